@@ -34,6 +34,9 @@ import de.robv.android.xposed.callbacks.XCallback;
  * {@link #beforeHookedMethod} and/or {@link #afterHookedMethod}.
  */
 public abstract class XC_MethodHook extends XCallback {
+    // name id of this callback in the hook profiler, assigned on its first call
+    int profileId;
+
     /**
      * Creates a new callback with default priority.
      */
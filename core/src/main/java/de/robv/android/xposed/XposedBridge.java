@@ -25,6 +25,7 @@ import android.content.res.Resources;
 import android.content.res.TypedArray;
 import android.util.Log;
 
+import org.lsposed.lspd.impl.HookProfiler;
 import org.lsposed.lspd.impl.LSPosedBridge;
 import org.lsposed.lspd.impl.LSPosedHookCallback;
 import org.lsposed.lspd.nativebridge.HookBridge;
@@ -37,6 +38,7 @@ import java.lang.reflect.Member;
 import java.lang.reflect.Method;
 import java.lang.reflect.Modifier;
 import java.lang.reflect.Proxy;
+import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.HashSet;
 import java.util.Set;
@@ -193,6 +195,17 @@ public final class XposedBridge {
      * @see #hookAllConstructors
      */
     public static XC_MethodHook.Unhook hookMethod(Member hookMethod, XC_MethodHook callback) {
+        checkHookable(hookMethod, callback);
+
+        if (!HookBridge.hookMethod(false, (Executable) hookMethod, LSPosedBridge.NativeHooker.class, callback.priority, callback)) {
+            log("Failed to hook " + hookMethod);
+            return null;
+        }
+
+        return callback.new Unhook(hookMethod);
+    }
+
+    private static void checkHookable(Member hookMethod, XC_MethodHook callback) {
         if (!(hookMethod instanceof Executable)) {
             throw new IllegalArgumentException("Only methods and constructors can be hooked: " + hookMethod);
         } else if (Modifier.isAbstract(hookMethod.getModifiers())) {
@@ -206,13 +219,26 @@ public final class XposedBridge {
         if (callback == null) {
             throw new IllegalArgumentException("callback should not be null!");
         }
+    }
 
-        if (!HookBridge.hookMethod(false, (Executable) hookMethod, LSPosedBridge.NativeHooker.class, callback.priority, callback)) {
-            log("Failed to hook " + hookMethod);
-            return null;
+    // Same as hookMethod for each of hookMethods, but installs all of them in one native call
+    private static Set<XC_MethodHook.Unhook> hookMethods(Member[] hookMethods, XC_MethodHook callback) {
+        var executables = new Executable[hookMethods.length];
+        for (int i = 0; i < hookMethods.length; ++i) {
+            checkHookable(hookMethods[i], callback);
+            executables[i] = (Executable) hookMethods[i];
         }
-
-        return callback.new Unhook(hookMethod);
+        var hooked = HookBridge.hookMethods(false, executables, LSPosedBridge.NativeHooker.class, callback.priority, callback);
+        Set<XC_MethodHook.Unhook> unhooks = new HashSet<>();
+        for (int i = 0; i < hookMethods.length; ++i) {
+            if (hooked[i]) {
+                unhooks.add(callback.new Unhook(hookMethods[i]));
+            } else {
+                log("Failed to hook " + hookMethods[i]);
+                unhooks.add(null);
+            }
+        }
+        return unhooks;
     }
 
     /**
@@ -242,11 +268,11 @@ public final class XposedBridge {
      */
     @SuppressWarnings("UnusedReturnValue")
     public static Set<XC_MethodHook.Unhook> hookAllMethods(Class<?> hookClass, String methodName, XC_MethodHook callback) {
-        Set<XC_MethodHook.Unhook> unhooks = new HashSet<>();
+        var methods = new ArrayList<Member>();
         for (Member method : hookClass.getDeclaredMethods())
             if (method.getName().equals(methodName))
-                unhooks.add(hookMethod(method, callback));
-        return unhooks;
+                methods.add(method);
+        return hookMethods(methods.toArray(new Member[0]), callback);
     }
 
     /**
@@ -258,10 +284,7 @@ public final class XposedBridge {
      */
     @SuppressWarnings("UnusedReturnValue")
     public static Set<XC_MethodHook.Unhook> hookAllConstructors(Class<?> hookClass, XC_MethodHook callback) {
-        Set<XC_MethodHook.Unhook> unhooks = new HashSet<>();
-        for (Member constructor : hookClass.getDeclaredConstructors())
-            unhooks.add(hookMethod(constructor, callback));
-        return unhooks;
+        return hookMethods(hookClass.getDeclaredConstructors(), callback);
     }
 
     /**
@@ -387,20 +410,23 @@ public final class XposedBridge {
         private final XC_MethodHook.MethodHookParam<T> param;
         private final LSPosedHookCallback<T> callback;
         private final Object[] snapshot;
+        private final int profileId;
 
         private int beforeIdx;
 
-        public LegacyApiSupport(LSPosedHookCallback<T> callback, Object[] legacySnapshot) {
+        public LegacyApiSupport(LSPosedHookCallback<T> callback, Object[] legacySnapshot, int profileId) {
             this.param = new XC_MethodHook.MethodHookParam<>();
             this.callback = callback;
             this.snapshot = legacySnapshot;
+            this.profileId = profileId;
         }
 
         public void handleBefore() {
             syncronizeApi(param, callback, true);
             for (beforeIdx = 0; beforeIdx < snapshot.length; beforeIdx++) {
+                var cb = (XC_MethodHook) snapshot[beforeIdx];
+                long start = profileId != 0 ? HookBridge.profilerNow() : 0;
                 try {
-                    var cb = (XC_MethodHook) snapshot[beforeIdx];
                     cb.beforeHookedMethod(param);
                 } catch (Throwable t) {
                     XposedBridge.log(t);
@@ -409,6 +435,10 @@ public final class XposedBridge {
                     param.setResult(null);
                     param.returnEarly = false;
                     continue;
+                } finally {
+                    if (profileId != 0) {
+                        HookBridge.profilerRecord(profileId, profileIdOf(cb), HookProfiler.BEFORE, start);
+                    }
                 }
 
                 if (param.returnEarly) {
@@ -425,8 +455,9 @@ public final class XposedBridge {
             for (int afterIdx = beforeIdx - 1; afterIdx >= 0; afterIdx--) {
                 Object lastResult = param.getResult();
                 Throwable lastThrowable = param.getThrowable();
+                var cb = (XC_MethodHook) snapshot[afterIdx];
+                long start = profileId != 0 ? HookBridge.profilerNow() : 0;
                 try {
-                    var cb = (XC_MethodHook) snapshot[afterIdx];
                     cb.afterHookedMethod(param);
                 } catch (Throwable t) {
                     XposedBridge.log(t);
@@ -438,10 +469,18 @@ public final class XposedBridge {
                         param.setThrowable(lastThrowable);
                     }
                 }
+                if (profileId != 0) {
+                    HookBridge.profilerRecord(profileId, profileIdOf(cb), HookProfiler.AFTER, start);
+                }
             }
             syncronizeApi(param, callback, false);
         }
 
+        private static int profileIdOf(XC_MethodHook cb) {
+            if (cb.profileId == 0) cb.profileId = HookProfiler.callbackId(cb.getClass());
+            return cb.profileId;
+        }
+
         private void syncronizeApi(XC_MethodHook.MethodHookParam<T> param, LSPosedHookCallback<T> callback, boolean forward) {
             if (forward) {
                 param.method = callback.method;
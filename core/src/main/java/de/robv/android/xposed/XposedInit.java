@@ -40,6 +40,7 @@ import android.os.IBinder;
 import android.os.Process;
 import android.util.ArrayMap;
 
+import org.lsposed.lspd.impl.HookProfiler;
 import org.lsposed.lspd.impl.LSPosedContext;
 import org.lsposed.lspd.models.PreLoadedApk;
 import org.lsposed.lspd.nativebridge.NativeAPI;
@@ -312,6 +313,7 @@ public final class XposedInit {
 
         var initLoader = XposedInit.class.getClassLoader();
         var mcl = LspModuleClassLoader.loadApk(apk, file.preLoadedDexes, librarySearchPath, initLoader);
+        HookProfiler.registerModule(mcl, name);
 
         try {
             if (mcl.loadClass(XposedBridge.class.getName()).getClassLoader() != initLoader) {
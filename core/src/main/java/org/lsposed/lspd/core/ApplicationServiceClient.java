@@ -20,10 +20,13 @@
 package org.lsposed.lspd.core;
 
 import android.os.IBinder;
+import android.os.Parcel;
 import android.os.ParcelFileDescriptor;
 import android.os.RemoteException;
+import android.os.SharedMemory;
 
 import androidx.annotation.NonNull;
+import androidx.annotation.Nullable;
 
 import org.lsposed.lspd.models.Module;
 import org.lsposed.lspd.service.ILSPApplicationService;
@@ -33,6 +36,11 @@ import java.util.Collections;
 import java.util.List;
 
 public class ApplicationServiceClient implements ILSPApplicationService, IBinder.DeathRecipient {
+    // raw transactions, keep in sync with LSPApplicationService
+    private final static int DEX_CACHE_TRANSACTION_CODE = 1146634051;
+    private final static int PUBLISH_DEX_CACHE_TRANSACTION_CODE = 1146634052;
+    private final static int PUBLISH_HOOK_PROFILE_TRANSACTION_CODE = 1212895302;
+
     public static ApplicationServiceClient serviceClient = null;
 
     final ILSPApplicationService service;
@@ -101,6 +109,53 @@ public class ApplicationServiceClient implements ILSPApplicationService, IBinder
         return null;
     }
 
+    @Nullable
+    public SharedMemory requestDexCache(@NonNull String key) {
+        var data = Parcel.obtain();
+        var reply = Parcel.obtain();
+        try {
+            data.writeString(key);
+            if (service.asBinder().transact(DEX_CACHE_TRANSACTION_CODE, data, reply, 0)) {
+                return SharedMemory.CREATOR.createFromParcel(reply);
+            }
+        } catch (RemoteException | NullPointerException ignored) {
+        } finally {
+            data.recycle();
+            reply.recycle();
+        }
+        return null;
+    }
+
+    public boolean publishDexCache(@NonNull String key, @NonNull ParcelFileDescriptor fd, long size) {
+        var data = Parcel.obtain();
+        var reply = Parcel.obtain();
+        try {
+            data.writeString(key);
+            data.writeFileDescriptor(fd.getFileDescriptor());
+            data.writeLong(size);
+            return service.asBinder().transact(PUBLISH_DEX_CACHE_TRANSACTION_CODE, data, reply, 0);
+        } catch (RemoteException | NullPointerException ignored) {
+        } finally {
+            data.recycle();
+            reply.recycle();
+        }
+        return false;
+    }
+
+    public boolean publishHookProfile(@NonNull byte[] report) {
+        var data = Parcel.obtain();
+        var reply = Parcel.obtain();
+        try {
+            data.writeByteArray(report);
+            return service.asBinder().transact(PUBLISH_HOOK_PROFILE_TRANSACTION_CODE, data, reply, 0);
+        } catch (RemoteException | NullPointerException ignored) {
+        } finally {
+            data.recycle();
+            reply.recycle();
+        }
+        return false;
+    }
+
     @Override
     public IBinder asBinder() {
         return service.asBinder();
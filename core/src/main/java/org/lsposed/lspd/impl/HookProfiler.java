@@ -0,0 +1,69 @@
+package org.lsposed.lspd.impl;
+
+import androidx.annotation.NonNull;
+
+import org.lsposed.lspd.core.ApplicationServiceClient;
+import org.lsposed.lspd.nativebridge.HookBridge;
+import org.lsposed.lspd.util.Utils;
+
+import java.lang.reflect.Executable;
+import java.util.Collections;
+import java.util.Map;
+import java.util.WeakHashMap;
+
+/**
+ * Opt-in timing of hook callbacks and hooked methods, see hook_profiler.h. The counters live
+ * in native, this only names methods and callbacks and sends the report to the daemon, which
+ * keeps the latest one of every process in the log directory.
+ */
+public final class HookProfiler {
+    public static final boolean ENABLED = HookBridge.profilerEnabled();
+
+    // keep in sync with hook_profiler::Phase
+    public static final int BEFORE = 0;
+    public static final int AFTER = 1;
+    public static final int ORIGINAL = 2;
+
+    private static final long REPORT_INTERVAL_MS = 60 * 1000;
+
+    private static final Map<ClassLoader, String> modules = Collections.synchronizedMap(new WeakHashMap<>());
+    private static Thread reporter = null;
+
+    private HookProfiler() {
+    }
+
+    public static void registerModule(@NonNull ClassLoader loader, @NonNull String packageName) {
+        if (ENABLED) modules.put(loader, packageName);
+    }
+
+    static int methodId(@NonNull Executable method) {
+        startReporter();
+        return HookBridge.profilerRegisterName(method.toString());
+    }
+
+    // callbacks are named by module and class separated by a tab, the daemon groups the report
+    // by module. The callers keep the id, so nothing here holds on to callbacks.
+    public static int callbackId(@NonNull Class<?> callback) {
+        var module = modules.get(callback.getClassLoader());
+        return HookBridge.profilerRegisterName((module != null ? module : "unknown") + '\t' + callback.getName());
+    }
+
+    private static synchronized void startReporter() {
+        if (reporter != null) return;
+        reporter = new Thread(() -> {
+            while (true) {
+                try {
+                    Thread.sleep(REPORT_INTERVAL_MS);
+                } catch (InterruptedException e) {
+                    return;
+                }
+                var client = ApplicationServiceClient.serviceClient;
+                if (client != null && !client.publishHookProfile(HookBridge.profilerReport())) {
+                    Utils.logW("daemon rejected hook profile");
+                }
+            }
+        }, "LSPosedHookProfiler");
+        reporter.setDaemon(true);
+        reporter.start();
+    }
+}
@@ -36,6 +36,8 @@ public class LSPosedBridge {
     }
 
     public static class HookerCallback {
+        @NonNull
+        final Class<?> hooker;
         @NonNull
         final Method beforeInvocation;
         @NonNull
@@ -44,7 +46,11 @@ public class LSPosedBridge {
         final int beforeParams;
         final int afterParams;
 
-        public HookerCallback(@NonNull Method beforeInvocation, @NonNull Method afterInvocation) {
+        // name id in the hook profiler, assigned on the first call
+        int profileId;
+
+        public HookerCallback(@NonNull Class<?> hooker, @NonNull Method beforeInvocation, @NonNull Method afterInvocation) {
+            this.hooker = hooker;
             this.beforeInvocation = beforeInvocation;
             this.afterInvocation = afterInvocation;
             this.beforeParams = beforeInvocation.getParameterCount();
@@ -62,8 +68,17 @@ public class LSPosedBridge {
     }
 
     public static class NativeHooker<T extends Executable> {
+        private static final Object[][] NO_CALLBACKS = {new Object[0], new Object[0]};
+
         private final Object params;
 
+        // 0 unless the profiler is enabled
+        private final int profileId;
+
+        // {modern, legacy}, replaced as a whole by HookBridge whenever a callback is added or
+        // removed, so reading it needs neither a lock nor a copy
+        private volatile Object[][] callbacks = NO_CALLBACKS;
+
         private NativeHooker(Executable method) {
             var isStatic = Modifier.isStatic(method.getModifiers());
             Object returnType;
@@ -77,6 +92,12 @@ public class LSPosedBridge {
                     returnType,
                     isStatic,
             };
+            profileId = HookProfiler.ENABLED ? HookProfiler.methodId(method) : 0;
+        }
+
+        private static int profileIdOf(HookerCallback hooker) {
+            if (hooker.profileId == 0) hooker.profileId = HookProfiler.callbackId(hooker.hooker);
+            return hooker.profileId;
         }
 
         // This method is quite critical. We should try not to use system methods to avoid
@@ -104,15 +125,21 @@ public class LSPosedBridge {
                 }
             }
 
-            Object[][] callbacksSnapshot = HookBridge.callbackSnapshot(HookerCallback.class, method);
+            Object[][] callbacksSnapshot = callbacks;
             Object[] modernSnapshot = callbacksSnapshot[0];
             Object[] legacySnapshot = callbacksSnapshot[1];
 
+            var profileId = this.profileId;
             if (modernSnapshot.length == 0 && legacySnapshot.length == 0) {
+                long start = profileId != 0 ? HookBridge.profilerNow() : 0;
                 try {
                     return HookBridge.invokeOriginalMethod(method, callback.thisObject, callback.args);
                 } catch (InvocationTargetException ite) {
                     throw (Throwable) HookBridge.invokeOriginalMethod(getCause, ite);
+                } finally {
+                    if (profileId != 0) {
+                        HookBridge.profilerRecord(profileId, 0, HookProfiler.ORIGINAL, start);
+                    }
                 }
             }
 
@@ -122,8 +149,9 @@ public class LSPosedBridge {
             // call "before method" callbacks
             int beforeIdx;
             for (beforeIdx = 0; beforeIdx < modernSnapshot.length; beforeIdx++) {
+                var hooker = (HookerCallback) modernSnapshot[beforeIdx];
+                long start = profileId != 0 ? HookBridge.profilerNow() : 0;
                 try {
-                    var hooker = (HookerCallback) modernSnapshot[beforeIdx];
                     if (hooker.beforeParams == 0) {
                         ctxArray[beforeIdx] = hooker.beforeInvocation.invoke(null);
                     } else {
@@ -136,6 +164,10 @@ public class LSPosedBridge {
                     callback.setResult(null);
                     callback.isSkipped = false;
                     continue;
+                } finally {
+                    if (profileId != 0) {
+                        HookBridge.profilerRecord(profileId, profileIdOf(hooker), HookProfiler.BEFORE, start);
+                    }
                 }
 
                 if (callback.isSkipped) {
@@ -147,12 +179,13 @@ public class LSPosedBridge {
 
             if (!callback.isSkipped && legacySnapshot.length != 0) {
                 // TODO: Separate classloader
-                legacy = new XposedBridge.LegacyApiSupport<>(callback, legacySnapshot);
+                legacy = new XposedBridge.LegacyApiSupport<>(callback, legacySnapshot, profileId);
                 legacy.handleBefore();
             }
 
             // call original method if not requested otherwise
             if (!callback.isSkipped) {
+                long start = profileId != 0 ? HookBridge.profilerNow() : 0;
                 try {
                     var result = HookBridge.invokeOriginalMethod(method, callback.thisObject, callback.args);
                     callback.setResult(result);
@@ -160,6 +193,9 @@ public class LSPosedBridge {
                     var throwable = (Throwable) HookBridge.invokeOriginalMethod(getCause, e);
                     callback.setThrowable(throwable);
                 }
+                if (profileId != 0) {
+                    HookBridge.profilerRecord(profileId, 0, HookProfiler.ORIGINAL, start);
+                }
             }
 
             // call "after method" callbacks
@@ -167,6 +203,7 @@ public class LSPosedBridge {
                 Object lastResult = callback.getResult();
                 Throwable lastThrowable = callback.getThrowable();
                 var hooker = (HookerCallback) modernSnapshot[afterIdx];
+                long start = profileId != 0 ? HookBridge.profilerNow() : 0;
                 try {
                     if (hooker.afterParams == 0) {
                         hooker.afterInvocation.invoke(null);
@@ -185,6 +222,9 @@ public class LSPosedBridge {
                         callback.setThrowable(lastThrowable);
                     }
                 }
+                if (profileId != 0) {
+                    HookBridge.profilerRecord(profileId, profileIdOf(hooker), HookProfiler.AFTER, start);
+                }
             }
 
             if (legacy != null) {
@@ -278,7 +318,7 @@ public class LSPosedBridge {
             throw new HookFailedError(e);
         }
 
-        var callback = new LSPosedBridge.HookerCallback(beforeInvocation, afterInvocation);
+        var callback = new LSPosedBridge.HookerCallback(hooker, beforeInvocation, afterInvocation);
         if (HookBridge.hookMethod(true, hookMethod, LSPosedBridge.NativeHooker.class, priority, callback)) {
             return new XposedInterface.MethodUnhooker<>() {
                 @NonNull
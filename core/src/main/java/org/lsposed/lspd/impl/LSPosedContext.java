@@ -97,6 +97,7 @@ public class LSPosedContext implements XposedInterface {
             var librarySearchPath = sb.toString();
             var initLoader = XposedModule.class.getClassLoader();
             var mcl = LspModuleClassLoader.loadApk(module.apkPath, module.file.preLoadedDexes, librarySearchPath, initLoader);
+            HookProfiler.registerModule(mcl, module.packageName);
             if (mcl.loadClass(XposedModule.class.getName()).getClassLoader() != initLoader) {
                 Log.e(TAG, "  Cannot load module: " + module.packageName);
                 Log.e(TAG, "  The Xposed API classes are compiled into the module's APK.");
@@ -245,52 +246,18 @@ public class LSPosedContext implements XposedInterface {
         HookBridge.invokeOriginalMethod(constructor, thisObject, args);
     }
 
-    private static char getTypeShorty(Class<?> type) {
-        if (type == int.class) {
-            return 'I';
-        } else if (type == long.class) {
-            return 'J';
-        } else if (type == float.class) {
-            return 'F';
-        } else if (type == double.class) {
-            return 'D';
-        } else if (type == boolean.class) {
-            return 'Z';
-        } else if (type == byte.class) {
-            return 'B';
-        } else if (type == char.class) {
-            return 'C';
-        } else if (type == short.class) {
-            return 'S';
-        } else if (type == void.class) {
-            return 'V';
-        } else {
-            return 'L';
-        }
-    }
-
-    private static char[] getExecutableShorty(Executable executable) {
-        var parameterTypes = executable.getParameterTypes();
-        var shorty = new char[parameterTypes.length + 1];
-        shorty[0] = getTypeShorty(executable instanceof Method ? ((Method) executable).getReturnType() : void.class);
-        for (int i = 1; i < shorty.length; i++) {
-            shorty[i] = getTypeShorty(parameterTypes[i - 1]);
-        }
-        return shorty;
-    }
-
     @Nullable
     @Override
     public Object invokeSpecial(@NonNull Method method, @NonNull Object thisObject, Object... args) throws InvocationTargetException, IllegalArgumentException, IllegalAccessException {
         if (Modifier.isStatic(method.getModifiers())) {
             throw new IllegalArgumentException("Cannot invoke special on static method: " + method);
         }
-        return HookBridge.invokeSpecialMethod(method, getExecutableShorty(method), method.getDeclaringClass(), thisObject, args);
+        return HookBridge.invokeSpecialMethod(method, method.getDeclaringClass(), thisObject, args);
     }
 
     @Override
     public <T> void invokeSpecial(@NonNull Constructor<T> constructor, @NonNull T thisObject, Object... args) throws InvocationTargetException, IllegalArgumentException, IllegalAccessException {
-        HookBridge.invokeSpecialMethod(constructor, getExecutableShorty(constructor), constructor.getDeclaringClass(), thisObject, args);
+        HookBridge.invokeSpecialMethod(constructor, constructor.getDeclaringClass(), thisObject, args);
     }
 
     @NonNull
@@ -309,7 +276,7 @@ public class LSPosedContext implements XposedInterface {
             throw new IllegalArgumentException(subClass + " is not inherited from " + superClass);
         }
         var obj = HookBridge.allocateObject(subClass);
-        HookBridge.invokeSpecialMethod(constructor, getExecutableShorty(constructor), superClass, obj, args);
+        HookBridge.invokeSpecialMethod(constructor, superClass, obj, args);
         return obj;
     }
 
@@ -0,0 +1,88 @@
+package org.lsposed.lspd.impl.utils;
+
+import android.os.ParcelFileDescriptor;
+import android.os.SharedMemory;
+import android.system.Os;
+
+import androidx.annotation.NonNull;
+import androidx.annotation.Nullable;
+
+import org.lsposed.lspd.core.ApplicationServiceClient;
+import org.lsposed.lspd.nativebridge.DexParserBridge;
+import org.lsposed.lspd.util.Utils;
+
+import java.nio.ByteBuffer;
+import java.util.Set;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
+
+/**
+ * Parsed dex caches shared through the daemon with other processes of the same uid. The
+ * daemon only stores them, so the first process opening a dex builds the cache in the
+ * background and publishes it.
+ */
+final class DexCache {
+    private static final Set<String> published = ConcurrentHashMap.newKeySet();
+    // building a cache parses the dex once more, so they are built one at a time
+    private static final ExecutorService publisher = Executors.newSingleThreadExecutor(r -> {
+        var thread = new Thread(r, "LSPosedDexCache");
+        thread.setDaemon(true);
+        return thread;
+    });
+
+    private DexCache() {
+    }
+
+    // hex of the checksum and SHA-1 signature, 8 to 32 in the dex header
+    @Nullable
+    static String keyOf(@NonNull ByteBuffer data) {
+        if (data.capacity() < 32) return null;
+        var key = new StringBuilder(48);
+        for (int i = 8; i < 32; ++i) {
+            var b = data.get(i) & 0xff;
+            key.append(Character.forDigit(b >> 4, 16)).append(Character.forDigit(b & 0xf, 16));
+        }
+        return key.toString();
+    }
+
+    @Nullable
+    static ByteBuffer map(@NonNull String key) {
+        var client = ApplicationServiceClient.serviceClient;
+        if (client == null) return null;
+        try (var memory = client.requestDexCache(key)) {
+            // the mapping stays valid after the memory is closed
+            return memory != null ? memory.mapReadOnly() : null;
+        } catch (Throwable e) {
+            Utils.logW("map dex cache " + key, e);
+            return null;
+        }
+    }
+
+    static void unmap(@NonNull ByteBuffer cache) {
+        SharedMemory.unmap(cache);
+    }
+
+    // data may be the buffer of the caller, which is free to reuse or unmap it once the parser
+    // is closed, so the cache is built from a copy
+    static void publishAsync(@NonNull String key, @NonNull ByteBuffer data) {
+        var client = ApplicationServiceClient.serviceClient;
+        if (client == null || !published.add(key)) return;
+        var source = data.duplicate();
+        source.clear();
+        var copy = ByteBuffer.allocateDirect(source.capacity());
+        copy.put(source);
+        publisher.execute(() -> {
+            var fd = DexParserBridge.writeDexCache(copy);
+            if (fd < 0) return;
+            try (var pfd = ParcelFileDescriptor.adoptFd(fd)) {
+                var size = Os.fstat(pfd.getFileDescriptor()).st_size;
+                if (!client.publishDexCache(key, pfd, size)) {
+                    Utils.logW("daemon rejected dex cache " + key);
+                }
+            } catch (Throwable e) {
+                Utils.logW("publish dex cache " + key, e);
+            }
+        });
+    }
+}
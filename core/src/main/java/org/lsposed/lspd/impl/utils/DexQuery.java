@@ -0,0 +1,94 @@
+package org.lsposed.lspd.impl.utils;
+
+import androidx.annotation.NonNull;
+
+import java.util.Arrays;
+
+/**
+ * Predicates for {@link LSPosedDexParser#findClasses} and {@link LSPosedDexParser#findMethods}.
+ * All of them have to hold, and id lists match if every id is present. Annotation predicates
+ * only match dex files opened with annotations.
+ */
+public final class DexQuery {
+    // keep in sync with Query::Kind in dex_parser.cpp
+    private static final int CLASS_ACCESS_FLAGS = 0;
+    private static final int SUPERCLASS = 1;
+    private static final int INTERFACES = 2;
+    private static final int CLASS_ANNOTATIONS = 3;
+    private static final int METHOD_ACCESS_FLAGS = 4;
+    private static final int METHOD_ANNOTATIONS = 5;
+    private static final int REFERRED_STRINGS = 6;
+    private static final int INVOKED_METHODS = 7;
+    private static final int ACCESSED_FIELDS = 8;
+    private static final int ASSIGNED_FIELDS = 9;
+
+    private int[] predicates = new int[16];
+    private int size = 0;
+
+    @NonNull
+    private DexQuery add(int kind, @NonNull int... values) {
+        if (size + 2 + values.length > predicates.length) {
+            predicates = Arrays.copyOf(predicates, Math.max(2 * predicates.length, size + 2 + values.length));
+        }
+        predicates[size++] = kind;
+        predicates[size++] = values.length;
+        System.arraycopy(values, 0, predicates, size, values.length);
+        size += values.length;
+        return this;
+    }
+
+    @NonNull
+    public DexQuery classAccessFlags(int required, int forbidden) {
+        return add(CLASS_ACCESS_FLAGS, required, forbidden);
+    }
+
+    @NonNull
+    public DexQuery superClass(int typeId) {
+        return add(SUPERCLASS, typeId);
+    }
+
+    @NonNull
+    public DexQuery interfaces(@NonNull int... typeIds) {
+        return add(INTERFACES, typeIds);
+    }
+
+    @NonNull
+    public DexQuery classAnnotations(@NonNull int... typeIds) {
+        return add(CLASS_ANNOTATIONS, typeIds);
+    }
+
+    @NonNull
+    public DexQuery methodAccessFlags(int required, int forbidden) {
+        return add(METHOD_ACCESS_FLAGS, required, forbidden);
+    }
+
+    @NonNull
+    public DexQuery methodAnnotations(@NonNull int... typeIds) {
+        return add(METHOD_ANNOTATIONS, typeIds);
+    }
+
+    @NonNull
+    public DexQuery referredStrings(@NonNull int... stringIds) {
+        return add(REFERRED_STRINGS, stringIds);
+    }
+
+    @NonNull
+    public DexQuery invokedMethods(@NonNull int... methodIds) {
+        return add(INVOKED_METHODS, methodIds);
+    }
+
+    @NonNull
+    public DexQuery accessedFields(@NonNull int... fieldIds) {
+        return add(ACCESSED_FIELDS, fieldIds);
+    }
+
+    @NonNull
+    public DexQuery assignedFields(@NonNull int... fieldIds) {
+        return add(ASSIGNED_FIELDS, fieldIds);
+    }
+
+    @NonNull
+    int[] toArray() {
+        return Arrays.copyOf(predicates, size);
+    }
+}
@@ -7,15 +7,34 @@ import org.lsposed.lspd.nativebridge.DexParserBridge;
 
 import java.io.IOException;
 import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.util.Arrays;
 
 import io.github.libxposed.api.utils.DexParser;
 
 public class LSPosedDexParser implements DexParser {
+    private static final int BATCH_BUFFER_SIZE = 256 * 1024;
+
+    // keep in sync with DexParserBridge.getXrefs
+    private static final int XREF_STRING_REFERRERS = 0;
+    private static final int XREF_METHOD_CALLERS = 1;
+    private static final int XREF_FIELD_READERS = 2;
+    private static final int XREF_FIELD_WRITERS = 3;
+
+    // record sizes in ints of the annotation arena, keep in sync with dex_parser.cpp
+    private static final int VALUE_RECORD_SIZE = 4;
+    private static final int ELEMENT_RECORD_SIZE = 1 + VALUE_RECORD_SIZE;
+
     long cookie;
+    // mapped dex cache, method bodies are read from it until close
+    @Nullable
+    ByteBuffer cache;
 
     @NonNull
     final ByteBuffer data;
     @NonNull
+    final int[] stringOffsets;
+    @NonNull
     final StringId[] strings;
     @NonNull
     final TypeId[] typeIds;
@@ -25,36 +44,49 @@ public class LSPosedDexParser implements DexParser {
     final FieldId[] fieldIds;
     @NonNull
     final MethodId[] methodIds;
+    // annotations and arrays are decoded from the native arena on first use
+    @Nullable
+    final ByteBuffer annotationData;
     @NonNull
     final Annotation[] annotations;
     @NonNull
     final Array[] arrays;
 
     public LSPosedDexParser(@NonNull ByteBuffer buffer, boolean includeAnnotations) throws IOException {
-        if (!buffer.isDirect() || !buffer.asReadOnlyBuffer().hasArray()) {
-            data = ByteBuffer.allocateDirect(buffer.capacity());
-            data.put(buffer);
-        } else {
-            data = buffer;
-        }
+        this(directBuffer(buffer), includeAnnotations, 0, null, null);
+    }
+
+    // opened is the native output from openDexes, which took cache, or null to open data here
+    private LSPosedDexParser(@NonNull ByteBuffer data, boolean includeAnnotations, long cookie, @Nullable ByteBuffer cache, @Nullable Object opened) throws IOException {
+        this.data = data;
+        this.cookie = cookie;
+        this.cache = cache;
         try {
-            long[] args = new long[2];
-            args[1] = includeAnnotations ? 1 : 0;
-            var out = (Object[]) DexParserBridge.openDex(buffer, args);
-            cookie = args[0];
-            // out[0]: String[]
+            Object[] out;
+            if (opened == null) {
+                long[] args = new long[3];
+                args[1] = includeAnnotations ? 1 : 0;
+                // annotation values are not cached
+                var key = includeAnnotations ? null : DexCache.keyOf(data);
+                if (key != null) this.cache = DexCache.map(key);
+                try {
+                    out = (Object[]) DexParserBridge.openDex(data, args, cache);
+                } finally {
+                    this.cookie = args[0];
+                }
+                if (key != null && args[2] == 0) DexCache.publishAsync(key, data);
+            } else {
+                out = (Object[]) opened;
+            }
+            // out[0]: int[]
             // out[1]: int[]
             // out[2]: int[][]
             // out[3]: int[]
             // out[4]: int[]
-            // out[5]: int[]
-            // out[6]: Object[]
-            // out[7]: Object[]
-            var strings = (Object[]) out[0];
-            this.strings = new StringId[strings.length];
-            for (int i = 0; i < strings.length; ++i) {
-                this.strings[i] = new LSPosedStringId(i, strings[i]);
-            }
+            // out[5]: ByteBuffer
+            // strings are decoded from the buffer on first use, most scans touch only a few
+            this.stringOffsets = (int[]) out[0];
+            this.strings = new StringId[stringOffsets.length];
 
             var typeIds = (int[]) out[1];
             this.typeIds = new TypeId[typeIds.length];
@@ -80,28 +112,87 @@ public class LSPosedDexParser implements DexParser {
                 this.methodIds[i] = new LSPosedMethodId(i, methodIds[3 * i], methodIds[3 * i + 1], methodIds[3 * i + 2]);
             }
 
-            if (out[5] != null && out[6] != null) {
-                var a = (int[]) out[5];
-                var b = (Object[]) out[6];
-                this.annotations = new Annotation[a.length / 2];
-                for (int i = 0; i < this.annotations.length; ++i) {
-                    this.annotations[i] = new LSPosedAnnotation(a[2 * i], a[2 * i + 1], (int[]) b[2 * i], (Object[]) b[2 * i + 1]);
-                }
+            if (out[5] != null) {
+                this.annotationData = ((ByteBuffer) out[5]).order(ByteOrder.nativeOrder());
+                this.annotations = new Annotation[annotationData.getInt(0)];
+                this.arrays = new Array[annotationData.getInt(Integer.BYTES)];
             } else {
+                this.annotationData = null;
                 this.annotations = new Annotation[0];
-            }
-            if (out[7] != null) {
-                var b = (Object[]) out[7];
-                this.arrays = new Array[b.length / 2];
-                for (int i = 0; i < this.arrays.length; ++i) {
-                    this.arrays[i] = new LSPosedArray((int[]) b[2 * i], (Object[]) b[2 * i + 1]);
-                }
-            } else {
                 this.arrays = new Array[0];
             }
         } catch (Throwable e) {
+            close();
+            throw new IOException("Invalid dex file", e);
+        }
+    }
+
+    @NonNull
+    private static ByteBuffer directBuffer(@NonNull ByteBuffer buffer) {
+        if (!buffer.isDirect() || !buffer.asReadOnlyBuffer().hasArray()) {
+            var data = ByteBuffer.allocateDirect(buffer.capacity());
+            data.put(buffer);
+            return data;
+        } else {
+            return buffer;
+        }
+    }
+
+    /**
+     * Opens several dex files, e.g. every classesN.dex of an apk. The native parsing runs
+     * concurrently on a small worker pool. Like the constructor, a dex with a published cache
+     * is loaded from it and the others publish theirs.
+     */
+    @NonNull
+    public static LSPosedDexParser[] openAll(@NonNull ByteBuffer[] buffers, boolean includeAnnotations) throws IOException {
+        var data = new ByteBuffer[buffers.length];
+        var keys = new String[buffers.length];
+        var caches = new ByteBuffer[buffers.length];
+        for (int i = 0; i < buffers.length; ++i) {
+            data[i] = directBuffer(buffers[i]);
+            // annotation values are not cached
+            keys[i] = includeAnnotations ? null : DexCache.keyOf(data[i]);
+            if (keys[i] != null) caches[i] = DexCache.map(keys[i]);
+        }
+        var cookies = new long[buffers.length];
+        var cached = new boolean[buffers.length];
+        Object[] out;
+        try {
+            out = (Object[]) DexParserBridge.openDexes(data, cookies, caches, cached, includeAnnotations);
+        } catch (Throwable e) {
+            release(cookies, caches);
             throw new IOException("Invalid dex file", e);
         }
+        var parsers = new LSPosedDexParser[buffers.length];
+        try {
+            for (int i = 0; i < buffers.length; ++i) {
+                // a failed constructor closes the cookie and unmaps the cache itself
+                var cookie = cookies[i];
+                var cache = caches[i];
+                cookies[i] = 0;
+                caches[i] = null;
+                parsers[i] = new LSPosedDexParser(data[i], includeAnnotations, cookie, cache, out[i]);
+            }
+        } catch (IOException e) {
+            for (var parser : parsers) {
+                if (parser != null) parser.close();
+            }
+            release(cookies, caches);
+            throw e;
+        }
+        for (int i = 0; i < buffers.length; ++i) {
+            if (keys[i] != null && !cached[i]) DexCache.publishAsync(keys[i], data[i]);
+        }
+        return parsers;
+    }
+
+    private static void release(@NonNull long[] cookies, @NonNull ByteBuffer[] caches) {
+        for (var cookie : cookies) {
+            if (cookie != 0) DexParserBridge.closeDex(cookie);
+        }
+        for (var cache : caches) {
+            if (cache != null) DexCache.unmap(cache);
+        }
     }
 
     @Override
@@ -110,6 +201,10 @@ public class LSPosedDexParser implements DexParser {
             DexParserBridge.closeDex(cookie);
             cookie = 0;
         }
+        if (cache != null) {
+            DexCache.unmap(cache);
+            cache = null;
+        }
     }
 
     static class LSPosedId<Self extends Id<Self>> implements Id<Self> {
@@ -130,18 +225,62 @@ public class LSPosedDexParser implements DexParser {
         }
     }
 
-    static class LSPosedStringId extends LSPosedId<StringId> implements StringId {
-        @NonNull
-        final String string;
+    @NonNull
+    StringId stringId(int id) {
+        var string = strings[id];
+        if (string != null) return string;
+        synchronized (strings) {
+            if (strings[id] == null) {
+                strings[id] = new LSPosedStringId(id, stringOffsets[id]);
+            }
+            return strings[id];
+        }
+    }
+
+    // Decodes the MUTF-8 string_data_item at offset, which starts with its UTF-16 length.
+    @NonNull
+    String decodeString(int offset) {
+        int length = 0;
+        for (int shift = 0; ; shift += 7) {
+            int b = data.get(offset++) & 0xff;
+            length |= (b & 0x7f) << shift;
+            if ((b & 0x80) == 0) break;
+        }
+        var chars = new char[length];
+        for (int i = 0; i < length; ++i) {
+            int a = data.get(offset++) & 0xff;
+            if ((a & 0x80) == 0) {
+                chars[i] = (char) a;
+            } else if ((a & 0xe0) == 0xc0) {
+                int b = data.get(offset++) & 0x3f;
+                chars[i] = (char) (((a & 0x1f) << 6) | b);
+            } else {
+                int b = data.get(offset++) & 0x3f;
+                int c = data.get(offset++) & 0x3f;
+                chars[i] = (char) (((a & 0x0f) << 12) | (b << 6) | c);
+            }
+        }
+        return new String(chars);
+    }
+
+    class LSPosedStringId extends LSPosedId<StringId> implements StringId {
+        final int offset;
+        @Nullable
+        volatile String string;
 
-        LSPosedStringId(int id, @NonNull Object string) {
+        LSPosedStringId(int id, int offset) {
             super(id);
-            this.string = (String) string;
+            this.offset = offset;
         }
 
         @NonNull
         @Override
         public String getString() {
+            var string = this.string;
+            if (string == null) {
+                string = decodeString(offset);
+                this.string = string;
+            }
             return string;
         }
     }
@@ -152,7 +291,7 @@ public class LSPosedDexParser implements DexParser {
 
         LSPosedTypeId(int id, int descriptor) {
             super(id);
-            this.descriptor = strings[descriptor];
+            this.descriptor = stringId(descriptor);
         }
 
         @NonNull
@@ -172,7 +311,7 @@ public class LSPosedDexParser implements DexParser {
 
         LSPosedProtoId(int id, @NonNull int[] protoId) {
             super(id);
-            this.shorty = strings[protoId[0]];
+            this.shorty = stringId(protoId[0]);
             this.returnType = typeIds[protoId[1]];
             if (protoId.length > 2) {
                 this.parameters = new TypeId[protoId.length - 2];
@@ -215,7 +354,7 @@ public class LSPosedDexParser implements DexParser {
             super(id);
             this.type = typeIds[type];
             this.declaringClass = typeIds[declaringClass];
-            this.name = strings[name];
+            this.name = stringId(name);
         }
 
         @NonNull
@@ -249,7 +388,7 @@ public class LSPosedDexParser implements DexParser {
             super(id);
             this.declaringClass = typeIds[declaringClass];
             this.prototype = protoIds[prototype];
-            this.name = strings[name];
+            this.name = stringId(name);
         }
 
         @NonNull
@@ -271,14 +410,38 @@ public class LSPosedDexParser implements DexParser {
         }
     }
 
-    static class LSPosedArray implements Array {
+    // the arena layout is described in dex_parser.cpp, positions here are in ints
+    private int annotationInt(int pos) {
+        return annotationData.getInt(pos * Integer.BYTES);
+    }
+
+    @NonNull
+    synchronized Annotation annotation(int id) {
+        if (annotations[id] == null) {
+            // the arena is freed with the native parser
+            if (cookie == 0) throw new IllegalStateException("Closed");
+            annotations[id] = new LSPosedAnnotation(annotationInt(2 + id));
+        }
+        return annotations[id];
+    }
+
+    @NonNull
+    synchronized Array array(int id) {
+        if (arrays[id] == null) {
+            if (cookie == 0) throw new IllegalStateException("Closed");
+            arrays[id] = new LSPosedArray(annotationInt(2 + annotations.length + id));
+        }
+        return arrays[id];
+    }
+
+    class LSPosedArray implements Array {
         @NonNull
         final Value[] values;
 
-        LSPosedArray(int[] elements, @NonNull Object[] values) {
-            this.values = new Value[values.length];
+        LSPosedArray(int pos) {
+            this.values = new Value[annotationInt(pos)];
             for (int i = 0; i < values.length; ++i) {
-                this.values[i] = new LSPosedValue(elements[i], (ByteBuffer) values[i]);
+                this.values[i] = new LSPosedValue(pos + 1 + i * VALUE_RECORD_SIZE);
             }
         }
 
@@ -296,12 +459,12 @@ public class LSPosedDexParser implements DexParser {
         @NonNull
         final Element[] elements;
 
-        LSPosedAnnotation(int visibility, int type, @NonNull int[] elements, @NonNull Object[] elementValues) {
-            this.visibility = visibility;
-            this.type = typeIds[type];
-            this.elements = new Element[elementValues.length];
-            for (int i = 0; i < elementValues.length; ++i) {
-                this.elements[i] = new LSPosedElement(elements[i * 2], elements[i * 2 + 1], (ByteBuffer) elementValues[i]);
+        LSPosedAnnotation(int pos) {
+            this.visibility = annotationInt(pos);
+            this.type = typeIds[annotationInt(pos + 1)];
+            this.elements = new Element[annotationInt(pos + 2)];
+            for (int i = 0; i < elements.length; ++i) {
+                this.elements[i] = new LSPosedElement(pos + 3 + i * ELEMENT_RECORD_SIZE);
             }
         }
 
@@ -323,16 +486,21 @@ public class LSPosedDexParser implements DexParser {
         }
     }
 
-    static class LSPosedValue implements Value {
+    class LSPosedValue implements Value {
         final int valueType;
         @Nullable
         final byte[] value;
 
-        LSPosedValue(int valueType, @Nullable ByteBuffer value) {
-            this.valueType = valueType;
-            if (value != null) {
-                this.value = new byte[value.remaining()];
-                value.get(this.value);
+        // pos is a value record: type, width and the value as it is in memory
+        LSPosedValue(int pos) {
+            this.valueType = annotationInt(pos);
+            int width = annotationInt(pos + 1);
+            if (width > 0) {
+                this.value = new byte[width];
+                int offset = (pos + 2) * Integer.BYTES;
+                for (int i = 0; i < width; ++i) {
+                    this.value[i] = annotationData.get(offset + i);
+                }
             } else {
                 this.value = null;
             }
@@ -354,9 +522,9 @@ public class LSPosedDexParser implements DexParser {
         @NonNull
         final StringId name;
 
-        LSPosedElement(int name, int valueType, @Nullable ByteBuffer value) {
-            super(valueType, value);
-            this.name = strings[name];
+        LSPosedElement(int pos) {
+            super(pos + 1);
+            this.name = stringId(annotationInt(pos));
         }
 
         @NonNull
@@ -369,6 +537,9 @@ public class LSPosedDexParser implements DexParser {
     @NonNull
     @Override
     public StringId[] getStringId() {
+        for (int i = 0; i < strings.length; ++i) {
+            stringId(i);
+        }
         return strings;
     }
 
@@ -398,27 +569,214 @@ public class LSPosedDexParser implements DexParser {
 
     @NonNull
     @Override
-    public Annotation[] getAnnotations() {
+    synchronized public Annotation[] getAnnotations() {
+        for (int i = 0; i < annotations.length; ++i) {
+            annotation(i);
+        }
         return annotations;
     }
 
     @NonNull
     @Override
-    public Array[] getArrays() {
+    synchronized public Array[] getArrays() {
+        for (int i = 0; i < arrays.length; ++i) {
+            array(i);
+        }
         return arrays;
     }
 
+    /**
+     * Returns the type ids of the classes matching query. With method predicates a class
+     * matches if any of its methods does. Nothing is visited in Java.
+     */
+    @NonNull
+    synchronized public int[] findClasses(@NonNull DexQuery query) {
+        if (cookie == 0) {
+            throw new IllegalStateException("Closed");
+        }
+        return DexParserBridge.query(cookie, query.toArray(), false);
+    }
+
+    /**
+     * Returns the method ids of the methods matching query, in the order they are defined.
+     */
+    @NonNull
+    synchronized public int[] findMethods(@NonNull DexQuery query) {
+        if (cookie == 0) {
+            throw new IllegalStateException("Closed");
+        }
+        return DexParserBridge.query(cookie, query.toArray(), true);
+    }
+
+    /**
+     * Builds the reverse index behind {@link #getStringReferrers}, {@link #getMethodCallers},
+     * {@link #getFieldReaders} and {@link #getFieldWriters} with one pass over all code items,
+     * split across a few threads if parallel. The lookups build it on first use otherwise.
+     */
+    synchronized public void buildXrefIndex(boolean parallel) {
+        if (cookie == 0) {
+            throw new IllegalStateException("Closed");
+        }
+        DexParserBridge.buildXrefIndex(cookie, parallel);
+    }
+
+    @NonNull
+    synchronized private int[] getXrefs(int kind, int id) {
+        buildXrefIndex(true);
+        return DexParserBridge.getXrefs(cookie, kind, id);
+    }
+
+    /**
+     * Returns the sorted ids of the methods that refer to the string.
+     */
+    @NonNull
+    public int[] getStringReferrers(int stringId) {
+        return getXrefs(XREF_STRING_REFERRERS, stringId);
+    }
+
+    /**
+     * Returns the sorted ids of the methods that invoke the method.
+     */
+    @NonNull
+    public int[] getMethodCallers(int methodId) {
+        return getXrefs(XREF_METHOD_CALLERS, methodId);
+    }
+
+    /**
+     * Returns the sorted ids of the methods that read the field.
+     */
+    @NonNull
+    public int[] getFieldReaders(int fieldId) {
+        return getXrefs(XREF_FIELD_READERS, fieldId);
+    }
+
+    /**
+     * Returns the sorted ids of the methods that write the field.
+     */
+    @NonNull
+    public int[] getFieldWriters(int fieldId) {
+        return getXrefs(XREF_FIELD_WRITERS, fieldId);
+    }
+
     @Override
     synchronized public void visitDefinedClasses(@NonNull ClassVisitor visitor) {
         if (cookie == 0) {
             throw new IllegalStateException("Closed");
         }
-        var classVisitMethod = ClassVisitor.class.getDeclaredMethods()[0];
-        var fieldVisitMethod = FieldVisitor.class.getDeclaredMethods()[0];
-        var methodVisitMethod = MethodVisitor.class.getDeclaredMethods()[0];
-        var methodBodyVisitMethod = MethodBodyVisitor.class.getDeclaredMethods()[0];
-        var stopMethod = EarlyStopVisitor.class.getDeclaredMethods()[0];
+        // native fills the buffer with as many class records as fit, so crossing JNI happens
+        // once per batch instead of several times per class and member
+        var buffer = ByteBuffer.allocateDirect(BATCH_BUFFER_SIZE).order(ByteOrder.nativeOrder());
+        var records = new ClassRecords();
+        for (int from = 0; ; ) {
+            int next = DexParserBridge.visitClassBatch(cookie, buffer, from);
+            if (next < 0) {
+                // a single class that does not fit, -next is the size of its record
+                buffer = ByteBuffer.allocateDirect((1 - next) * Integer.BYTES).order(ByteOrder.nativeOrder());
+                continue;
+            }
+            if (next == from) return;
+            records.load(buffer);
+            for (int i = from; i < next; ++i) {
+                if (!visitClassRecord(visitor, records)) return;
+            }
+            from = next;
+        }
+    }
+
+    // a batch written by DexParserBridge.visitClassBatch, see there for the record layout
+    private static final class ClassRecords {
+        private int[] data = new int[0];
+        private int pos;
+
+        void load(ByteBuffer buffer) {
+            var ints = buffer.asIntBuffer();
+            int size = ints.get(0);
+            if (data.length < size) data = new int[size];
+            ints.position(1);
+            ints.get(data, 0, size);
+            pos = 0;
+        }
+
+        int next() {
+            return data[pos++];
+        }
+
+        int[] next(int count) {
+            var res = Arrays.copyOfRange(data, pos, pos + count);
+            pos += count;
+            return res;
+        }
+
+        int[] list() {
+            return next(next());
+        }
+
+        void skipList() {
+            pos += data[pos] + 1;
+        }
+    }
+
+    // returns false once the visitor asks to stop
+    private boolean visitClassRecord(@NonNull ClassVisitor visitor, @NonNull ClassRecords records) {
+        int clazz = records.next();
+        int accessFlags = records.next();
+        int superClass = records.next();
+        int sourceFile = records.next();
+        var interfaces = records.list();
+        var annotations = records.list();
+        var staticFields = records.list();
+        var staticFieldsAccessFlags = records.next(staticFields.length);
+        var instanceFields = records.list();
+        var instanceFieldsAccessFlags = records.next(instanceFields.length);
+        var directMethods = records.list();
+        var directMethodsAccessFlags = records.next(directMethods.length);
+        var directMethodsCode = records.next(directMethods.length);
+        var virtualMethods = records.list();
+        var virtualMethodsAccessFlags = records.next(virtualMethods.length);
+        var virtualMethodsCode = records.next(virtualMethods.length);
+
+        var memberVisitor = visitor.visit(clazz, accessFlags, superClass, interfaces, sourceFile,
+                staticFields, staticFieldsAccessFlags, instanceFields, instanceFieldsAccessFlags,
+                directMethods, directMethodsAccessFlags, virtualMethods, virtualMethodsAccessFlags,
+                annotations);
+
+        boolean stopped = !(memberVisitor instanceof FieldVisitor);
+        for (var fields : new int[][][]{{staticFields, staticFieldsAccessFlags}, {instanceFields, instanceFieldsAccessFlags}}) {
+            for (int i = 0; i < fields[0].length; ++i) {
+                if (stopped) {
+                    records.skipList();
+                    continue;
+                }
+                var fieldVisitor = (FieldVisitor) memberVisitor;
+                fieldVisitor.visit(fields[0][i], fields[1][i], records.list());
+                stopped = fieldVisitor.stop();
+            }
+        }
+
+        stopped = !(memberVisitor instanceof MethodVisitor);
+        for (var methods : new int[][][]{{directMethods, directMethodsAccessFlags, directMethodsCode}, {virtualMethods, virtualMethodsAccessFlags, virtualMethodsCode}}) {
+            for (int i = 0; i < methods[0].length; ++i) {
+                if (stopped) {
+                    records.skipList();
+                    records.skipList();
+                    continue;
+                }
+                var methodVisitor = (MethodVisitor) memberVisitor;
+                int method = methods[0][i];
+                int code = methods[2][i];
+                var methodAnnotations = records.list();
+                var parameterAnnotations = records.list();
+                var bodyVisitor = methodVisitor.visit(method, methods[1][i], code >= 0, methodAnnotations, parameterAnnotations);
+                if (bodyVisitor != null && code >= 0) {
+                    var body = (Object[]) DexParserBridge.getMethodBody(cookie, method, code);
+                    if (body != null) {
+                        bodyVisitor.visit((int[]) body[0], (int[]) body[1], (int[]) body[2], (int[]) body[3], (byte[]) body[4]);
+                    }
+                }
+                stopped = methodVisitor.stop();
+            }
+        }
 
-        DexParserBridge.visitClass(cookie, visitor, FieldVisitor.class, MethodVisitor.class, classVisitMethod, fieldVisitMethod, methodVisitMethod, methodBodyVisitMethod, stopMethod);
+        return !visitor.stop();
     }
 }
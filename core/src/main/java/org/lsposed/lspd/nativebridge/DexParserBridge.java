@@ -1,19 +1,31 @@
 package org.lsposed.lspd.nativebridge;
 
 import java.io.IOException;
-import java.lang.reflect.Method;
 import java.nio.ByteBuffer;
 
 import dalvik.annotation.optimization.FastNative;
-import io.github.libxposed.api.utils.DexParser;
 
 public class DexParserBridge {
     @FastNative
-    public static native Object openDex(ByteBuffer data, long[] args) throws IOException;
+    public static native Object openDex(ByteBuffer data, long[] args, ByteBuffer cache) throws IOException;
+
+    public static native int writeDexCache(ByteBuffer data);
+
+    public static native Object openDexes(ByteBuffer[] data, long[] cookies, ByteBuffer[] caches, boolean[] cached, boolean includeAnnotations) throws IOException;
 
     @FastNative
     public static native void closeDex(long cookie);
 
     @FastNative
-    public static native void visitClass(long cookie, Object visitor, Class<DexParser.FieldVisitor> fieldVisitorClass, Class<DexParser.MethodVisitor> methodVisitorClass, Method classVisitMethod, Method fieldVisitMethod, Method methodVisitMethod, Method methodBodyVisitMethod, Method stopMethod);
+    public static native int visitClassBatch(long cookie, ByteBuffer buffer, int from);
+
+    @FastNative
+    public static native Object getMethodBody(long cookie, int methodIdx, int code);
+
+    public static native int[] query(long cookie, int[] predicates, boolean methods);
+
+    public static native void buildXrefIndex(long cookie, boolean parallel);
+
+    @FastNative
+    public static native int[] getXrefs(long cookie, int kind, int id);
 }
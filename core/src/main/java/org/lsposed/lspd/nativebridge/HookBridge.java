@@ -8,6 +8,9 @@ import dalvik.annotation.optimization.FastNative;
 public class HookBridge {
     public static native boolean hookMethod(boolean useModernApi, Executable hookMethod, Class<?> hooker, int priority, Object callback);
 
+    // hooks every method with the same callback, returns whether each one succeeded
+    public static native boolean[] hookMethods(boolean useModernApi, Executable[] hookMethods, Class<?> hooker, int priority, Object callback);
+
     public static native boolean unhookMethod(boolean useModernApi, Executable hookMethod, Object callback);
 
     public static native boolean deoptimizeMethod(Executable method);
@@ -16,7 +19,7 @@ public class HookBridge {
 
     public static native Object invokeOriginalMethod(Executable method, Object thisObject, Object... args) throws IllegalAccessException, IllegalArgumentException, InvocationTargetException;
 
-    public static native <T> Object invokeSpecialMethod(Executable method, char[] shorty, Class<T> clazz, Object thisObject, Object... args) throws IllegalAccessException, IllegalArgumentException, InvocationTargetException;
+    public static native <T> Object invokeSpecialMethod(Executable method, Class<T> clazz, Object thisObject, Object... args) throws IllegalAccessException, IllegalArgumentException, InvocationTargetException;
 
     @FastNative
     public static native boolean instanceOf(Object obj, Class<?> clazz);
@@ -24,5 +27,16 @@ public class HookBridge {
     @FastNative
     public static native boolean setTrusted(Object cookie);
 
-    public static native Object[][] callbackSnapshot(Class<?> hooker_callback, Executable method);
+    public static native boolean profilerEnabled();
+
+    @FastNative
+    public static native long profilerNow();
+
+    public static native int profilerRegisterName(String name);
+
+    // records the time since start, which came from profilerNow
+    @FastNative
+    public static native void profilerRecord(int method, int callback, int phase, long start);
+
+    public static native byte[] profilerReport();
 }
@@ -20,21 +20,35 @@
 #ifndef SANDHOOK_ELF_UTIL_H
 #define SANDHOOK_ELF_UTIL_H
 
+#include <array>
+#include <atomic>
 #include <string_view>
-#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
 #include <linux/elf.h>
 #include <sys/types.h>
 #include <link.h>
 #include <vector>
-#include "config.h"
+#include "symbol_index.h"
+#include "trace.h"
 
 #define SHT_GNU_HASH 0x6ffffff6
 
 namespace SandHook {
+    // A symbol name with its precomputed hashes, create it with the _elf literal so that
+    // lookups need neither hashing nor strlen at runtime.
+    struct ElfSymbol {
+        std::string_view name;
+        uint32_t gnu_hash;
+        uint32_t elf_hash;
+    };
+
     class ElfImg {
     public:
 
-        ElfImg(std::string_view elf);
+        ElfImg(std::string_view elf, std::unique_ptr<const SymbolIndex> index = nullptr);
 
         template<typename T = void*>
         requires(std::is_pointer_v<T>)
@@ -47,6 +61,34 @@ namespace SandHook {
             }
         }
 
+        template<typename T = void*>
+        requires(std::is_pointer_v<T>)
+        constexpr const T getSymbAddress(const ElfSymbol &symbol) const {
+            auto offset = getSymbOffset(symbol.name, symbol.gnu_hash, symbol.elf_hash);
+            if (offset > 0 && base != nullptr) {
+                return reinterpret_cast<T>(static_cast<ElfW(Addr)>((uintptr_t) base + offset - bias));
+            } else {
+                return nullptr;
+            }
+        }
+
+        // Resolves a batch of symbols, a missing symbol yields nullptr at its position.
+        template<typename T = void*>
+        requires(std::is_pointer_v<T>)
+        std::vector<T> getSymbAddresses(std::span<const std::string_view> names) const {
+            return ToAddresses<T>(getSymbOffsets(names));
+        }
+
+        template<typename T = void*>
+        requires(std::is_pointer_v<T>)
+        std::vector<T> getSymbAddresses(std::span<const ElfSymbol> symbols) const {
+            return ToAddresses<T>(getSymbOffsets(symbols));
+        }
+
+        constexpr static uint32_t ElfHash(std::string_view name);
+
+        constexpr static uint32_t GnuHash(std::string_view name);
+
         template<typename T = void*>
         requires(std::is_pointer_v<T>)
         constexpr const T getSymbPrefixFirstAddress(std::string_view prefix) const {
@@ -82,11 +124,56 @@ namespace SandHook {
             return elf;
         }
 
+        bool hasSymbolIndex() const {
+            return index_ != nullptr;
+        }
+
+        // Remembers successful lookups from now on, only for an image whose index is going
+        // to be written, they become the hot part of it
+        void RecordResolvedSymbols() { record_resolved_ = !index_; }
+
+        bool WriteSymbolIndex(int fd) const;
+
+        // Resolves the bases of several libraries with one maps scan for later constructions
+        static void PrefetchModuleBases(std::span<const std::string_view> names);
+
+        // Drops the decompressed gnu_debugdata; symbols only found in its symtab can no
+        // longer be resolved unless served from a symbol index.
+        void ReleaseDebugData();
+
+        // How many lookups each tier answered, a symtab hit implies gnu_debugdata was
+        // decompressed if the library is stripped.
+        struct LookupStats {
+            uint32_t index;
+            uint32_t gnu_hash;
+            uint32_t elf_hash;
+            uint32_t symtab;
+            uint32_t miss;
+        };
+
+        LookupStats lookupStats() const;
+
         ~ElfImg();
 
     private:
         ElfW(Addr) getSymbOffset(std::string_view name, uint32_t gnu_hash, uint32_t elf_hash) const;
 
+        std::vector<ElfW(Addr)> getSymbOffsets(std::span<const std::string_view> names) const;
+
+        std::vector<ElfW(Addr)> getSymbOffsets(std::span<const ElfSymbol> symbols) const;
+
+        template<typename T>
+        std::vector<T> ToAddresses(const std::vector<ElfW(Addr)> &offsets) const {
+            std::vector<T> res(offsets.size(), nullptr);
+            if (base == nullptr) return res;
+            for (size_t i = 0; i < offsets.size(); ++i) {
+                if (offsets[i] > 0) {
+                    res[i] = reinterpret_cast<T>(static_cast<ElfW(Addr)>((uintptr_t) base + offsets[i] - bias));
+                }
+            }
+            return res;
+        }
+
         ElfW(Addr) ElfLookup(std::string_view name, uint32_t hash) const;
 
         ElfW(Addr) GnuLookup(std::string_view name, uint32_t hash) const;
@@ -95,16 +182,37 @@ namespace SandHook {
 
         std::vector<ElfW(Addr)> LinearRangeLookup(std::string_view name) const;
 
-        ElfW(Addr) PrefixLookupFirst(std::string_view prefix) const;
+        std::pair<std::vector<uint32_t>::const_iterator, std::vector<uint32_t>::const_iterator>
+        LinearEqualRange(std::string_view name) const;
 
-        constexpr static uint32_t ElfHash(std::string_view name);
+        const char *SymtabName(uint32_t index) const;
 
-        constexpr static uint32_t GnuHash(std::string_view name);
+        ElfW(Addr) PrefixLookupFirst(std::string_view prefix) const;
+
+        void RecordResolved(std::string_view name, ElfW(Addr) value,
+                            SymbolIndex::Source source) const;
 
         bool findModuleBase();
 
         void MayInitLinearMap() const;
 
+        void MayLoadDebugData() const;
+
+        enum Tier {
+            kIndexTier,
+            kGnuHashTier,
+            kElfHashTier,
+            kSymtabTier,
+            kMissTier,
+            kTierCount,
+        };
+
+        void CountHit(Tier tier) const {
+            tier_hits_[tier].fetch_add(1, std::memory_order_relaxed);
+            lspd::trace::Count(static_cast<lspd::trace::Event>(
+                static_cast<int>(lspd::trace::Event::kIndexHit) + tier));
+        }
+
         void parse(ElfW(Ehdr) *header);
 
         bool xzdecompress();
@@ -114,6 +222,8 @@ namespace SandHook {
         char *buffer = nullptr;
         off_t size = 0;
         off_t bias = -4396;
+        off_t section_bias_ = 0;
+        bool exact_bias_ = false;
         ElfW(Ehdr) *header = nullptr;
         ElfW(Ehdr) *header_debugdata = nullptr;
         ElfW(Shdr) *section_header = nullptr;
@@ -131,7 +241,9 @@ namespace SandHook {
         ElfW(Off) symtab_size = 0;
         ElfW(Off) debugdata_offset = 0;
         ElfW(Off) debugdata_size = 0;
-        std::string elf_debugdata;
+        void *debugdata_ = nullptr;
+        size_t debugdata_map_size_ = 0;
+        mutable bool debugdata_tried_ = false;
 
         uint32_t nbucket_{};
         uint32_t *bucket_ = nullptr;
@@ -145,7 +257,24 @@ namespace SandHook {
         uint32_t *gnu_bucket_;
         uint32_t *gnu_chain_;
 
-        mutable std::map<std::string_view, ElfW(Sym) *> symtabs_;
+        // indices into symtab_start sorted by name, duplicated names are kept in symtab order
+        mutable std::vector<uint32_t> symtabs_;
+
+        struct ResolvedSymbol {
+            std::string name;
+            ElfW(Addr) value;
+            SymbolIndex::Source source;
+        };
+
+        // successful lookups made without an index, published as the hot part of it
+        bool record_resolved_ = false;
+        mutable std::mutex resolved_lock_;
+        mutable std::vector<ResolvedSymbol> resolved_;
+
+        std::unique_ptr<const SymbolIndex> index_;
+        SymbolIndex::Key key_{};
+
+        mutable std::array<std::atomic<uint32_t>, kTierCount> tier_hits_{};
     };
 
     constexpr uint32_t ElfImg::ElfHash(std::string_view name) {
@@ -166,6 +295,11 @@ namespace SandHook {
         }
         return h;
     }
+
+    consteval ElfSymbol operator""_elf(const char *name, size_t len) {
+        std::string_view n{name, len};
+        return {n, ElfImg::GnuHash(n), ElfImg::ElfHash(n)};
+    }
 }
 
 #endif //SANDHOOK_ELF_UTIL_H
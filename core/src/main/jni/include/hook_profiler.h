@@ -0,0 +1,59 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2021 LSPosed Contributors
+ */
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Opt-in hook profiling, enabled with `setprop debug.lsposed.hookprof 1` before the process
+// starts. Every thread counts into its own table, which is only locked by the owner and by
+// Report, so recording never contends with other threads.
+//
+// Report layout, all little endian:
+//   u32 magic 'LSHP', u32 version, u32 entry count, u32 name count
+//   entries: u32 method, u32 callback, u32 phase, u32 reserved,
+//            u64 count, total, max, p50, p90, p99 (all times in ns)
+//   names: u32 length and the UTF-8 bytes, name ids start from 1 in this order
+// callback is 0 for the original method. Percentiles are the upper bound of their power of
+// two bucket, capped by max.
+namespace lspd::hook_profiler {
+    constexpr uint32_t kMagic = 0x5048534c;
+    constexpr uint32_t kVersion = 1;
+
+    // keep in sync with HookProfiler.java
+    enum class Phase : uint32_t {
+        kBefore,
+        kAfter,
+        kOriginal,
+        kCount,
+    };
+
+    bool Enabled();
+
+    uint64_t Now();
+
+    // Returns the same id for the same name, 0 if there are too many names
+    uint32_t RegisterName(std::string_view name);
+
+    void Record(uint32_t method, uint32_t callback, Phase phase, uint64_t duration_ns);
+
+    // Aggregates all threads, including finished ones
+    std::vector<uint8_t> Report();
+}  // namespace lspd::hook_profiler
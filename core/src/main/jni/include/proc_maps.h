@@ -0,0 +1,58 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2021 LSPosed Contributors
+ */
+#ifndef SANDHOOK_PROC_MAPS_H
+#define SANDHOOK_PROC_MAPS_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace SandHook {
+    struct ModuleMapping {
+        uintptr_t base = 0;
+        std::string path;
+        // base is the load bias reported by the linker, symbol values need no further adjustment
+        bool exact_bias = false;
+
+        bool valid() const {
+            return base != 0;
+        }
+    };
+
+    // Resolves the load base of every library whose path contains one of `names` with a single
+    // scan of /proc/self/maps. The base is the first `r--p` mapping directly followed by an
+    // `r-xp` one of the same library, or its first `r-xp` mapping otherwise.
+    std::vector<ModuleMapping> ScanModuleBases(std::span<const std::string_view> names);
+
+    std::vector<ModuleMapping> ScanModuleBases(std::string_view maps,
+                                               std::span<const std::string_view> names);
+
+    // Resolves with dl_iterate_phdr only, names it does not list are left invalid
+    std::vector<ModuleMapping> IteratePhdrModuleBases(std::span<const std::string_view> names);
+
+    // Resolves with the maps scanner, or with dl_iterate_phdr after
+    // `setprop debug.lsposed.modbase phdr` before the process starts. dl_iterate_phdr needs no
+    // procfs access and yields the exact load bias, anything it does not list (e.g. the linker
+    // itself) falls back to maps.
+    std::vector<ModuleMapping> ResolveModuleBases(std::span<const std::string_view> names);
+}
+
+#endif //SANDHOOK_PROC_MAPS_H
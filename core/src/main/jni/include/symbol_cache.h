@@ -29,10 +29,17 @@
 
 namespace SandHook {
     class ElfImg;
+    class SymbolIndex;
 }
 
 namespace lspd {
     std::unique_ptr<const SandHook::ElfImg> &GetArt(bool release=false);
+    // Offers a prebuilt index to the next GetArt() construction; it is dropped if stale
+    void SetArtSymbolIndex(std::unique_ptr<const SandHook::SymbolIndex> index);
+    // Makes the next GetArt() construction record its lookups for the index it will publish
+    void RecordArtSymbols();
+    // Frees the decompressed debug data of libart once the hooker has resolved its symbols
+    void ReleaseArtDebugData();
     std::unique_ptr<const SandHook::ElfImg> &GetLibBinder(bool release=false);
     std::unique_ptr<const SandHook::ElfImg> &GetLinker(bool release=false);
 }
@@ -0,0 +1,115 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2021 LSPosed Contributors
+ */
+#ifndef SANDHOOK_SYMBOL_INDEX_H
+#define SANDHOOK_SYMBOL_INDEX_H
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace SandHook {
+    // A flat, mmap-able snapshot of the symbols an ElfImg can resolve.
+    //
+    // Layout (native endianness, everything 8-byte aligned):
+    //   Header
+    //   Entry[hot_count]     symbols the publisher actually resolved, same order as below
+    //   Entry[count]         sorted by (gnu hash, name, source)
+    //   uint32_t[prefix]     indices of symtab entries sorted by name
+    //   char[strings_size]   symbol names, not null-terminated
+    //
+    // The index is only valid for the exact file it was built from, which is
+    // identified by (dev, inode, size, mtime) of the canonical library path.
+    class SymbolIndex {
+    public:
+        struct Key {
+            uint64_t dev = 0;
+            uint64_t ino = 0;
+            uint64_t size = 0;
+            int64_t mtime_sec = 0;
+            int64_t mtime_nsec = 0;
+
+            static Key FromStat(const struct stat &st) {
+                return {static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino),
+                        static_cast<uint64_t>(st.st_size), static_cast<int64_t>(st.st_mtim.tv_sec),
+                        static_cast<int64_t>(st.st_mtim.tv_nsec)};
+            }
+
+            bool operator==(const Key &) const = default;
+        };
+
+        enum Source : uint32_t {
+            kDynsym = 0,
+            kSymtab = 1,
+            // a hot entry named after a queried prefix, carrying the value it resolved to
+            kPrefix = 2,
+        };
+
+        struct Symbol {
+            std::string_view name;
+            uint32_t gnu_hash;
+            uint64_t value;
+            Source source;
+        };
+
+        static std::unique_ptr<const SymbolIndex> Open(int fd, size_t size);
+
+        // `hot` are the lookups the publisher made, they are probed first so that a process
+        // repeating them only touches a page or two of the index
+        static bool Write(int fd, const Key &key, off_t bias, std::vector<Symbol> &&symbols,
+                          std::vector<Symbol> &&hot);
+
+        bool Matches(const Key &key) const;
+
+        off_t bias() const;
+
+        uint64_t Lookup(std::string_view name, uint32_t gnu_hash) const;
+
+        std::vector<uint64_t> RangeLookup(std::string_view name, uint32_t gnu_hash) const;
+
+        uint64_t PrefixLookupFirst(std::string_view prefix, uint32_t gnu_hash) const;
+
+        ~SymbolIndex();
+
+    private:
+        struct Header;
+        struct Entry;
+
+        SymbolIndex(void *map, size_t size);
+
+        std::string_view NameOf(const Entry &entry) const;
+
+        const Entry *Find(std::span<const Entry> entries, std::string_view name, uint32_t gnu_hash,
+                          bool prefix) const;
+
+        void *map_ = nullptr;
+        size_t size_ = 0;
+        const Header *header_ = nullptr;
+        std::span<const Entry> hot_;
+        std::span<const Entry> entries_;
+        std::span<const uint32_t> prefix_;
+        const char *strings_ = nullptr;
+    };
+}
+
+#endif //SANDHOOK_SYMBOL_INDEX_H
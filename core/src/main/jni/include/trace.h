@@ -0,0 +1,78 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2021 LSPosed Contributors
+ */
+#pragma once
+
+#include <cstdint>
+
+// Opt-in startup tracing, enabled with `setprop debug.lsposed.trace 1` before the process
+// starts. Events go into a fixed-size lock-free ring and are dumped to logcat with the
+// LSPosedTrace tag, which the daemon always copies into the verbose log.
+namespace lspd::trace {
+    enum class Event : uint16_t {
+        kElfImgInit,
+        kFindModuleBase,
+        kXzDecompress,
+        kLinearMap,
+        kLookup,
+        kBatchLookup,
+        kIndexHit,
+        kGnuHashHit,
+        kElfHashHit,
+        kSymtabHit,
+        kLookupMiss,
+        kInitArtHooker,
+        kInitHooks,
+        kCount,
+    };
+
+    bool Enabled();
+
+    uint64_t Now();
+
+    void Record(Event event, uint64_t start_ns, uint64_t duration_ns, uint32_t value = 0);
+
+    // An instant event, used for hit and miss counts
+    inline void Count(Event event, uint32_t value = 0) {
+        if (Enabled()) Record(event, Now(), 0, value);
+    }
+
+    // Logs everything recorded since the last dump
+    void Dump();
+
+    class Scope {
+    public:
+        explicit Scope(Event event, uint32_t value = 0)
+            : event_(event), value_(value), start_(Enabled() ? Now() : 0) {}
+
+        void value(uint32_t value) { value_ = value; }
+
+        ~Scope() {
+            if (start_ != 0) Record(event_, start_, Now() - start_, value_);
+        }
+
+        Scope(const Scope &) = delete;
+
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        Event event_;
+        uint32_t value_;
+        uint64_t start_;
+    };
+}  // namespace lspd::trace
@@ -28,6 +28,7 @@
 #include "jni/resources_hook.h"
 #include "jni/dex_parser.h"
 #include "symbol_cache.h"
+#include "trace.h"
 
 using namespace lsplant;
 
@@ -53,13 +54,20 @@ namespace lspd {
     }
 
     void Context::InitArtHooker(JNIEnv *env, const lsplant::InitInfo &initInfo) {
-        if (!lsplant::Init(env, initInfo)) {
+        bool initialized;
+        {
+            trace::Scope scope(trace::Event::kInitArtHooker);
+            initialized = lsplant::Init(env, initInfo);
+        }
+        trace::Dump();
+        if (!initialized) {
             LOGE("Failed to init lsplant");
             return;
         }
     }
 
     void Context::InitHooks(JNIEnv *env) {
+        trace::Scope scope(trace::Event::kInitHooks);
         auto path_list = JNI_GetObjectFieldOf(env, inject_class_loader_, "pathList",
                                               "Ldalvik/system/DexPathList;");
         if (!path_list) {
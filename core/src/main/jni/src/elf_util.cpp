@@ -25,14 +25,18 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <mutex>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #include "linux/xz.h"
 #include "logging.h"
+#include "proc_maps.h"
 
 using namespace SandHook;
 
@@ -42,12 +46,29 @@ inline constexpr auto offsetOf(ElfW(Ehdr) * head, ElfW(Off) off) {
         reinterpret_cast<uintptr_t>(head) + off);
 }
 
-ElfImg::ElfImg(std::string_view base_name) : elf(base_name) {
+ElfImg::ElfImg(std::string_view base_name, std::unique_ptr<const SymbolIndex> index)
+    : elf(base_name), index_(std::move(index)) {
+    lspd::trace::Scope scope(lspd::trace::Event::kElfImgInit);
     if (!findModuleBase()) {
         base = nullptr;
+        index_.reset();
         return;
     }
 
+    if (index_) {
+        struct stat st {};
+        if (stat(elf.data(), &st) == 0 && index_->Matches(SymbolIndex::Key::FromStat(st))) {
+            key_ = SymbolIndex::Key::FromStat(st);
+            section_bias_ = index_->bias();
+            bias = exact_bias_ ? 0 : section_bias_;
+            LOGD("use symbol index for {}", elf);
+            scope.value(1);
+            return;
+        }
+        LOGD("symbol index for {} is stale, fallback to parse", elf);
+        index_.reset();
+    }
+
     // load elf
     int fd = open(elf.data(), O_RDONLY);
     if (fd < 0) {
@@ -55,6 +76,10 @@ ElfImg::ElfImg(std::string_view base_name) : elf(base_name) {
         return;
     }
 
+    if (struct stat st {}; fstat(fd, &st) == 0) {
+        key_ = SymbolIndex::Key::FromStat(st);
+    }
+
     size = lseek(fd, 0, SEEK_END);
     if (size <= 0) {
         LOGE("lseek() failed for {}", elf);
@@ -63,15 +88,31 @@ ElfImg::ElfImg(std::string_view base_name) : elf(base_name) {
     header = reinterpret_cast<decltype(header)>(mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0));
 
     close(fd);
+    // only the section headers are walked here, gnu_debugdata is decompressed on the first
+    // lookup that misses dynsym
     parse(header);
-    if (isStripped()) {
-        if (xzdecompress()) {
-            header_debugdata = reinterpret_cast<ElfW(Ehdr) *>(elf_debugdata.data());
-            parse(header_debugdata);
-        }
+    // parse() derives the bias from the section headers, the linker already accounted for it
+    section_bias_ = bias;
+    if (exact_bias_) bias = 0;
+}
+
+void ElfImg::MayLoadDebugData() const {
+    if (debugdata_tried_) return;
+    debugdata_tried_ = true;
+    if (!isStripped()) return;
+    // lookups are const, but materializing the symtab does not change what they return
+    auto *self = const_cast<ElfImg *>(this);
+    if (self->xzdecompress()) {
+        self->header_debugdata = reinterpret_cast<ElfW(Ehdr) *>(debugdata_);
+        self->parse(header_debugdata);
     }
 }
 
+ElfImg::LookupStats ElfImg::lookupStats() const {
+    auto get = [this](Tier tier) { return tier_hits_[tier].load(std::memory_order_relaxed); };
+    return {get(kIndexTier), get(kGnuHashTier), get(kElfHashTier), get(kSymtabTier), get(kMissTier)};
+}
+
 void ElfImg::parse(ElfW(Ehdr) * hdr) {
     section_header = offsetOf<decltype(section_header)>(hdr, hdr->e_shoff);
 
@@ -152,55 +193,91 @@ void ElfImg::parse(ElfW(Ehdr) * hdr) {
     }
 }
 
-bool ElfImg::xzdecompress() {
-    struct xz_buf str_xz_buf;
-    struct xz_dec *str_xz_dec;
-    enum xz_ret ret = XZ_OK;
-    bool bError = true;
-
-#define BUFSIZE 1024 * 1024
+// Reads the total uncompressed size from the index of a single-stream .xz file,
+// returns 0 if the size cannot be determined.
+static size_t XzUncompressedSize(const uint8_t *in, size_t size) {
+    // strip stream padding
+    while (size >= 4 && !(in[size - 1] | in[size - 2] | in[size - 3] | in[size - 4])) size -= 4;
+    constexpr size_t kHeaderSize = 12, kFooterSize = 12;
+    if (size < kHeaderSize + kFooterSize) return 0;
+    const auto *footer = in + size - kFooterSize;
+    if (footer[10] != 'Y' || footer[11] != 'Z') return 0;
+    uint32_t backward_size = footer[4] | footer[5] << 8 | footer[6] << 16 | uint32_t{footer[7]} << 24;
+    size_t index_size = (size_t{backward_size} + 1) * 4;
+    if (index_size > size - kHeaderSize - kFooterSize) return 0;
+
+    const auto *p = footer - index_size;
+    const auto *end = footer - 4;  // CRC32 of the index
+    auto read_vli = [&p, end](uint64_t &v) {
+        v = 0;
+        for (int i = 0; i < 9 && p < end; ++i) {
+            uint8_t b = *p++;
+            v |= uint64_t{b & 0x7fu} << (i * 7);
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    };
+    if (*p++ != 0) return 0;  // index indicator
+    uint64_t records, unpadded, uncompressed, blocks_size = 0, total = 0;
+    if (!read_vli(records)) return 0;
+    for (uint64_t i = 0; i < records; ++i) {
+        if (!read_vli(unpadded) || !read_vli(uncompressed)) return 0;
+        blocks_size += (unpadded + 3) & ~uint64_t{3};
+        total += uncompressed;
+    }
+    // concatenated streams only index their own blocks
+    if (kHeaderSize + blocks_size + index_size + kFooterSize != size) return 0;
+    return total;
+}
 
+bool ElfImg::xzdecompress() {
+    lspd::trace::Scope scope(lspd::trace::Event::kXzDecompress, debugdata_size);
     xz_crc32_init();
 #ifdef XZ_USE_CRC64
     xz_crc64_init();
 #endif
-    str_xz_dec = xz_dec_init(XZ_DYNALLOC, 1 << 26);
-    if (str_xz_dec == NULL) {
-        LOGE("xz_dec_init memory allocation failed");
+
+    auto *in = reinterpret_cast<const uint8_t *>(header) + debugdata_offset;
+    size_t out_size = XzUncompressedSize(in, debugdata_size);
+    // with a known size, decode in single-call mode straight into the final buffer, which also
+    // serves as the dictionary; otherwise grow the mapping in place
+    bool single = out_size != 0;
+    if (!single) out_size = 1024 * 1024;
+
+    auto *out = static_cast<uint8_t *>(
+        mmap(nullptr, out_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (out == MAP_FAILED) {
+        PLOGE("allocation for debugdata");
         return false;
     }
 
-    uint8_t *sBuffOut = (uint8_t *)malloc(BUFSIZE);
-    if (sBuffOut == NULL) {
-        LOGE("allocation for debugdata_header failed");
+    auto *str_xz_dec = xz_dec_init(single ? XZ_SINGLE : XZ_DYNALLOC, single ? 0 : 1 << 26);
+    if (str_xz_dec == nullptr) {
+        LOGE("xz_dec_init memory allocation failed");
+        munmap(out, out_size);
         return false;
     }
 
-    int iSzOut = BUFSIZE;
-
-    str_xz_buf.in = ((uint8_t *)header) + debugdata_offset;
-    str_xz_buf.in_pos = 0;
-    str_xz_buf.in_size = debugdata_size;
-    str_xz_buf.out = sBuffOut;
-    str_xz_buf.out_pos = 0;
-    str_xz_buf.out_size = BUFSIZE;
-
-    uint8_t iSkip = 0;
-
+    struct xz_buf str_xz_buf {
+        .in = in, .in_pos = 0, .in_size = debugdata_size, .out = out, .out_pos = 0,
+        .out_size = out_size,
+    };
+    enum xz_ret ret;
     while (true) {
         ret = xz_dec_run(str_xz_dec, &str_xz_buf);
 
-        if (str_xz_buf.out_pos == BUFSIZE) {
-            str_xz_buf.out_pos = 0;
-            iSkip++;
-        } else {
-            iSzOut -= (BUFSIZE - str_xz_buf.out_pos);
-        }
-
         if (ret == XZ_OK) {
-            iSzOut += BUFSIZE;
-            sBuffOut = (uint8_t *)realloc(sBuffOut, iSzOut);
-            str_xz_buf.out = sBuffOut + (iSkip * BUFSIZE);
+            if (str_xz_buf.out_pos == out_size) {
+                auto *grown = mremap(out, out_size, out_size * 2, MREMAP_MAYMOVE);
+                if (grown == MAP_FAILED) {
+                    ret = XZ_MEM_ERROR;
+                    break;
+                }
+                out = static_cast<uint8_t *>(grown);
+                out_size *= 2;
+                str_xz_buf.out = out;
+                str_xz_buf.out_size = out_size;
+            }
             continue;
         }
 
@@ -212,10 +289,10 @@ bool ElfImg::xzdecompress() {
 #endif
         break;
     }  // end while true
+    xz_dec_end(str_xz_dec);
 
     switch (ret) {
     case XZ_STREAM_END:
-        bError = false;
         break;
 
     case XZ_MEM_ERROR:
@@ -246,19 +323,48 @@ bool ElfImg::xzdecompress() {
         LOGE("xz_dec_run return a wrong value!");
         break;
     }
-    xz_dec_end(str_xz_dec);
-    if (bError) {
+    if (ret != XZ_STREAM_END) {
+        munmap(out, out_size);
         return false;
     }
-    if (sBuffOut[0] != 0x7F && sBuffOut[1] != 0x45 && sBuffOut[2] != 0x4C && sBuffOut[3] != 0x46) {
+    if (str_xz_buf.out_pos < SELFMAG || memcmp(out, ELFMAG, SELFMAG) != 0) {
         LOGE("not ELF header in gnu_debugdata");
+        munmap(out, out_size);
         return false;
     }
-    elf_debugdata = std::string((char *)sBuffOut, iSzOut);
-    free(sBuffOut);
+    LOGD("decompressed gnu_debugdata to {} bytes in {} mode", str_xz_buf.out_pos,
+         single ? "single-call" : "multi-call");
+    debugdata_ = out;
+    debugdata_map_size_ = out_size;
     return true;
 }
 
+void ElfImg::ReleaseDebugData() {
+    // never decompress it after this point
+    debugdata_tried_ = true;
+    if (debugdata_ == nullptr) return;
+    // the symtab lives in the decompressed data, only dynsym is left afterwards
+    symtabs_.clear();
+    symtabs_.shrink_to_fit();
+    symtab = nullptr;
+    symtab_start = nullptr;
+    symtab_count = 0;
+    symtab_offset = 0;
+    symtab_size = 0;
+    symstr_offset_for_symtab = 0;
+    header_debugdata = nullptr;
+    munmap(debugdata_, debugdata_map_size_);
+    debugdata_ = nullptr;
+    debugdata_map_size_ = 0;
+    LOGD("released gnu_debugdata of {}", elf);
+}
+
+// order of a null-terminated ELF string table name against a string_view, same as std::string_view::compare
+static inline int CompareName(const char *s, std::string_view name) {
+    if (int c = strncmp(s, name.data(), name.size()); c != 0) return c;
+    return s[name.size()] == '\0' ? 0 : 1;
+}
+
 ElfW(Addr) ElfImg::ElfLookup(std::string_view name, uint32_t hash) const {
     if (nbucket_ == 0) return 0;
 
@@ -266,7 +372,7 @@ ElfW(Addr) ElfImg::ElfLookup(std::string_view name, uint32_t hash) const {
 
     for (auto n = bucket_[hash % nbucket_]; n != 0; n = chain_[n]) {
         auto *sym = dynsym_start + n;
-        if (name == strings + sym->st_name) {
+        if (CompareName(strings + sym->st_name, name) == 0) {
             return sym->st_value;
         }
     }
@@ -287,7 +393,8 @@ ElfW(Addr) ElfImg::GnuLookup(std::string_view name, uint32_t hash) const {
             char *strings = (char *)strtab_start;
             do {
                 auto *sym = dynsym_start + sym_index;
-                if (((gnu_chain_[sym_index] ^ hash) >> 1) == 0 && name == strings + sym->st_name) {
+                if (((gnu_chain_[sym_index] ^ hash) >> 1) == 0 &&
+                    CompareName(strings + sym->st_name, name) == 0) {
                     return sym->st_value;
                 }
             } while ((gnu_chain_[sym_index++] & 1) == 0);
@@ -296,55 +403,98 @@ ElfW(Addr) ElfImg::GnuLookup(std::string_view name, uint32_t hash) const {
     return 0;
 }
 
+const char *ElfImg::SymtabName(uint32_t index) const {
+    auto hdr = header_debugdata != nullptr ? header_debugdata : header;
+    return offsetOf<const char *>(hdr, symstr_offset_for_symtab + symtab_start[index].st_name);
+}
+
 void ElfImg::MayInitLinearMap() const {
+    MayLoadDebugData();
     if (symtabs_.empty()) {
         if (symtab_start != nullptr && symstr_offset_for_symtab != 0) {
-            auto hdr = header_debugdata != nullptr ? header_debugdata : header;
+            lspd::trace::Scope scope(lspd::trace::Event::kLinearMap, symtab_count);
+            symtabs_.reserve(symtab_count);
             for (ElfW(Off) i = 0; i < symtab_count; i++) {
                 unsigned int st_type = ELF_ST_TYPE(symtab_start[i].st_info);
-                const char *st_name =
-                    offsetOf<const char *>(hdr, symstr_offset_for_symtab + symtab_start[i].st_name);
                 if ((st_type == STT_FUNC || st_type == STT_OBJECT) && symtab_start[i].st_size) {
-                    symtabs_.emplace(st_name, &symtab_start[i]);
+                    symtabs_.emplace_back(static_cast<uint32_t>(i));
                 }
             }
+            // stable so that duplicated names keep their symtab order
+            std::stable_sort(symtabs_.begin(), symtabs_.end(), [this](auto a, auto b) {
+                return strcmp(SymtabName(a), SymtabName(b)) < 0;
+            });
+            symtabs_.shrink_to_fit();
         }
     }
 }
 
+std::pair<std::vector<uint32_t>::const_iterator, std::vector<uint32_t>::const_iterator>
+ElfImg::LinearEqualRange(std::string_view name) const {
+    auto first = std::lower_bound(symtabs_.cbegin(), symtabs_.cend(), name,
+                                  [this](auto i, auto n) { return CompareName(SymtabName(i), n) < 0; });
+    // duplicated names are rare, walking them is cheaper than a second binary search
+    auto last = first;
+    while (last != symtabs_.cend() && CompareName(SymtabName(*last), name) == 0) ++last;
+    return {first, last};
+}
+
 ElfW(Addr) ElfImg::LinearLookup(std::string_view name) const {
     MayInitLinearMap();
-    if (auto i = symtabs_.find(name); i != symtabs_.end()) {
-        return i->second->st_value;
+    if (auto [i, end] = LinearEqualRange(name); i != end) {
+        CountHit(kSymtabTier);
+        return symtab_start[*i].st_value;
     } else {
         return 0;
     }
 }
 
 std::vector<ElfW(Addr)> ElfImg::LinearRangeLookup(std::string_view name) const {
+    lspd::trace::Scope scope(lspd::trace::Event::kLookup);
+    if (index_) {
+        auto offsets = index_->RangeLookup(name, GnuHash(name));
+        CountHit(offsets.empty() ? kMissTier : kIndexTier);
+        return {offsets.begin(), offsets.end()};
+    }
     MayInitLinearMap();
     std::vector<ElfW(Addr)> res;
-    for (auto [i, end] = symtabs_.equal_range(name); i != end; ++i) {
-        auto offset = i->second->st_value;
+    for (auto [i, end] = LinearEqualRange(name); i != end; ++i) {
+        auto offset = symtab_start[*i].st_value;
         res.emplace_back(offset);
         LOGD("found {} {:#x} in {} in symtab by linear range lookup", name, offset, elf);
     }
+    CountHit(res.empty() ? kMissTier : kSymtabTier);
     return res;
 }
 
 ElfW(Addr) ElfImg::PrefixLookupFirst(std::string_view prefix) const {
+    lspd::trace::Scope scope(lspd::trace::Event::kLookup);
+    if (index_) {
+        auto offset = index_->PrefixLookupFirst(prefix, GnuHash(prefix));
+        CountHit(offset > 0 ? kIndexTier : kMissTier);
+        return offset;
+    }
     MayInitLinearMap();
-    if (auto i = symtabs_.lower_bound(prefix);
-        i != symtabs_.end() && i->first.starts_with(prefix)) {
-        LOGD("found prefix {} of {} {:#x} in {} in symtab by linear lookup", prefix, i->first,
-             i->second->st_value, elf);
-        return i->second->st_value;
+    auto i = std::lower_bound(symtabs_.cbegin(), symtabs_.cend(), prefix,
+                              [this](auto i, auto n) { return CompareName(SymtabName(i), n) < 0; });
+    if (i != symtabs_.end() && strncmp(SymtabName(*i), prefix.data(), prefix.size()) == 0) {
+        LOGD("found prefix {} of {} {:#x} in {} in symtab by linear lookup", prefix,
+             SymtabName(*i), symtab_start[*i].st_value, elf);
+        RecordResolved(prefix, symtab_start[*i].st_value, SymbolIndex::kPrefix);
+        CountHit(kSymtabTier);
+        return symtab_start[*i].st_value;
     } else {
+        CountHit(kMissTier);
         return 0;
     }
 }
 
 ElfImg::~ElfImg() {
+    if (auto [index, gnu_hash, elf_hash, symtab, miss] = lookupStats();
+        index + gnu_hash + elf_hash + symtab + miss > 0) {
+        LOGD("lookups in {}: index {}, gnu hash {}, elf hash {}, symtab {}, miss {}", elf, index,
+             gnu_hash, elf_hash, symtab, miss);
+    }
     // open elf file local
     if (buffer) {
         free(buffer);
@@ -354,117 +504,195 @@ ElfImg::~ElfImg() {
     if (header) {
         munmap(header, size);
     }
+    if (debugdata_) {
+        munmap(debugdata_, debugdata_map_size_);
+    }
 }
 
 ElfW(Addr) ElfImg::getSymbOffset(std::string_view name, uint32_t gnu_hash,
                                  uint32_t elf_hash) const {
+    lspd::trace::Scope scope(lspd::trace::Event::kLookup);
+    if (index_) {
+        auto offset = index_->Lookup(name, gnu_hash);
+        if (offset > 0) LOGD("found {} {:#x} in {} in symbol index", name, offset, elf);
+        CountHit(offset > 0 ? kIndexTier : kMissTier);
+        return offset;
+    }
     if (auto offset = GnuLookup(name, gnu_hash); offset > 0) {
         LOGD("found {} {:#x} in {} in dynsym by gnuhash", name, offset, elf);
+        RecordResolved(name, offset, SymbolIndex::kDynsym);
+        CountHit(kGnuHashTier);
         return offset;
     } else if (offset = ElfLookup(name, elf_hash); offset > 0) {
         LOGD("found {} {:#x} in {} in dynsym by elfhash", name, offset, elf);
+        RecordResolved(name, offset, SymbolIndex::kDynsym);
+        CountHit(kElfHashTier);
         return offset;
     } else if (offset = LinearLookup(name); offset > 0) {
         LOGD("found {} {:#x} in {} in symtab by linear lookup", name, offset, elf);
+        RecordResolved(name, offset, SymbolIndex::kSymtab);
         return offset;
     } else {
+        CountHit(kMissTier);
         return 0;
     }
 }
 
-constexpr inline bool contains(std::string_view a, std::string_view b) {
-    return a.find(b) != std::string_view::npos;
+std::vector<ElfW(Addr)> ElfImg::getSymbOffsets(std::span<const std::string_view> names) const {
+    // gnu hash covers every defined dynamic symbol, the sysv hash is only needed without it
+    bool need_elf_hash = !index_ && (gnu_nbucket_ == 0 || gnu_bloom_size_ == 0);
+    std::vector<ElfSymbol> symbols;
+    symbols.reserve(names.size());
+    for (auto name : names) {
+        symbols.push_back({name, GnuHash(name), need_elf_hash ? ElfHash(name) : 0});
+    }
+    return getSymbOffsets(symbols);
 }
 
-// A clean and simple struct to hold parsed map entry data.
-struct MapEntry {
-    uintptr_t start_addr;
-    char perms[5] = {0};  // Assured null-termination
-    std::string pathname;
-};
+std::vector<ElfW(Addr)> ElfImg::getSymbOffsets(std::span<const ElfSymbol> symbols) const {
+    lspd::trace::Scope scope(lspd::trace::Event::kBatchLookup, symbols.size());
+    std::vector<ElfW(Addr)> offsets(symbols.size(), 0);
 
-bool ElfImg::findModuleBase() {
-    // Open the maps file using standard C file I/O.
-    FILE *maps = fopen("/proc/self/maps", "r");
-    if (!maps) {
-        LOGE("failed to open /proc/self/maps");
-        return false;
+    if (index_) {
+        for (size_t i = 0; i < symbols.size(); ++i) {
+            offsets[i] = index_->Lookup(symbols[i].name, symbols[i].gnu_hash);
+            CountHit(offsets[i] > 0 ? kIndexTier : kMissTier);
+        }
+        return offsets;
     }
 
-    char line_buffer[512];  // A reasonable fixed-size buffer for map lines.
-    std::vector<MapEntry> filtered_list;
-
-    // Step 1: Filter all entries containing `elf` in its path.
-    while (fgets(line_buffer, sizeof(line_buffer), maps)) {
-        // Use an intermediate variable of a known, large type to avoid format warnings.
-        // `unsigned long long` and `%llx` are standard and portable.
-        unsigned long long temp_start;
-        char path_buffer[256] = {0};
-        char p[5] = {0};
-
-        // Use the portable `%llx` specifier.
-        int items_parsed =
-            sscanf(line_buffer, "%llx-%*x %4s %*x %*s %*d %255s", &temp_start, p, path_buffer);
-
-        // The filter condition: must parse the path, and it must contain the elf name.
-        if (items_parsed == 3 && strstr(path_buffer, elf.c_str()) != nullptr) {
-            MapEntry entry;
-            // Safely assign the parsed value to the uintptr_t.
-            entry.start_addr = static_cast<uintptr_t>(temp_start);
-            strncpy(entry.perms, p, 4);
-            entry.pathname = path_buffer;
-            filtered_list.push_back(std::move(entry));
+    bool has_gnu_hash = gnu_nbucket_ != 0 && gnu_bloom_size_ != 0;
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        const auto &[name, gnu_hash, elf_hash] = symbols[i];
+        offsets[i] = has_gnu_hash ? GnuLookup(name, gnu_hash) : ElfLookup(name, elf_hash);
+        if (offsets[i] > 0) {
+            LOGD("found {} {:#x} in {} in dynsym by batch lookup", name, offsets[i], elf);
+            RecordResolved(name, offsets[i], SymbolIndex::kDynsym);
+            CountHit(has_gnu_hash ? kGnuHashTier : kElfHashTier);
+        } else {
+            pending.emplace_back(i);
         }
     }
-    fclose(maps);
-
-    if (filtered_list.empty()) {
-        LOGE("Could not find any mappings for {}", elf.data());
-        return false;
+    if (!pending.empty()) MayLoadDebugData();
+    if (pending.empty() || symtab_start == nullptr || symstr_offset_for_symtab == 0) {
+        for (size_t n = 0; n < pending.size(); ++n) CountHit(kMissTier);
+        return offsets;
     }
 
-    // Also part of Step 1: Print the filtered list for debugging.
-    LOGD("Found {} filtered map entries for {}:", filtered_list.size(), elf.data());
-    for (const auto &entry : filtered_list) {
-        LOGD("  {:#x} {} {}", entry.start_addr, entry.perms, entry.pathname);
+    if (!symtabs_.empty()) {
+        for (auto i : pending) {
+            offsets[i] = LinearLookup(symbols[i].name);
+            if (offsets[i] > 0) {
+                RecordResolved(symbols[i].name, offsets[i], SymbolIndex::kSymtab);
+            } else {
+                CountHit(kMissTier);
+            }
+        }
+        return offsets;
     }
 
-    const MapEntry *found_block = nullptr;
+    // the sorted table is not built yet: one shared pass over the symtab is cheaper than
+    // sorting it for a handful of names, keep the first match like LinearLookup does
+    std::unordered_map<std::string_view, std::vector<size_t>> wanted;
+    for (auto i : pending) {
+        wanted[symbols[i].name].emplace_back(i);
+    }
+    for (ElfW(Off) i = 0; i < symtab_count && !wanted.empty(); i++) {
+        unsigned int st_type = ELF_ST_TYPE(symtab_start[i].st_info);
+        if ((st_type != STT_FUNC && st_type != STT_OBJECT) || !symtab_start[i].st_size) continue;
+        if (auto it = wanted.find(SymtabName(i)); it != wanted.end()) {
+            for (auto idx : it->second) {
+                offsets[idx] = symtab_start[i].st_value;
+            }
+            LOGD("found {} {:#x} in {} in symtab by batch lookup", it->first,
+                 symtab_start[i].st_value, elf);
+            RecordResolved(it->first, symtab_start[i].st_value, SymbolIndex::kSymtab);
+            for (size_t n = 0; n < it->second.size(); ++n) CountHit(kSymtabTier);
+            wanted.erase(it);
+        }
+    }
+    for (const auto &[name, idx] : wanted) {
+        for (size_t n = 0; n < idx.size(); ++n) CountHit(kMissTier);
+    }
+    return offsets;
+}
 
-    // Step 2: In the filtered list, search for the first `r--p` whose next entry is `r-xp`.
-    for (size_t i = 0; i < filtered_list.size() - 1; ++i) {
-        if (strcmp(filtered_list[i].perms, "r--p") == 0 &&
-            strcmp(filtered_list[i + 1].perms, "r-xp") == 0) {
-            found_block = &filtered_list[i];
-            LOGD("Found `r--p` -> `r-xp` pattern. Choosing base from `r--p` block at {:#x}",
-                 found_block->start_addr);
-            break;  // Pattern found, exit loop.
+bool ElfImg::WriteSymbolIndex(int fd) const {
+    if (!isValid() || index_) return false;
+    std::vector<SymbolIndex::Symbol> symbols;
+    if (dynsym != nullptr && strtab_start != nullptr) {
+        auto *strings = reinterpret_cast<const char *>(strtab_start);
+        auto count = dynsym->sh_size / sizeof(ElfW(Sym));
+        for (ElfW(Off) i = 0; i < count; i++) {
+            const auto &sym = dynsym_start[i];
+            if (sym.st_shndx == SHN_UNDEF || sym.st_value == 0) continue;
+            std::string_view sym_name = strings + sym.st_name;
+            symbols.push_back({sym_name, GnuHash(sym_name), sym.st_value, SymbolIndex::kDynsym});
         }
     }
+    MayInitLinearMap();
+    for (auto i : symtabs_) {
+        const auto &sym = symtab_start[i];
+        if (sym.st_value == 0) continue;
+        std::string_view sym_name = SymtabName(i);
+        symbols.push_back({sym_name, GnuHash(sym_name), sym.st_value, SymbolIndex::kSymtab});
+    }
+    std::vector<SymbolIndex::Symbol> hot;
+    std::lock_guard lk(resolved_lock_);
+    hot.reserve(resolved_.size());
+    for (const auto &[name, value, source] : resolved_) {
+        hot.push_back({name, GnuHash(name), value, source});
+    }
+    return SymbolIndex::Write(fd, key_, section_bias_, std::move(symbols), std::move(hot));
+}
 
-    // Step 2 (Fallback): If the pattern was not found, find the first `r-xp` entry.
-    if (!found_block) {
-        LOGD("`r--p` -> `r-xp` pattern not found. Falling back to first `r-xp` entry.");
-        for (const auto &entry : filtered_list) {
-            if (strcmp(entry.perms, "r-xp") == 0) {
-                found_block = &entry;
-                LOGD("Found first `r-xp` block at {:#x}", found_block->start_addr);
-                break;  // Fallback found, exit loop.
-            }
+void ElfImg::RecordResolved(std::string_view name, ElfW(Addr) value,
+                            SymbolIndex::Source source) const {
+    if (!record_resolved_) return;
+    std::lock_guard lk(resolved_lock_);
+    resolved_.push_back({std::string(name), value, source});
+}
+
+namespace {
+    // bases resolved ahead of time by ElfImg::PrefetchModuleBases, keyed by the requested name
+    std::mutex module_bases_lock;
+    std::vector<std::pair<std::string, ModuleMapping>> module_bases;
+}  // namespace
+
+void ElfImg::PrefetchModuleBases(std::span<const std::string_view> names) {
+    auto mappings = ResolveModuleBases(names);
+    std::lock_guard lk(module_bases_lock);
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (!mappings[i].valid()) continue;
+        auto it = std::ranges::find(module_bases, names[i], &decltype(module_bases)::value_type::first);
+        if (it != module_bases.end()) {
+            it->second = std::move(mappings[i]);
+        } else {
+            module_bases.emplace_back(names[i], std::move(mappings[i]));
         }
     }
+}
 
-    if (!found_block) {
-        LOGE("Fatal: Could not determine a base address for {}", elf.data());
+bool ElfImg::findModuleBase() {
+    lspd::trace::Scope scope(lspd::trace::Event::kFindModuleBase);
+    ModuleMapping mapping;
+    {
+        std::lock_guard lk(module_bases_lock);
+        auto it = std::ranges::find(module_bases, elf, &decltype(module_bases)::value_type::first);
+        if (it != module_bases.end()) mapping = it->second;
+    }
+    if (!mapping.valid()) {
+        std::string_view name = elf;
+        mapping = std::move(ResolveModuleBases({&name, 1}).front());
+    }
+    if (!mapping.valid()) {
         return false;
     }
 
-    // Step 3: Use the starting address of the found block as the base address.
-    base = reinterpret_cast<void *>(found_block->start_addr);
-    elf = found_block->pathname;  // Update elf path to the canonical one.
-
-    LOGD("get module base {}: {:#x}", elf, found_block->start_addr);
+    base = reinterpret_cast<void *>(mapping.base);
+    exact_bias_ = mapping.exact_bias;
+    elf = std::move(mapping.path);  // Update elf path to the canonical one.
     LOGD("update path: {}", elf);
-
     return true;
 }
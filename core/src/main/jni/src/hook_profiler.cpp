@@ -0,0 +1,202 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2021 LSPosed Contributors
+ */
+#include "hook_profiler.h"
+
+#include <parallel_hashmap/phmap.h>
+#include <sys/system_properties.h>
+#include <time.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+namespace lspd::hook_profiler {
+    namespace {
+        constexpr size_t kBuckets = 40;
+        constexpr uint32_t kMaxNames = 1 << 20;
+        constexpr size_t kHeaderSize = 4 * sizeof(uint32_t);
+        constexpr size_t kEntrySize = 4 * sizeof(uint32_t) + 6 * sizeof(uint64_t);
+
+        struct Stats {
+            uint64_t count = 0;
+            uint64_t total = 0;
+            uint64_t max = 0;
+            // bucket i holds durations below 2^(i+1) ns, the last one everything longer
+            std::array<uint64_t, kBuckets> buckets{};
+
+            void Add(uint64_t duration) {
+                ++count;
+                total += duration;
+                max = std::max(max, duration);
+                auto bucket = duration ? 63 - __builtin_clzll(duration) : 0;
+                ++buckets[std::min<size_t>(bucket, kBuckets - 1)];
+            }
+
+            void Merge(const Stats &other) {
+                count += other.count;
+                total += other.total;
+                max = std::max(max, other.max);
+                for (size_t i = 0; i < kBuckets; ++i) buckets[i] += other.buckets[i];
+            }
+
+            uint64_t Percentile(uint64_t percent) const {
+                auto rank = (count * percent + 99) / 100;
+                uint64_t seen = 0;
+                for (size_t i = 0; i < kBuckets - 1; ++i) {
+                    seen += buckets[i];
+                    if (seen >= rank) return std::min(max, (uint64_t{2} << i) - 1);
+                }
+                return max;
+            }
+        };
+
+        // method in the high half, callback and phase in the low half
+        using Key = uint64_t;
+        using Table = phmap::flat_hash_map<Key, Stats>;
+
+        constexpr Key MakeKey(uint32_t method, uint32_t callback, Phase phase) {
+            return Key{method} << 32 | Key{callback} << 2 | static_cast<Key>(phase);
+        }
+
+        void MergeInto(Table &to, const Table &from) {
+            for (auto &[key, stats] : from) to[key].Merge(stats);
+        }
+
+        struct ThreadStats;
+
+        std::mutex threads_lock;
+        std::vector<ThreadStats *> threads;
+        Table retired;
+
+        std::mutex names_lock;
+        std::vector<std::string> names;
+        phmap::flat_hash_map<std::string, uint32_t> name_ids;
+
+        struct ThreadStats {
+            // only taken by the owner and Report, so it is almost never contended
+            std::mutex lock;
+            Table table;
+
+            ThreadStats() {
+                std::lock_guard lk(threads_lock);
+                threads.push_back(this);
+            }
+
+            ~ThreadStats() {
+                std::lock_guard lk(threads_lock);
+                threads.erase(std::find(threads.begin(), threads.end(), this));
+                MergeInto(retired, table);
+            }
+
+            ThreadStats(const ThreadStats &) = delete;
+
+            ThreadStats &operator=(const ThreadStats &) = delete;
+        };
+
+        ThreadStats &Local() {
+            thread_local ThreadStats stats;
+            return stats;
+        }
+
+        template <typename T>
+        void Put(std::vector<uint8_t> &out, T value) {
+            auto size = out.size();
+            out.resize(size + sizeof(T));
+            std::memcpy(out.data() + size, &value, sizeof(T));
+        }
+    }  // namespace
+
+    bool Enabled() {
+        static const bool enabled = [] {
+            char value[PROP_VALUE_MAX]{};
+            __system_property_get("debug.lsposed.hookprof", value);
+            return value[0] == '1';
+        }();
+        return enabled;
+    }
+
+    uint64_t Now() {
+        timespec ts{};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    uint32_t RegisterName(std::string_view name) {
+        std::lock_guard lk(names_lock);
+        std::string key(name);
+        if (auto it = name_ids.find(key); it != name_ids.end()) return it->second;
+        if (names.size() >= kMaxNames) return 0;
+        names.push_back(key);
+        auto id = static_cast<uint32_t>(names.size());
+        name_ids.emplace(std::move(key), id);
+        return id;
+    }
+
+    void Record(uint32_t method, uint32_t callback, Phase phase, uint64_t duration_ns) {
+        if (callback >= kMaxNames || phase >= Phase::kCount) return;
+        // a callback that could not be named, 0 is the original method
+        if (callback == 0 && phase != Phase::kOriginal) return;
+        auto &local = Local();
+        std::lock_guard lk(local.lock);
+        local.table[MakeKey(method, callback, phase)].Add(duration_ns);
+    }
+
+    std::vector<uint8_t> Report() {
+        Table merged;
+        {
+            std::lock_guard lk(threads_lock);
+            merged = retired;
+            for (auto *thread : threads) {
+                std::lock_guard thread_lk(thread->lock);
+                MergeInto(merged, thread->table);
+            }
+        }
+        std::vector<std::string> snapshot;
+        {
+            std::lock_guard lk(names_lock);
+            snapshot = names;
+        }
+
+        std::vector<uint8_t> out;
+        out.reserve(kHeaderSize + merged.size() * kEntrySize);
+        Put(out, kMagic);
+        Put(out, kVersion);
+        Put(out, static_cast<uint32_t>(merged.size()));
+        Put(out, static_cast<uint32_t>(snapshot.size()));
+        for (auto &[key, stats] : merged) {
+            Put(out, static_cast<uint32_t>(key >> 32));
+            Put(out, static_cast<uint32_t>(key) >> 2);
+            Put(out, static_cast<uint32_t>(key & 3));
+            Put(out, uint32_t{0});
+            Put(out, stats.count);
+            Put(out, stats.total);
+            Put(out, stats.max);
+            Put(out, stats.Percentile(50));
+            Put(out, stats.Percentile(90));
+            Put(out, stats.Percentile(99));
+        }
+        for (auto &name : snapshot) {
+            Put(out, static_cast<uint32_t>(name.size()));
+            out.insert(out.end(), name.begin(), name.end());
+        }
+        return out;
+    }
+}  // namespace lspd::hook_profiler
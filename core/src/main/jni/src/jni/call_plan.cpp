@@ -0,0 +1,271 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2022 LSPosed Contributors
+ */
+
+#include "call_plan.h"
+
+#include <array>
+
+namespace {
+using lspd::PrimitiveType;
+
+// filled by InitCallPlans, void has no box
+std::array<PrimitiveType, 9> primitive_types;
+
+char ShortyOf(JNIEnv *env, jclass type) {
+    for (auto &primitive: primitive_types) {
+        if (env->IsSameObject(type, primitive.type)) return primitive.shorty;
+    }
+    return 'L';
+}
+
+jclass invocation_target_exception = nullptr;
+jmethodID invocation_target_exception_ctor = nullptr;
+
+// Executable and Method, resolved by InitCallPlans
+jclass method_class = nullptr;
+jmethodID get_declaring_class = nullptr;
+jmethodID get_modifiers = nullptr;
+jmethodID get_return_type = nullptr;
+jmethodID get_parameter_types = nullptr;
+
+// What the call plans need from the reflected signature of a method
+struct Signature {
+    // a local ref
+    jclass declaring_class = nullptr;
+    bool is_static = false;
+    char return_shorty = 'V';
+};
+
+// Reads the signature of method and calls on_param with the class and shorty of every
+// parameter in order. Nothing may be called with an exception pending, so it stops at the
+// first call that throws and returns false with the exception still pending. The caller then
+// frees what on_param kept, signature holds no refs.
+template <typename OnParam>
+bool ReadSignature(JNIEnv *env, jobject method, Signature &signature, OnParam &&on_param) {
+    constexpr jint kStatic = 0x0008;
+    jobjectArray parameter_types = nullptr;
+    auto failed = [&] {
+        if (!env->ExceptionCheck()) return false;
+        if (parameter_types) env->DeleteLocalRef(parameter_types);
+        if (signature.declaring_class) env->DeleteLocalRef(signature.declaring_class);
+        signature.declaring_class = nullptr;
+        return true;
+    };
+
+    signature.declaring_class = static_cast<jclass>(env->CallObjectMethod(method, get_declaring_class));
+    if (failed()) return false;
+    auto modifiers = env->CallIntMethod(method, get_modifiers);
+    if (failed()) return false;
+    signature.is_static = (modifiers & kStatic) != 0;
+    // constructors return void
+    signature.return_shorty = 'V';
+    if (env->IsInstanceOf(method, method_class)) {
+        auto return_type = static_cast<jclass>(env->CallObjectMethod(method, get_return_type));
+        if (failed()) return false;
+        signature.return_shorty = ShortyOf(env, return_type);
+        env->DeleteLocalRef(return_type);
+    }
+    parameter_types = static_cast<jobjectArray>(env->CallObjectMethod(method, get_parameter_types));
+    if (failed()) return false;
+    auto count = parameter_types ? env->GetArrayLength(parameter_types) : 0;
+    for (jsize i = 0; i < count; ++i) {
+        auto type = static_cast<jclass>(env->GetObjectArrayElement(parameter_types, i));
+        if (failed()) return false;
+        on_param(type, ShortyOf(env, type));
+        env->DeleteLocalRef(type);
+    }
+    env->DeleteLocalRef(parameter_types);
+    return true;
+}
+}  // namespace
+
+namespace lspd {
+const PrimitiveType *PrimitiveOf(char shorty) {
+    for (auto &primitive: primitive_types) {
+        if (primitive.shorty == shorty) return &primitive;
+    }
+    return nullptr;
+}
+
+std::unique_ptr<const CallPlan> CallPlan::Create(JNIEnv *env, jobject method, jobject backup) {
+    auto plan = std::make_unique<CallPlan>();
+    Signature signature;
+    auto read = ReadSignature(env, method, signature, [&](jclass type, char shorty) {
+        auto *primitive = PrimitiveOf(shorty);
+        plan->params.push_back({
+            .shorty = shorty,
+            .type = primitive ? primitive->boxed : static_cast<jclass>(env->NewGlobalRef(type)),
+            .primitive = primitive,
+        });
+    });
+    if (!read) {
+        // Method.invoke will report it
+        env->ExceptionClear();
+        for (auto &param : plan->params) {
+            if (!param.primitive) env->DeleteGlobalRef(param.type);
+        }
+        return nullptr;
+    }
+    plan->declaring_class = static_cast<jclass>(env->NewGlobalRef(signature.declaring_class));
+    env->DeleteLocalRef(signature.declaring_class);
+    plan->backup = env->FromReflectedMethod(backup);
+    plan->is_static = signature.is_static;
+    plan->return_shorty = signature.return_shorty;
+    plan->return_primitive = PrimitiveOf(plan->return_shorty);
+    return plan;
+}
+
+bool CallPlan::Invoke(JNIEnv *env, jobject thiz, jobjectArray args, jobject &result) const {
+    auto count = args ? static_cast<size_t>(env->GetArrayLength(args)) : 0;
+    if (count != params.size() || count > kMaxArgs) return false;
+    if (!is_static && (thiz == nullptr || !env->IsInstanceOf(thiz, declaring_class))) return false;
+
+    std::array<jvalue, kMaxArgs> values;
+    std::array<jobject, kMaxArgs> elements;
+    auto release = [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) env->DeleteLocalRef(elements[i]);
+    };
+    for (size_t i = 0; i < count; ++i) {
+        auto &param = params[i];
+        auto element = elements[i] = env->GetObjectArrayElement(args, static_cast<jsize>(i));
+        // box classes are final, so instanceof is an exact match and no conversion is needed.
+        // JNI considers null an instance of everything.
+        if (param.primitive ? !element || !env->IsInstanceOf(element, param.type)
+                            : element && !env->IsInstanceOf(element, param.type)) {
+            release(i + 1);
+            return false;
+        }
+        auto &value = values[i];
+        switch (param.shorty) {
+            case 'Z': value.z = env->CallBooleanMethod(element, param.primitive->unbox); break;
+            case 'B': value.b = env->CallByteMethod(element, param.primitive->unbox); break;
+            case 'C': value.c = env->CallCharMethod(element, param.primitive->unbox); break;
+            case 'S': value.s = env->CallShortMethod(element, param.primitive->unbox); break;
+            case 'I': value.i = env->CallIntMethod(element, param.primitive->unbox); break;
+            case 'J': value.j = env->CallLongMethod(element, param.primitive->unbox); break;
+            case 'F': value.f = env->CallFloatMethod(element, param.primitive->unbox); break;
+            case 'D': value.d = env->CallDoubleMethod(element, param.primitive->unbox); break;
+            default: value.l = element; break;
+        }
+    }
+
+    auto *a = values.data();
+    jvalue ret{};
+#define CALL(TYPE, FIELD)                                                                      \
+    ret.FIELD = is_static ? env->CallStatic##TYPE##MethodA(declaring_class, backup, a)          \
+                          : env->CallNonvirtual##TYPE##MethodA(thiz, declaring_class, backup, a)
+    switch (return_shorty) {
+        case 'Z': CALL(Boolean, z); break;
+        case 'B': CALL(Byte, b); break;
+        case 'C': CALL(Char, c); break;
+        case 'S': CALL(Short, s); break;
+        case 'I': CALL(Int, i); break;
+        case 'J': CALL(Long, j); break;
+        case 'F': CALL(Float, f); break;
+        case 'D': CALL(Double, d); break;
+        case 'L': CALL(Object, l); break;
+        default:
+            if (is_static) {
+                env->CallStaticVoidMethodA(declaring_class, backup, a);
+            } else {
+                env->CallNonvirtualVoidMethodA(thiz, declaring_class, backup, a);
+            }
+            break;
+    }
+#undef CALL
+    release(count);
+
+    result = nullptr;
+    if (env->ExceptionCheck()) {
+        auto cause = env->ExceptionOccurred();
+        env->ExceptionClear();
+        auto exception = static_cast<jthrowable>(env->NewObject(invocation_target_exception,
+                                                                invocation_target_exception_ctor, cause));
+        env->Throw(exception);
+        env->DeleteLocalRef(exception);
+        env->DeleteLocalRef(cause);
+    } else if (return_shorty == 'L') {
+        result = ret.l;
+    } else if (return_primitive && return_primitive->box) {
+        result = env->CallStaticObjectMethodA(return_primitive->boxed, return_primitive->box, &ret);
+    }
+    return true;
+}
+
+std::unique_ptr<const SpecialCallPlan> SpecialCallPlan::Create(JNIEnv *env, jobject method) {
+    auto plan = std::make_unique<SpecialCallPlan>();
+    Signature signature;
+    auto read = ReadSignature(env, method, signature, [&](jclass, char shorty) {
+        plan->params.push_back(PrimitiveOf(shorty));
+    });
+    if (!read) return nullptr;
+    env->DeleteLocalRef(signature.declaring_class);
+    plan->return_shorty = signature.return_shorty;
+    plan->return_primitive = PrimitiveOf(plan->return_shorty);
+    return plan;
+}
+
+void InitCallPlans(JNIEnv *env) {
+    jclass method = env->FindClass("java/lang/reflect/Method");
+    method_class = static_cast<jclass>(env->NewGlobalRef(method));
+    get_return_type = env->GetMethodID(method, "getReturnType", "()Ljava/lang/Class;");
+    env->DeleteLocalRef(method);
+    jclass executable = env->FindClass("java/lang/reflect/Executable");
+    get_declaring_class = env->GetMethodID(executable, "getDeclaringClass", "()Ljava/lang/Class;");
+    get_modifiers = env->GetMethodID(executable, "getModifiers", "()I");
+    get_parameter_types = env->GetMethodID(executable, "getParameterTypes", "()[Ljava/lang/Class;");
+    env->DeleteLocalRef(executable);
+    jclass exception = env->FindClass("java/lang/reflect/InvocationTargetException");
+    invocation_target_exception = static_cast<jclass>(env->NewGlobalRef(exception));
+    invocation_target_exception_ctor = env->GetMethodID(exception, "<init>", "(Ljava/lang/Throwable;)V");
+    env->DeleteLocalRef(exception);
+    struct {
+        char shorty;
+        const char *boxed;
+        const char *unbox;
+        const char *unbox_signature;
+        const char *box_signature;
+    } constexpr kPrimitives[] = {
+        {'Z', "java/lang/Boolean", "booleanValue", "()Z", "(Z)Ljava/lang/Boolean;"},
+        {'B', "java/lang/Byte", "byteValue", "()B", "(B)Ljava/lang/Byte;"},
+        {'C', "java/lang/Character", "charValue", "()C", "(C)Ljava/lang/Character;"},
+        {'S', "java/lang/Short", "shortValue", "()S", "(S)Ljava/lang/Short;"},
+        {'I', "java/lang/Integer", "intValue", "()I", "(I)Ljava/lang/Integer;"},
+        {'J', "java/lang/Long", "longValue", "()J", "(J)Ljava/lang/Long;"},
+        {'F', "java/lang/Float", "floatValue", "()F", "(F)Ljava/lang/Float;"},
+        {'D', "java/lang/Double", "doubleValue", "()D", "(D)Ljava/lang/Double;"},
+        {'V', "java/lang/Void", nullptr, nullptr, nullptr},
+    };
+    static_assert(std::size(kPrimitives) == std::tuple_size_v<decltype(primitive_types)>);
+    for (size_t i = 0; i < std::size(kPrimitives); ++i) {
+        auto &[shorty, boxed, unbox, unbox_signature, box_signature] = kPrimitives[i];
+        auto boxed_class = env->FindClass(boxed);
+        auto type = env->GetStaticObjectField(boxed_class, env->GetStaticFieldID(boxed_class, "TYPE", "Ljava/lang/Class;"));
+        primitive_types[i] = {
+            .shorty = shorty,
+            .type = static_cast<jclass>(env->NewGlobalRef(type)),
+            .boxed = static_cast<jclass>(env->NewGlobalRef(boxed_class)),
+            .unbox = unbox ? env->GetMethodID(boxed_class, unbox, unbox_signature) : nullptr,
+            .box = unbox ? env->GetStaticMethodID(boxed_class, "valueOf", box_signature) : nullptr,
+        };
+        env->DeleteLocalRef(type);
+        env->DeleteLocalRef(boxed_class);
+    }
+}
+}  // namespace lspd
@@ -0,0 +1,76 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2022 LSPosed Contributors
+ */
+#pragma once
+
+#include <jni.h>
+
+#include <memory>
+#include <vector>
+
+// Calling reflected methods through JNI without Method.invoke. Nothing here hooks, so it
+// is also built into the host tests, which run it in a JVM.
+namespace lspd {
+    struct PrimitiveType {
+        char shorty;
+        jclass type;   // int.class
+        jclass boxed;  // Integer.class
+        jmethodID unbox;
+        jmethodID box;
+    };
+
+    const PrimitiveType *PrimitiveOf(char shorty);
+
+    // Resolves the reflection and box classes the plans use, before any is created
+    void InitCallPlans(JNIEnv *env);
+
+    // How to call a backup through JNI instead of Method.invoke, resolved once per hooked method
+    struct CallPlan {
+        static constexpr size_t kMaxArgs = 16;
+
+        struct Param {
+            char shorty;
+            // the box class for primitives
+            jclass type;
+            const PrimitiveType *primitive;
+        };
+
+        jclass declaring_class;
+        jmethodID backup;
+        bool is_static;
+        char return_shorty;
+        const PrimitiveType *return_primitive;
+        std::vector<Param> params;
+
+        static std::unique_ptr<const CallPlan> Create(JNIEnv *env, jobject method, jobject backup);
+
+        // Returns false without calling anything if the arguments need the checks or widening
+        // conversions of Method.invoke. Exceptions of the backup are wrapped the same way.
+        bool Invoke(JNIEnv *env, jobject thiz, jobjectArray args, jobject &result) const;
+    };
+
+    // The parsed shorty of a method called through invokeSpecialMethod
+    struct SpecialCallPlan {
+        char return_shorty;
+        const PrimitiveType *return_primitive;
+        // null for references
+        std::vector<const PrimitiveType *> params;
+
+        static std::unique_ptr<const SpecialCallPlan> Create(JNIEnv *env, jobject method);
+    };
+}  // namespace lspd
@@ -0,0 +1,140 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+
+#include "dex_body.h"
+#include "slicer/reader.h"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+    constexpr dex::u1 kOpcodeMask = 0xff;
+    constexpr dex::u1 kOpcodeNoOp = 0x00;
+    constexpr dex::u1 kOpcodeConstString = 0x1a;
+    constexpr dex::u1 kOpcodeConstStringJumbo = 0x1b;
+    constexpr dex::u1 kOpcodeIGetStart = 0x52;
+    constexpr dex::u1 kOpcodeIGetEnd = 0x58;
+    constexpr dex::u1 kOpcodeSGetStart = 0x60;
+    constexpr dex::u1 kOpcodeSGetEnd = 0x66;
+    constexpr dex::u1 kOpcodeIPutStart = 0x59;
+    constexpr dex::u1 kOpcodeIPutEnd = 0x5f;
+    constexpr dex::u1 kOpcodeSPutStart = 0x67;
+    constexpr dex::u1 kOpcodeSPutEnd = 0x6d;
+    constexpr dex::u1 kOpcodeInvokeStart = 0x6e;
+    constexpr dex::u1 kOpcodeInvokeEnd = 0x72;
+    constexpr dex::u1 kOpcodeInvokeRangeStart = 0x74;
+    constexpr dex::u1 kOpcodeInvokeRangeEnd = 0x78;
+    constexpr dex::u2 kInstPackedSwitchPlayLoad = 0x0100;
+    constexpr dex::u2 kInstSparseSwitchPlayLoad = 0x0200;
+    constexpr dex::u2 kInstFillArrayDataPlayLoad = 0x0300;
+
+    // What DecodeMethodBody looks at for each opcode, so the scan does one table load and a
+    // switch per instruction instead of a chain of range checks
+    enum OpcodeClass : dex::u1 {
+        kOpcodeClassOther,
+        kOpcodeClassNoOp,  // may start a switch or array payload
+        kOpcodeClassConstString,
+        kOpcodeClassConstStringJumbo,
+        kOpcodeClassFieldRead,
+        kOpcodeClassFieldWrite,
+        kOpcodeClassInvoke,
+    };
+
+    constexpr auto kOpcodeClasses = [] {
+        std::array<OpcodeClass, 256> table{};
+        auto fill = [&table](dex::u1 start, dex::u1 end, OpcodeClass opcode_class) {
+            for (auto opcode = start; opcode <= end; ++opcode) table[opcode] = opcode_class;
+        };
+        table[kOpcodeNoOp] = kOpcodeClassNoOp;
+        table[kOpcodeConstString] = kOpcodeClassConstString;
+        table[kOpcodeConstStringJumbo] = kOpcodeClassConstStringJumbo;
+        fill(kOpcodeIGetStart, kOpcodeIGetEnd, kOpcodeClassFieldRead);
+        fill(kOpcodeSGetStart, kOpcodeSGetEnd, kOpcodeClassFieldRead);
+        fill(kOpcodeIPutStart, kOpcodeIPutEnd, kOpcodeClassFieldWrite);
+        fill(kOpcodeSPutStart, kOpcodeSPutEnd, kOpcodeClassFieldWrite);
+        fill(kOpcodeInvokeStart, kOpcodeInvokeEnd, kOpcodeClassInvoke);
+        fill(kOpcodeInvokeRangeStart, kOpcodeInvokeRangeEnd, kOpcodeClassInvoke);
+        return table;
+    }();
+}
+
+namespace lspd {
+    void DecodeMethodBody(const dex::Code *code, MethodBody &body) {
+        // ids are appended as they come and deduplicated at the end, which is much cheaper
+        // than a tree insert per instruction. The buffers live as long as the thread, so
+        // their capacity is reused and bodies only keep exact-size copies.
+        thread_local std::vector<int32_t> referred_strings;
+        thread_local std::vector<int32_t> assigned_fields;
+        thread_local std::vector<int32_t> accessed_fields;
+        thread_local std::vector<int32_t> invoked_methods;
+        referred_strings.clear();
+        assigned_fields.clear();
+        accessed_fields.clear();
+        invoked_methods.clear();
+        body.opcodes.clear();
+
+        const dex::u2 *inst = code->insns;
+        const dex::u2 *end = inst + code->insns_size;
+        while (inst < end) {
+            dex::u1 opcode = *inst & kOpcodeMask;
+            body.opcodes.push_back(static_cast<int8_t>(opcode));
+            switch (kOpcodeClasses[opcode]) {
+                case kOpcodeClassConstString:
+                    referred_strings.emplace_back(inst[1]);
+                    break;
+                case kOpcodeClassConstStringJumbo:
+                    referred_strings.emplace_back(
+                            static_cast<int32_t>(*reinterpret_cast<const dex::u4 *>(&inst[1])));
+                    break;
+                case kOpcodeClassFieldRead:
+                    accessed_fields.emplace_back(inst[1]);
+                    break;
+                case kOpcodeClassFieldWrite:
+                    assigned_fields.emplace_back(inst[1]);
+                    break;
+                case kOpcodeClassInvoke:
+                    invoked_methods.emplace_back(inst[1]);
+                    break;
+                case kOpcodeClassNoOp:
+                    if (*inst == kInstPackedSwitchPlayLoad) {
+                        inst += inst[1] * 2 + 3;
+                    } else if (*inst == kInstSparseSwitchPlayLoad) {
+                        inst += inst[1] * 4 + 1;
+                    } else if (*inst == kInstFillArrayDataPlayLoad) {
+                        inst += (*reinterpret_cast<const dex::u4 *>(&inst[2]) * inst[1] + 1) / 2 +
+                                3;
+                    }
+                    break;
+                case kOpcodeClassOther:
+                    break;
+            }
+            inst += dex::opcode_len[opcode];
+        }
+        auto take_unique = [](std::vector<int32_t> &ids, std::vector<int32_t> &out) {
+            std::sort(ids.begin(), ids.end());
+            out.assign(ids.begin(), std::unique(ids.begin(), ids.end()));
+        };
+        take_unique(referred_strings, body.referred_strings);
+        take_unique(assigned_fields, body.assigned_fields);
+        take_unique(accessed_fields, body.accessed_fields);
+        take_unique(invoked_methods, body.invoked_methods);
+        body.loaded = true;
+    }
+}  // namespace lspd
+
@@ -0,0 +1,42 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "slicer/dex_format.h"
+
+// The instruction scan behind DexParser's method bodies. It needs neither JNI nor a parsed
+// dex, so it is also built into the host tests.
+namespace lspd {
+    // jint and jbyte on Android, the id lists are sorted and without duplicates
+    struct MethodBody {
+        bool loaded;
+        std::vector<int32_t> referred_strings;
+        std::vector<int32_t> accessed_fields;
+        std::vector<int32_t> assigned_fields;
+        std::vector<int32_t> invoked_methods;
+        std::vector<int8_t> opcodes;
+    };
+
+    // Scans the instructions of code for the ids a MethodBodyVisitor gets, replacing what
+    // body held before.
+    void DecodeMethodBody(const dex::Code *code, MethodBody &body);
+}
@@ -0,0 +1,743 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+#include "dex_file.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <numeric>
+#include <thread>
+
+#include "logging.h"
+
+namespace lspd {
+    template<class T>
+    static T ParseIntValue(const dex::u1 **pptr, size_t size) {
+        static_assert(std::is_integral<T>::value, "must be an integral type");
+        T value = 0;
+        for (size_t i = 0; i < size; ++i) {
+            value |= T(*(*pptr)++) << (i * 8);
+        }
+
+        // sign-extend?
+        if constexpr (std::is_signed_v<T>) {
+            size_t shift = (sizeof(T) - size) * 8;
+            value = T(value << shift) >> shift;
+        }
+        return value;
+    }
+
+    template<class T>
+    static T ParseFloatValue(const dex::u1 **pptr, size_t size) {
+        T value = 0;
+        int start_byte = sizeof(T) - size;
+        for (dex::u1 *p = reinterpret_cast<dex::u1 *>(&value) + start_byte; size > 0;
+             --size) {
+            *p++ = *(*pptr)++;
+        }
+        return value;
+    }
+
+    jint ParseAnnotation(const dex::u1 **annotation, AnnotationArenaBuilder &arena,
+                         jint visibility);
+
+    jint ParseArray(const dex::u1 **array, AnnotationArenaBuilder &arena);
+
+    // writes the value record at arena.records[pos]
+    void ParseValue(const dex::u1 **value, AnnotationArenaBuilder &arena, size_t pos) {
+        auto header = *(*value)++;
+        jint type = header & dex::kEncodedValueTypeMask;
+        dex::u1 arg = header >> dex::kEncodedValueArgShift;
+        jint width = 0;
+        uint64_t payload = 0;
+        auto store = [&](auto v) {
+            static_assert(sizeof(v) <= sizeof(payload));
+            std::memcpy(&payload, &v, sizeof(v));
+            width = sizeof(v);
+        };
+        switch (type) {
+            case dex::kEncodedByte:
+                store(ParseIntValue<int8_t>(value, arg + 1));
+                break;
+            case dex::kEncodedShort:
+                store(ParseIntValue<int16_t>(value, arg + 1));
+                break;
+            case dex::kEncodedChar:
+                store(ParseIntValue<uint16_t>(value, arg + 1));
+                break;
+            case dex::kEncodedInt:
+                store(ParseIntValue<int32_t>(value, arg + 1));
+                break;
+            case dex::kEncodedLong:
+                store(ParseIntValue<int64_t>(value, arg + 1));
+                break;
+            case dex::kEncodedFloat:
+                store(ParseFloatValue<float>(value, arg + 1));
+                break;
+            case dex::kEncodedDouble:
+                store(ParseFloatValue<double>(value, arg + 1));
+                break;
+            case dex::kEncodedMethodType:
+            case dex::kEncodedMethodHandle:
+            case dex::kEncodedString:
+            case dex::kEncodedType:
+            case dex::kEncodedField:
+            case dex::kEncodedMethod:
+            case dex::kEncodedEnum:
+                store(ParseIntValue<uint32_t>(value, arg + 1));
+                break;
+            case dex::kEncodedArray:
+                store(ParseArray(value, arena));
+                break;
+            case dex::kEncodedAnnotation:
+                store(ParseAnnotation(value, arena, dex::kVisibilityEncoded));
+                break;
+            case dex::kEncodedNull:
+                break;
+            case dex::kEncodedBoolean:
+                store(static_cast<jbyte>(arg == 1));
+                break;
+            default:
+                __builtin_unreachable();
+        }
+        // nested records may have grown the arena, so index only now
+        auto *record = arena.records.data() + pos;
+        record[0] = type;
+        record[1] = width;
+        std::memcpy(record + 2, &payload, sizeof(payload));
+    }
+
+    // returns the index of the annotation, which is taken before its nested values
+    jint ParseAnnotation(const dex::u1 **annotation, AnnotationArenaBuilder &arena,
+                         jint visibility) {
+        auto idx = static_cast<jint>(arena.annotation_offsets.size());
+        auto type = static_cast<jint>(dex::ReadULeb128(annotation));
+        auto size = dex::ReadULeb128(annotation);
+        auto pos = arena.records.size();
+        arena.annotation_offsets.push_back(static_cast<jint>(pos));
+        arena.records.resize(pos + 3 + size * kElementRecordSize);
+        arena.records[pos] = visibility;
+        arena.records[pos + 1] = type;
+        arena.records[pos + 2] = static_cast<jint>(size);
+        for (size_t j = 0; j < size; ++j) {
+            auto element = pos + 3 + j * kElementRecordSize;
+            arena.records[element] = static_cast<jint>(dex::ReadULeb128(annotation));
+            ParseValue(annotation, arena, element + 1);
+        }
+        return idx;
+    }
+
+    jint ParseArray(const dex::u1 **array, AnnotationArenaBuilder &arena) {
+        auto idx = static_cast<jint>(arena.array_offsets.size());
+        auto size = dex::ReadULeb128(array);
+        auto pos = arena.records.size();
+        arena.array_offsets.push_back(static_cast<jint>(pos));
+        arena.records.resize(pos + 1 + size * kValueRecordSize);
+        arena.records[pos] = static_cast<jint>(size);
+        for (size_t i = 0; i < size; ++i) {
+            ParseValue(array, arena, pos + 1 + i * kValueRecordSize);
+        }
+        return idx;
+    }
+
+    void ParseAnnotationSet(dex::Reader &dex, AnnotationArenaBuilder &arena,
+                            std::vector<jint> &indices,
+                            const dex::AnnotationSetItem *annotation_set) {
+        if (annotation_set == nullptr) {
+            return;
+        }
+        for (size_t i = 0; i < annotation_set->size; ++i) {
+            auto *item = dex.dataPtr<dex::AnnotationItem>(annotation_set->entries[i]);
+            auto *annotation_data = item->annotation;
+            indices.emplace_back(ParseAnnotation(&annotation_data, arena, item->visibility));
+        }
+    }
+
+    void DexParser::Parse(bool include_annotations) {
+        auto &dex = *this;
+        AnnotationArenaBuilder arena;
+        auto classes = dex.ClassDefs();
+        dex.class_data.resize(classes.size());
+
+        // count the members first so that all classes share three allocations
+        size_t members_count = 0;
+        size_t methods_count = 0;
+        for (const auto &class_def : classes) {
+            if (class_def.interfaces_off) {
+                members_count += dex.dataPtr<dex::TypeList>(class_def.interfaces_off)->size;
+            }
+            if (class_def.class_data_off != 0) {
+                const auto *ptr = dex.dataPtr<dex::u1>(class_def.class_data_off);
+                size_t fields = dex::ReadULeb128(&ptr);
+                fields += dex::ReadULeb128(&ptr);
+                size_t methods = dex::ReadULeb128(&ptr);
+                methods += dex::ReadULeb128(&ptr);
+                members_count += 2 * (fields + methods);
+                methods_count += methods;
+            }
+        }
+        class_members.resize(members_count);
+        class_methods_code.resize(methods_count);
+        auto *next_member = class_members.data();
+        auto *next_code = class_methods_code.data();
+        auto take_members = [&next_member](size_t count) {
+            return std::span(std::exchange(next_member, next_member + count), count);
+        };
+        auto take_codes = [&next_code](size_t count) {
+            return std::span(std::exchange(next_code, next_code + count), count);
+        };
+
+        for (size_t i = 0; i < classes.size(); ++i) {
+            auto &class_def = classes[i];
+
+            dex::u4 static_fields_count = 0;
+            dex::u4 instance_fields_count = 0;
+            dex::u4 direct_methods_count = 0;
+            dex::u4 virtual_methods_count = 0;
+            const dex::u1 *class_data_ptr = nullptr;
+
+            const dex::AnnotationsDirectoryItem *annotations = nullptr;
+            const dex::AnnotationSetItem *class_annotation = nullptr;
+            dex::u4 field_annotations_count = 0;
+            dex::u4 method_annotations_count = 0;
+            dex::u4 parameter_annotations_count = 0;
+
+            auto &class_data = dex.class_data[i];
+
+            if (class_def.interfaces_off) {
+                auto defined_interfaces = dex.dataPtr<dex::TypeList>(class_def.interfaces_off);
+                class_data.interfaces = take_members(defined_interfaces->size);
+                for (size_t k = 0; k < class_data.interfaces.size(); ++k) {
+                    class_data.interfaces[k] = defined_interfaces->list[k].type_idx;
+                }
+            }
+
+            if (class_def.annotations_off != 0) {
+                annotations = dex.dataPtr<dex::AnnotationsDirectoryItem>(class_def.annotations_off);
+                if (annotations->class_annotations_off != 0) {
+                    class_annotation = dex.dataPtr<dex::AnnotationSetItem>(
+                            annotations->class_annotations_off);
+                }
+                field_annotations_count = annotations->fields_size;
+                method_annotations_count = annotations->methods_size;
+                parameter_annotations_count = annotations->parameters_size;
+            }
+
+            if (class_def.class_data_off != 0) {
+                class_data_ptr = dex.dataPtr<dex::u1>(class_def.class_data_off);
+                static_fields_count = dex::ReadULeb128(&class_data_ptr);
+                instance_fields_count = dex::ReadULeb128(&class_data_ptr);
+                direct_methods_count = dex::ReadULeb128(&class_data_ptr);
+                virtual_methods_count = dex::ReadULeb128(&class_data_ptr);
+                class_data.static_fields = take_members(static_fields_count);
+                class_data.static_fields_access_flags = take_members(static_fields_count);
+                class_data.instance_fields = take_members(instance_fields_count);
+                class_data.instance_fields_access_flags = take_members(instance_fields_count);
+                class_data.direct_methods = take_members(direct_methods_count);
+                class_data.direct_methods_access_flags = take_members(direct_methods_count);
+                class_data.direct_methods_code = take_codes(direct_methods_count);
+                class_data.virtual_methods = take_members(virtual_methods_count);
+                class_data.virtual_methods_access_flags = take_members(virtual_methods_count);
+                class_data.virtual_methods_code = take_codes(virtual_methods_count);
+            }
+
+            if (class_data_ptr) {
+                for (size_t k = 0, field_idx = 0; k < static_fields_count; ++k) {
+                    class_data.static_fields[k] = static_cast<jint>(field_idx += dex::ReadULeb128(
+                            &class_data_ptr));
+                    class_data.static_fields_access_flags[k] = static_cast<jint>(dex::ReadULeb128(
+                            &class_data_ptr));
+                }
+
+                for (size_t k = 0, field_idx = 0; k < instance_fields_count; ++k) {
+                    class_data.instance_fields[k] = static_cast<jint>(field_idx += dex::ReadULeb128(
+                            &class_data_ptr));
+                    class_data.instance_fields_access_flags[k] = static_cast<jint>(dex::ReadULeb128(
+                            &class_data_ptr));
+                }
+
+                for (size_t k = 0, method_idx = 0; k < direct_methods_count; ++k) {
+                    class_data.direct_methods[k] = static_cast<jint>(method_idx += dex::ReadULeb128(
+                            &class_data_ptr));
+                    class_data.direct_methods_access_flags[k] = static_cast<jint>(dex::ReadULeb128(
+                            &class_data_ptr));
+                    auto code_off = dex::ReadULeb128(&class_data_ptr);
+                    class_data.direct_methods_code[k] = code_off ? dex.dataPtr<dex::Code>(code_off)
+                                                                 : nullptr;
+                }
+
+                for (size_t k = 0, method_idx = 0; k < virtual_methods_count; ++k) {
+                    class_data.virtual_methods[k] = static_cast<jint>(method_idx += dex::ReadULeb128(
+                            &class_data_ptr));
+                    class_data.virtual_methods_access_flags[k] = static_cast<jint>(dex::ReadULeb128(
+                            &class_data_ptr));
+                    auto code_off = dex::ReadULeb128(&class_data_ptr);
+                    class_data.virtual_methods_code[k] = code_off ? dex.dataPtr<dex::Code>(code_off)
+                                                                  : nullptr;
+                }
+            }
+
+            if (!include_annotations) continue;
+            class_data.annotations_begin = static_cast<uint32_t>(class_annotations.size());
+            ParseAnnotationSet(dex, arena, class_annotations, class_annotation);
+            class_data.annotations_end = static_cast<uint32_t>(class_annotations.size());
+
+            auto *field_annotations = annotations
+                                      ? reinterpret_cast<const dex::FieldAnnotationsItem *>(
+                                              annotations + 1) : nullptr;
+            for (size_t k = 0; k < field_annotations_count; ++k) {
+                auto *field_annotation = dex.dataPtr<dex::AnnotationSetItem>(
+                        field_annotations[k].annotations_off);
+                ParseAnnotationSet(dex, arena,
+                                   dex.field_annotations[static_cast<jint>(field_annotations[k].field_idx)],
+                                   field_annotation);
+            }
+
+            auto *method_annotations = field_annotations
+                                       ? reinterpret_cast<const dex::MethodAnnotationsItem *>(
+                                               field_annotations + field_annotations_count)
+                                       : nullptr;
+            for (size_t k = 0; k < method_annotations_count; ++k) {
+                auto *method_annotation = dex.dataPtr<dex::AnnotationSetItem>(
+                        method_annotations[k].annotations_off);
+                ParseAnnotationSet(dex, arena,
+                                   dex.method_annotations[static_cast<jint>(method_annotations[k].method_idx)],
+                                   method_annotation);
+            }
+
+            auto *parameter_annotations = method_annotations
+                                          ? reinterpret_cast<const dex::ParameterAnnotationsItem *>(
+                                                  method_annotations + method_annotations_count)
+                                          : nullptr;
+            for (size_t k = 0; k < parameter_annotations_count; ++k) {
+                auto *parameter_annotation = dex.dataPtr<dex::AnnotationSetRefList>(
+                        parameter_annotations[k].annotations_off);
+                auto &indices = dex.parameter_annotations[static_cast<jint>(parameter_annotations[k].method_idx)];
+                for (size_t l = 0; l < parameter_annotation->size; ++l) {
+                    if (parameter_annotation->list[l].annotations_off != 0) {
+                        auto *parameter_annotation_item = dex.dataPtr<dex::AnnotationSetItem>(
+                                parameter_annotation->list[l].annotations_off);
+                        ParseAnnotationSet(dex, arena, indices,
+                                           parameter_annotation_item);
+                    }
+                    indices.emplace_back(dex::kNoIndex);
+                }
+            }
+        }
+        if (include_annotations) dex.annotation_arena = std::move(arena).Finish();
+    }
+
+    static constexpr size_t kMaxXrefWorkers = 4;
+
+    void DexParser::BuildXrefIndex(bool parallel) {
+        std::vector<std::pair<jint, const dex::Code *>> methods;
+        for (auto &data: class_data) {
+            for (auto &[ids, codes]: {std::make_tuple(data.direct_methods, data.direct_methods_code),
+                                      std::make_tuple(data.virtual_methods,
+                                                      data.virtual_methods_code)}) {
+                for (size_t i = 0; i < ids.size(); ++i) {
+                    if (codes[i]) methods.emplace_back(ids[i], codes[i]);
+                }
+            }
+        }
+
+        // (key, method) pairs, collected per worker and merged by a counting sort below
+        struct Pairs {
+            std::vector<std::pair<jint, jint>> strings;
+            std::vector<std::pair<jint, jint>> calls;
+            std::vector<std::pair<jint, jint>> reads;
+            std::vector<std::pair<jint, jint>> writes;
+        };
+        static constexpr size_t kChunk = 256;
+        auto workers = parallel ? std::min<size_t>(
+                {(methods.size() + kChunk - 1) / kChunk,
+                 std::max(1u, std::thread::hardware_concurrency()), kMaxXrefWorkers}) : 1;
+        std::vector<Pairs> pairs(std::max<size_t>(workers, 1));
+        std::atomic_size_t next = 0;
+        auto work = [&](Pairs &out) {
+            MethodBody body{};
+            for (size_t begin; (begin = next.fetch_add(kChunk, std::memory_order_relaxed)) <
+                               methods.size();) {
+                for (size_t i = begin; i < std::min(begin + kChunk, methods.size()); ++i) {
+                    auto [method_idx, code] = methods[i];
+                    LoadMethodBody(method_idx, code, body);
+                    for (auto id: body.referred_strings) out.strings.emplace_back(id, method_idx);
+                    for (auto id: body.invoked_methods) out.calls.emplace_back(id, method_idx);
+                    for (auto id: body.accessed_fields) out.reads.emplace_back(id, method_idx);
+                    for (auto id: body.assigned_fields) out.writes.emplace_back(id, method_idx);
+                }
+            }
+        };
+        std::vector<std::thread> pool;
+        for (size_t i = 1; i < workers; ++i) {
+            pool.emplace_back(work, std::ref(pairs[i]));
+        }
+        work(pairs[0]);
+        for (auto &thread: pool) {
+            thread.join();
+        }
+
+        auto build = [&pairs](size_t keys, auto member) {
+            ReverseIndex index;
+            index.offsets.assign(keys + 1, 0);
+            for (auto &worker: pairs) {
+                for (auto [key, _]: worker.*member) {
+                    if (static_cast<uint32_t>(key) < keys) ++index.offsets[key + 1];
+                }
+            }
+            std::partial_sum(index.offsets.begin(), index.offsets.end(), index.offsets.begin());
+            index.values.resize(index.offsets.back());
+            auto cursors = index.offsets;
+            for (auto &worker: pairs) {
+                for (auto [key, method_idx]: worker.*member) {
+                    if (static_cast<uint32_t>(key) < keys) {
+                        index.values[cursors[key]++] = method_idx;
+                    }
+                }
+                std::exchange(worker.*member, {});
+            }
+            // workers take chunks in any order
+            for (size_t key = 0; key < keys; ++key) {
+                std::sort(index.values.begin() + index.offsets[key],
+                          index.values.begin() + index.offsets[key + 1]);
+            }
+            return index;
+        };
+        auto index = std::make_unique<XrefIndex>();
+        index->string_referrers = build(StringIds().size(), &Pairs::strings);
+        index->method_callers = build(MethodIds().size(), &Pairs::calls);
+        index->field_readers = build(FieldIds().size(), &Pairs::reads);
+        index->field_writers = build(FieldIds().size(), &Pairs::writes);
+        xref_index = std::move(index);
+    }
+
+    // Layout of a parsed-dex cache (native endianness, 4-byte aligned):
+    //   CacheHeader
+    //   u4[class_count][5]         interfaces, static fields, instance fields, direct and
+    //                              virtual methods of every class
+    //   jint[members_count]        class_members
+    //   u4[codes_count]            code_off of class_methods_code, 0 for none
+    //   CachedBody[body_count]
+    //   jint[ids_count]            the id lists of the bodies
+    //   jbyte[opcodes_size]        the opcodes of the bodies
+    struct DexParser::CacheHeader {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t reserved;
+        dex::u4 checksum;
+        dex::u1 signature[20];
+        dex::u4 file_size;
+        uint32_t class_count;
+        uint32_t members_count;
+        uint32_t codes_count;
+        uint32_t body_count;
+        uint32_t ids_count;
+        uint32_t opcodes_size;
+    };
+
+    struct DexParser::CachedBody {
+        jint method_idx;
+        uint32_t ids_begin;
+        uint32_t referred_strings;
+        uint32_t invoked_methods;
+        uint32_t accessed_fields;
+        uint32_t assigned_fields;
+        uint32_t opcodes_begin;
+        uint32_t opcodes_size;
+    };
+
+    static constexpr uint32_t kCacheMagic = 0x4358444c;  // "LDXC"
+    static constexpr uint16_t kCacheVersion = 1;
+    static constexpr size_t kClassCounts = 5;
+    // every access flag a field or a method can have, up to ACC_DECLARED_SYNCHRONIZED
+    static constexpr jint kAccessFlagsMask = 0x3ffff;
+
+    static bool WriteFully(int fd, const void *data, size_t size) {
+        auto *p = static_cast<const char *>(data);
+        while (size > 0) {
+            auto written = TEMP_FAILURE_RETRY(write(fd, p, size));
+            if (written <= 0) return false;
+            p += written;
+            size -= written;
+        }
+        return true;
+    }
+
+    void DexParser::LoadMethodBody(jint method_idx, const dex::Code *code, MethodBody &body) {
+        auto it = std::lower_bound(cached_bodies.begin(), cached_bodies.end(), method_idx,
+                                   [](const CachedBody &a, jint b) { return a.method_idx < b; });
+        if (it == cached_bodies.end() || it->method_idx != method_idx) {
+            lspd::DecodeMethodBody(code, body);
+            return;
+        }
+        auto *ids = cached_ids + it->ids_begin;
+        for (auto [count, out]: {std::make_pair(it->referred_strings, &body.referred_strings),
+                                 std::make_pair(it->invoked_methods, &body.invoked_methods),
+                                 std::make_pair(it->accessed_fields, &body.accessed_fields),
+                                 std::make_pair(it->assigned_fields, &body.assigned_fields)}) {
+            out->assign(ids, ids + count);
+            ids += count;
+        }
+        body.opcodes.assign(cached_opcodes + it->opcodes_begin,
+                            cached_opcodes + it->opcodes_begin + it->opcodes_size);
+        body.loaded = true;
+    }
+
+    bool DexParser::WriteCache(int fd) {
+        auto *base = reinterpret_cast<const dex::u1 *>(Header());
+        std::vector<uint32_t> counts;
+        counts.reserve(class_data.size() * kClassCounts);
+        for (auto &data: class_data) {
+            counts.insert(counts.end(), {static_cast<uint32_t>(data.interfaces.size()),
+                                         static_cast<uint32_t>(data.static_fields.size()),
+                                         static_cast<uint32_t>(data.instance_fields.size()),
+                                         static_cast<uint32_t>(data.direct_methods.size()),
+                                         static_cast<uint32_t>(data.virtual_methods.size())});
+        }
+        std::vector<dex::u4> codes;
+        codes.reserve(class_methods_code.size());
+        for (auto *code: class_methods_code) {
+            codes.emplace_back(code ? reinterpret_cast<const dex::u1 *>(code) - base : 0);
+        }
+
+        std::vector<CachedBody> bodies;
+        std::vector<jint> ids;
+        std::vector<jbyte> opcodes;
+        MethodBody body{};
+        for (auto &data: class_data) {
+            for (auto &[methods, methods_code]: {
+                    std::make_tuple(data.direct_methods, data.direct_methods_code),
+                    std::make_tuple(data.virtual_methods, data.virtual_methods_code)}) {
+                for (size_t i = 0; i < methods.size(); ++i) {
+                    if (!methods_code[i]) continue;
+                    lspd::DecodeMethodBody(methods_code[i], body);
+                    bodies.push_back({methods[i], static_cast<uint32_t>(ids.size()),
+                                      static_cast<uint32_t>(body.referred_strings.size()),
+                                      static_cast<uint32_t>(body.invoked_methods.size()),
+                                      static_cast<uint32_t>(body.accessed_fields.size()),
+                                      static_cast<uint32_t>(body.assigned_fields.size()),
+                                      static_cast<uint32_t>(opcodes.size()),
+                                      static_cast<uint32_t>(body.opcodes.size())});
+                    for (auto *list: {&body.referred_strings, &body.invoked_methods,
+                                      &body.accessed_fields, &body.assigned_fields}) {
+                        ids.insert(ids.end(), list->begin(), list->end());
+                    }
+                    opcodes.insert(opcodes.end(), body.opcodes.begin(), body.opcodes.end());
+                }
+            }
+        }
+        std::sort(bodies.begin(), bodies.end(),
+                  [](const auto &a, const auto &b) { return a.method_idx < b.method_idx; });
+        if (ids.size() > UINT32_MAX || opcodes.size() > UINT32_MAX) return false;
+
+        CacheHeader header{
+                .magic = kCacheMagic,
+                .version = kCacheVersion,
+                .reserved = 0,
+                .checksum = Header()->checksum,
+                .signature = {},
+                .file_size = Header()->file_size,
+                .class_count = static_cast<uint32_t>(class_data.size()),
+                .members_count = static_cast<uint32_t>(class_members.size()),
+                .codes_count = static_cast<uint32_t>(codes.size()),
+                .body_count = static_cast<uint32_t>(bodies.size()),
+                .ids_count = static_cast<uint32_t>(ids.size()),
+                .opcodes_size = static_cast<uint32_t>(opcodes.size()),
+        };
+        std::copy(std::begin(Header()->signature), std::end(Header()->signature),
+                  header.signature);
+        if (!WriteFully(fd, &header, sizeof(header)) ||
+            !WriteFully(fd, counts.data(), counts.size() * sizeof(uint32_t)) ||
+            !WriteFully(fd, class_members.data(), class_members.size() * sizeof(jint)) ||
+            !WriteFully(fd, codes.data(), codes.size() * sizeof(dex::u4)) ||
+            !WriteFully(fd, bodies.data(), bodies.size() * sizeof(CachedBody)) ||
+            !WriteFully(fd, ids.data(), ids.size() * sizeof(jint)) ||
+            !WriteFully(fd, opcodes.data(), opcodes.size())) {
+            PLOGE("write dex cache");
+            return false;
+        }
+        LOGD("wrote dex cache with {} classes and {} method bodies", class_data.size(),
+             bodies.size());
+        return true;
+    }
+
+    bool DexParser::LoadCache(const void *data, size_t size) {
+        auto *header = static_cast<const CacheHeader *>(data);
+        if (size < sizeof(CacheHeader) || header->magic != kCacheMagic ||
+            header->version != kCacheVersion || header->checksum != Header()->checksum ||
+            header->file_size != Header()->file_size ||
+            !std::equal(std::begin(header->signature), std::end(header->signature),
+                        std::begin(Header()->signature))) {
+            return false;
+        }
+        auto expected = sizeof(CacheHeader) +
+                        uint64_t{header->class_count} * kClassCounts * sizeof(uint32_t) +
+                        uint64_t{header->members_count} * sizeof(jint) +
+                        uint64_t{header->codes_count} * sizeof(dex::u4) +
+                        uint64_t{header->body_count} * sizeof(CachedBody) +
+                        uint64_t{header->ids_count} * sizeof(jint) + header->opcodes_size;
+        if (expected != size || header->class_count != ClassDefs().size()) {
+            LOGW("dex cache has unexpected size {} vs {}, ignoring", size, expected);
+            return false;
+        }
+        auto *counts = reinterpret_cast<const uint32_t *>(header + 1);
+        auto *members = reinterpret_cast<const jint *>(counts + header->class_count * kClassCounts);
+        auto *codes = reinterpret_cast<const dex::u4 *>(members + header->members_count);
+        auto *bodies = reinterpret_cast<const CachedBody *>(codes + header->codes_count);
+        auto *ids = reinterpret_cast<const jint *>(bodies + header->body_count);
+        auto *opcodes = reinterpret_cast<const jbyte *>(ids + header->ids_count);
+
+        uint64_t members_count = 0;
+        uint64_t codes_count = 0;
+        for (size_t i = 0; i < header->class_count; ++i) {
+            auto *c = counts + i * kClassCounts;
+            members_count += c[0] + 2 * (uint64_t{c[1]} + c[2] + c[3] + c[4]);
+            codes_count += uint64_t{c[3]} + c[4];
+        }
+        if (members_count != header->members_count || codes_count != header->codes_count) {
+            LOGW("dex cache has inconsistent class data, ignoring");
+            return false;
+        }
+        // the cache comes from another process, so every id has to be checked against the
+        // tables of this dex before the Java side indexes with it
+        auto ids_below = [](std::span<const jint> list, size_t bound) {
+            return std::ranges::all_of(list, [bound](jint id) {
+                return id >= 0 && static_cast<size_t>(id) < bound;
+            });
+        };
+        auto flags_valid = [](std::span<const jint> list) {
+            return std::ranges::all_of(list, [](jint flags) {
+                return (flags & ~kAccessFlagsMask) == 0;
+            });
+        };
+        auto *next = members;
+        auto take = [&next](size_t count) {
+            return std::span(std::exchange(next, next + count), count);
+        };
+        for (size_t i = 0; i < header->class_count; ++i) {
+            auto *c = counts + i * kClassCounts;
+            if (!ids_below(take(c[0]), TypeIds().size()) ||
+                !ids_below(take(c[1]), FieldIds().size()) || !flags_valid(take(c[1])) ||
+                !ids_below(take(c[2]), FieldIds().size()) || !flags_valid(take(c[2])) ||
+                !ids_below(take(c[3]), MethodIds().size()) || !flags_valid(take(c[3])) ||
+                !ids_below(take(c[4]), MethodIds().size()) || !flags_valid(take(c[4]))) {
+                LOGW("dex cache has out of bound class data, ignoring");
+                return false;
+            }
+        }
+        for (size_t i = 0; i < header->codes_count; ++i) {
+            if (codes[i] == 0) continue;
+            if (codes[i] % 4 != 0 || codes[i] + sizeof(dex::Code) > image_size ||
+                codes[i] + sizeof(dex::Code) +
+                uint64_t{dataPtr<dex::Code>(codes[i])->insns_size} * sizeof(dex::u2) >
+                image_size) {
+                LOGW("dex cache has out of bound code, ignoring");
+                return false;
+            }
+        }
+        for (size_t i = 0; i < header->body_count; ++i) {
+            auto &body = bodies[i];
+            if ((i > 0 && bodies[i - 1].method_idx >= body.method_idx) ||
+                body.method_idx < 0 || static_cast<size_t>(body.method_idx) >= MethodIds().size() ||
+                uint64_t{body.ids_begin} + body.referred_strings + body.invoked_methods +
+                body.accessed_fields + body.assigned_fields > header->ids_count ||
+                uint64_t{body.opcodes_begin} + body.opcodes_size > header->opcodes_size) {
+                LOGW("dex cache has out of bound method bodies, ignoring");
+                return false;
+            }
+            auto list = std::span(ids + body.ids_begin, header->ids_count - body.ids_begin);
+            if (!ids_below(list.subspan(0, body.referred_strings), StringIds().size()) ||
+                !ids_below(list.subspan(body.referred_strings, body.invoked_methods),
+                           MethodIds().size()) ||
+                !ids_below(list.subspan(body.referred_strings + body.invoked_methods,
+                                        body.accessed_fields + body.assigned_fields),
+                           FieldIds().size())) {
+                LOGW("dex cache has out of bound method bodies, ignoring");
+                return false;
+            }
+        }
+
+        class_members.assign(members, members + header->members_count);
+        class_methods_code.resize(header->codes_count);
+        for (size_t i = 0; i < header->codes_count; ++i) {
+            class_methods_code[i] = codes[i] ? dataPtr<dex::Code>(codes[i]) : nullptr;
+        }
+        class_data.resize(header->class_count);
+        auto *next_member = class_members.data();
+        auto *next_code = class_methods_code.data();
+        auto take_members = [&next_member](size_t count) {
+            return std::span(std::exchange(next_member, next_member + count), count);
+        };
+        auto take_codes = [&next_code](size_t count) {
+            return std::span(std::exchange(next_code, next_code + count), count);
+        };
+        for (size_t i = 0; i < header->class_count; ++i) {
+            auto *c = counts + i * kClassCounts;
+            auto &data = class_data[i];
+            // the same order as Parse hands them out
+            data.interfaces = take_members(c[0]);
+            data.static_fields = take_members(c[1]);
+            data.static_fields_access_flags = take_members(c[1]);
+            data.instance_fields = take_members(c[2]);
+            data.instance_fields_access_flags = take_members(c[2]);
+            data.direct_methods = take_members(c[3]);
+            data.direct_methods_access_flags = take_members(c[3]);
+            data.direct_methods_code = take_codes(c[3]);
+            data.virtual_methods = take_members(c[4]);
+            data.virtual_methods_access_flags = take_members(c[4]);
+            data.virtual_methods_code = take_codes(c[4]);
+        }
+        cached_bodies = {bodies, header->body_count};
+        cached_ids = ids;
+        cached_opcodes = opcodes;
+        return true;
+    }
+
+    std::vector<jboolean> ParseDexes(std::span<DexParser *const> parsers,
+                                     std::span<const DexCacheView> caches,
+                                     bool include_annotations, size_t max_workers) {
+        // parsing is independent per dex
+        auto workers = std::min<size_t>(
+                {parsers.size(), std::max(1u, std::thread::hardware_concurrency()), max_workers});
+        std::atomic_size_t next = 0;
+        // written by the workers, read after they are joined
+        std::vector<jboolean> loaded(parsers.size(), JNI_FALSE);
+        auto work = [&] {
+            for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < parsers.size();) {
+                auto [cache, cache_size] = i < caches.size() ? caches[i] : DexCacheView{};
+                if (cache && parsers[i]->LoadCache(cache, cache_size)) {
+                    loaded[i] = JNI_TRUE;
+                } else {
+                    parsers[i]->Parse(include_annotations);
+                }
+            }
+        };
+        std::vector<std::thread> pool;
+        for (size_t i = 1; i < workers; ++i) {
+            pool.emplace_back(work);
+        }
+        work();
+        for (auto &thread : pool) {
+            thread.join();
+        }
+        return loaded;
+    }
+}  // namespace lspd
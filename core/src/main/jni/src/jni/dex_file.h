@@ -0,0 +1,187 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+#pragma once
+
+#include <jni.h>
+
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+#include <parallel_hashmap/phmap.h>
+
+#include "dex_body.h"
+#include "slicer/reader.h"
+
+// The JNI-free half of the dex parser bridge. Nothing here calls into Java, so it is also
+// built into the host tests.
+namespace lspd {
+    // Annotations and encoded arrays are flattened into one jint arena, which Java gets as a
+    // single direct buffer and decodes on demand. Layout (native endianness):
+    //   annotation_count array_count
+    //   offset[annotation_count] offset[array_count]    of the records in the arena
+    //   annotation record: visibility type element_count {name value}[element_count]
+    //   array record:      value_count {value}[value_count]
+    //   value:             type width payload[2], the first width bytes of payload are the
+    //                      value as it is in memory
+    // keep in sync with LSPosedDexParser
+    constexpr size_t kValueRecordSize = 4;
+    constexpr size_t kElementRecordSize = 1 + kValueRecordSize;
+
+    // Collects the records while parsing. Nested values get appended after the record that
+    // contains them, whose size is known up front, so every record stays contiguous.
+    struct AnnotationArenaBuilder {
+        std::vector<jint> annotation_offsets;
+        std::vector<jint> array_offsets;
+        std::vector<jint> records;
+
+        std::vector<jint> Finish() && {
+            auto header = static_cast<jint>(2 + annotation_offsets.size() + array_offsets.size());
+            std::vector<jint> arena;
+            arena.reserve(header + records.size());
+            arena.push_back(static_cast<jint>(annotation_offsets.size()));
+            arena.push_back(static_cast<jint>(array_offsets.size()));
+            for (auto offset : annotation_offsets) arena.push_back(header + offset);
+            for (auto offset : array_offsets) arena.push_back(header + offset);
+            arena.insert(arena.end(), records.begin(), records.end());
+            return arena;
+        }
+    };
+
+    class DexParser : public dex::Reader {
+    public:
+        DexParser(const dex::u1 *data, size_t size)
+                : dex::Reader(data, size, nullptr, 0), image_size(size) {}
+
+        // Views into the dex-wide arrays below, so a class costs no allocation of its own
+        struct ClassData {
+            std::span<jint> interfaces;
+            std::span<jint> static_fields;
+            std::span<jint> static_fields_access_flags;
+            std::span<jint> instance_fields;
+            std::span<jint> instance_fields_access_flags;
+            std::span<jint> direct_methods;
+            std::span<jint> direct_methods_access_flags;
+            std::span<const dex::Code *> direct_methods_code;
+            std::span<jint> virtual_methods;
+            std::span<jint> virtual_methods_access_flags;
+            std::span<const dex::Code *> virtual_methods_code;
+            // [annotations_begin, annotations_end) of class_annotations
+            uint32_t annotations_begin = 0;
+            uint32_t annotations_end = 0;
+        };
+
+        // declared without jni.h for the host tests, but handed to Java as is
+        using MethodBody = lspd::MethodBody;
+        static_assert(std::is_same_v<jint, int32_t> && std::is_same_v<jbyte, int8_t>);
+
+        // Compressed sparse rows: the values of key k are values[offsets[k], offsets[k + 1]),
+        // sorted ascending
+        struct ReverseIndex {
+            std::vector<uint32_t> offsets;
+            std::vector<jint> values;
+
+            std::span<const jint> operator[](size_t key) const {
+                if (key + 1 >= offsets.size()) return {};
+                return std::span(values).subspan(offsets[key], offsets[key + 1] - offsets[key]);
+            }
+        };
+
+        // Which methods refer to a string, invoke a method or read or write a field
+        struct XrefIndex {
+            ReverseIndex string_referrers;
+            ReverseIndex method_callers;
+            ReverseIndex field_readers;
+            ReverseIndex field_writers;
+        };
+
+        // Fills class_data and the annotation tables. It touches no JNI, so several
+        // parsers can run on worker threads at once.
+        void Parse(bool include_annotations);
+
+        // Decodes every code item once, on up to kMaxXrefWorkers threads if parallel
+        void BuildXrefIndex(bool parallel);
+
+        // A body from the parsed-dex cache if there is one, decoded from code otherwise
+        void LoadMethodBody(jint method_idx, const dex::Code *code, MethodBody &body);
+
+        // Serializes class_data and the body of every method to fd. The result is only
+        // valid for a dex with the same checksum and signature.
+        bool WriteCache(int fd);
+
+        // Takes class_data and method bodies from a cache written by WriteCache instead of
+        // parsing. data has to outlive the parser. Annotations are not cached, so this is
+        // only for dexes opened without them.
+        bool LoadCache(const void *data, size_t size);
+
+        std::span<const jint> ClassAnnotations(const ClassData &data) const {
+            return std::span(class_annotations).subspan(
+                    data.annotations_begin, data.annotations_end - data.annotations_begin);
+        }
+
+        // unlike operator[] this does not insert an empty entry for members without annotations
+        static std::span<const jint> AnnotationsOf(
+                const phmap::flat_hash_map<jint, std::vector<jint>> &table, jint idx) {
+            auto it = table.find(idx);
+            return it == table.end() ? std::span<const jint>() : std::span<const jint>(it->second);
+        }
+
+        std::vector<ClassData> class_data;
+        // every id and access flag list of every class, sized exactly before filling
+        std::vector<jint> class_members;
+        std::vector<const dex::Code *> class_methods_code;
+        std::vector<jint> class_annotations;
+        phmap::flat_hash_map<jint, std::vector<jint>> field_annotations;
+        phmap::flat_hash_map<jint, std::vector<jint>> method_annotations;
+        phmap::flat_hash_map<jint, std::vector<jint>> parameter_annotations;
+
+        jint AnnotationType(jint idx) const {
+            return annotation_arena[annotation_arena[2 + idx] + 1];
+        }
+
+        // owned by the parser as it is handed out as a direct buffer, see AnnotationArenaBuilder
+        std::vector<jint> annotation_arena;
+
+        phmap::flat_hash_map<jint, MethodBody> method_bodies;
+
+        std::unique_ptr<const XrefIndex> xref_index;
+
+        // the size of the buffer, which the header of a malformed dex may not agree with
+        size_t image_size;
+
+        struct CacheHeader;
+        struct CachedBody;
+        // method bodies of a loaded cache, sorted by method_idx
+        std::span<const CachedBody> cached_bodies;
+        const jint *cached_ids = nullptr;
+        const jbyte *cached_opcodes = nullptr;
+    };
+
+    static constexpr size_t kMaxParseWorkers = 4;
+
+    // A mapped parsed-dex cache, or {nullptr, 0}
+    using DexCacheView = std::pair<const void *, size_t>;
+
+    // Loads every parser from its cache or parses it if that fails, on up to max_workers
+    // threads, and returns which ones came from their cache. caches is empty or one per parser.
+    std::vector<jboolean> ParseDexes(std::span<DexParser *const> parsers,
+                                     std::span<const DexCacheView> caches,
+                                     bool include_annotations,
+                                     size_t max_workers = kMaxParseWorkers);
+}  // namespace lspd
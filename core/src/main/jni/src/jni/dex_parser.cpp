@@ -17,232 +17,194 @@
  * Copyright (C) 2023 LSPosed Contributors
  */
 
+#include "dex_file.h"
 #include "dex_parser.h"
 #include "native_util.h"
-#include "slicer/reader.h"
 
-#include <list>
-#include <set>
-#include <parallel_hashmap/phmap.h>
+#include <linux/memfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
-namespace {
-    using Value = std::tuple<jint /*type*/, std::vector<jbyte> /*data*/>;
-    using Array = std::vector<Value>;
-    using ArrayList = std::list<Array>;
-    using Element = std::tuple<jint /*name*/, Value>;
-    using ElementList = std::vector<Element>;
-    using Annotation = std::tuple<jint/*vis*/, jint /*type*/, ElementList>;
-    using AnnotationList = std::vector<Annotation>;
-
-    class DexParser : public dex::Reader {
-    public:
-        DexParser(const dex::u1 *data, size_t size) : dex::Reader(data, size, nullptr, 0) {}
-
-        struct ClassData {
-            std::vector<jint> interfaces;
-            std::vector<jint> static_fields;
-            std::vector<jint> static_fields_access_flags;
-            std::vector<jint> instance_fields;
-            std::vector<jint> instance_fields_access_flags;
-            std::vector<jint> direct_methods;
-            std::vector<jint> direct_methods_access_flags;
-            std::vector<const dex::Code *> direct_methods_code;
-            std::vector<jint> virtual_methods;
-            std::vector<jint> virtual_methods_access_flags;
-            std::vector<const dex::Code *> virtual_methods_code;
-            std::vector<jint> annotations;
-        };
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
 
-        struct MethodBody {
-            bool loaded;
-            std::vector<jint> referred_strings;
-            std::vector<jint> accessed_fields;
-            std::vector<jint> assigned_fields;
-            std::vector<jint> invoked_methods;
-            std::vector<jbyte> opcodes;
+namespace {
+    using lspd::DexParser;
+
+    // The predicates of a DexQuery, all of them have to hold. Kinds and their layout
+    // (kind, count, values...) are shared with DexQuery.java.
+    struct Query {
+        enum Kind : jint {
+            kClassAccessFlags,  // required, forbidden
+            kSuperclass,
+            kInterfaces,
+            kClassAnnotations,
+            kMethodAccessFlags,  // required, forbidden
+            kMethodAnnotations,
+            kReferredStrings,
+            kInvokedMethods,
+            kAccessedFields,
+            kAssignedFields,
         };
 
-        std::vector<ClassData> class_data;
-        phmap::flat_hash_map<jint, std::vector<jint>> field_annotations;
-        phmap::flat_hash_map<jint, std::vector<jint>> method_annotations;
-        phmap::flat_hash_map<jint, std::vector<jint>> parameter_annotations;
-
-        phmap::flat_hash_map<jint, MethodBody> method_bodies;
-    };
-
-    template<class T>
-    static std::vector<jbyte> ParseIntValue(const dex::u1 **pptr, size_t size) {
-        static_assert(std::is_integral<T>::value, "must be an integral type");
-        std::vector<jbyte> ret(sizeof(T));
-        T &value = *reinterpret_cast<T *>(ret.data());
-        for (size_t i = 0; i < size; ++i) {
-            value |= T(*(*pptr)++) << (i * 8);
-        }
-
-        // sign-extend?
-        if constexpr (std::is_signed_v<T>) {
-            size_t shift = (sizeof(T) - size) * 8;
-            value = T(value << shift) >> shift;
-        }
-        return ret;
-    }
-
-    template<class T>
-    static std::vector<jbyte> ParseFloatValue(const dex::u1 **pptr, size_t size) {
-        std::vector<jbyte> ret(sizeof(T));
-        T &value = *reinterpret_cast<T *>(ret.data());
-        int start_byte = sizeof(T) - size;
-        for (dex::u1 *p = reinterpret_cast<dex::u1 *>(&value) + start_byte; size > 0;
-             --size) {
-            *p++ = *(*pptr)++;
+        jint class_flags_required = 0;
+        jint class_flags_forbidden = 0;
+        std::optional<jint> superclass;
+        std::vector<jint> interfaces;
+        std::vector<jint> class_annotations;
+        jint method_flags_required = 0;
+        jint method_flags_forbidden = 0;
+        std::vector<jint> method_annotations;
+        // sorted, as are the lists of MethodBody
+        std::vector<jint> referred_strings;
+        std::vector<jint> invoked_methods;
+        std::vector<jint> accessed_fields;
+        std::vector<jint> assigned_fields;
+        bool has_method_predicates = false;
+        bool has_body_predicates = false;
+
+        static std::optional<Query> Parse(std::span<const jint> data) {
+            Query query;
+            for (size_t i = 0; i + 2 <= data.size();) {
+                auto kind = data[i];
+                auto count = static_cast<size_t>(data[i + 1]);
+                if (data[i + 1] < 0 || count > data.size() - i - 2) return std::nullopt;
+                auto values = data.subspan(i + 2, count);
+                i += 2 + count;
+                auto sorted = [&values](std::vector<jint> &out) {
+                    out.insert(out.end(), values.begin(), values.end());
+                    std::sort(out.begin(), out.end());
+                    out.erase(std::unique(out.begin(), out.end()), out.end());
+                };
+                switch (kind) {
+                    case kClassAccessFlags:
+                    case kMethodAccessFlags:
+                        if (count != 2) return std::nullopt;
+                        if (kind == kClassAccessFlags) {
+                            query.class_flags_required |= values[0];
+                            query.class_flags_forbidden |= values[1];
+                        } else {
+                            query.method_flags_required |= values[0];
+                            query.method_flags_forbidden |= values[1];
+                            query.has_method_predicates = true;
+                        }
+                        break;
+                    case kSuperclass:
+                        if (count != 1) return std::nullopt;
+                        query.superclass = values[0];
+                        break;
+                    case kInterfaces:
+                        sorted(query.interfaces);
+                        break;
+                    case kClassAnnotations:
+                        sorted(query.class_annotations);
+                        break;
+                    case kMethodAnnotations:
+                        sorted(query.method_annotations);
+                        query.has_method_predicates = true;
+                        break;
+                    case kReferredStrings:
+                        sorted(query.referred_strings);
+                        query.has_method_predicates = query.has_body_predicates = true;
+                        break;
+                    case kInvokedMethods:
+                        sorted(query.invoked_methods);
+                        query.has_method_predicates = query.has_body_predicates = true;
+                        break;
+                    case kAccessedFields:
+                        sorted(query.accessed_fields);
+                        query.has_method_predicates = query.has_body_predicates = true;
+                        break;
+                    case kAssignedFields:
+                        sorted(query.assigned_fields);
+                        query.has_method_predicates = query.has_body_predicates = true;
+                        break;
+                    default:
+                        return std::nullopt;
+                }
+            }
+            return query;
         }
-        return ret;
-    }
 
-    Annotation
-    ParseAnnotation(const dex::u1 **annotation, AnnotationList &annotation_list,
-                    ArrayList &array_list);
-
-    Array
-    ParseArray(const dex::u1 **array, AnnotationList &annotation_list, ArrayList &array_list);
-
-    Value
-    ParseValue(const dex::u1 **value, AnnotationList &annotation_list, ArrayList &array_list) {
-        Value res;
-        auto &[type, value_content] = res;
-        auto header = *(*value)++;
-        type = header & dex::kEncodedValueTypeMask;
-        dex::u1 arg = header >> dex::kEncodedValueArgShift;
-        switch (type) {
-            case dex::kEncodedByte:
-                value_content = ParseIntValue<int8_t>(value, arg + 1);
-                break;
-            case dex::kEncodedShort:
-                value_content = ParseIntValue<int16_t>(value, arg + 1);
-                break;
-            case dex::kEncodedChar:
-                value_content = ParseIntValue<uint16_t>(value, arg + 1);
-                break;
-            case dex::kEncodedInt:
-                value_content = ParseIntValue<int32_t>(value, arg + 1);
-                break;
-            case dex::kEncodedLong:
-                value_content = ParseIntValue<int64_t>(value, arg + 1);
-                break;
-            case dex::kEncodedFloat:
-                value_content = ParseFloatValue<float>(value, arg + 1);
-                break;
-            case dex::kEncodedDouble:
-                value_content = ParseFloatValue<double>(value, arg + 1);
-                break;
-            case dex::kEncodedMethodType:
-            case dex::kEncodedMethodHandle:
-            case dex::kEncodedString:
-            case dex::kEncodedType:
-            case dex::kEncodedField:
-            case dex::kEncodedMethod:
-            case dex::kEncodedEnum:
-                value_content = ParseIntValue<uint32_t>(value, arg + 1);
-                break;
-            case dex::kEncodedArray:
-                value_content.resize(sizeof(jint));
-                *reinterpret_cast<jint *>(value_content.data()) = static_cast<jint>(array_list.size());
-                array_list.emplace_back(ParseArray(value, annotation_list, array_list));
-                break;
-            case dex::kEncodedAnnotation:
-                value_content.resize(sizeof(jint));
-                *reinterpret_cast<jint *>(value_content.data()) = static_cast<jint>(annotation_list.size());
-                annotation_list.emplace_back(ParseAnnotation(value, annotation_list, array_list));
-                break;
-            case dex::kEncodedNull:
-                break;
-            case dex::kEncodedBoolean:
-                value_content = {static_cast<jbyte>(arg == 1)};
-                break;
-            default:
-                __builtin_unreachable();
+        // every annotation type in types is among the annotations at indices
+        static bool HasAnnotationTypes(const DexParser &dex, std::span<const jint> indices,
+                                       std::span<const jint> types) {
+            return std::all_of(types.begin(), types.end(), [&](jint type) {
+                return std::any_of(indices.begin(), indices.end(), [&](jint idx) {
+                    return dex.AnnotationType(idx) == type;
+                });
+            });
         }
-        return res;
-    }
 
-    Annotation
-    ParseAnnotation(const dex::u1 **annotation, AnnotationList &annotation_list,
-                    ArrayList &array_list) {
-        Annotation ret = {dex::kVisibilityEncoded,
-                          dex::ReadULeb128(annotation),
-                          ElementList{}};
-        auto &[vis, type, element_list] = ret;
-        auto size = dex::ReadULeb128(annotation);
-        element_list.resize(size);
-        for (size_t j = 0; j < size; ++j) {
-            auto &[name, value] = element_list[j];
-            name = static_cast<jint>(dex::ReadULeb128(annotation));
-            value = ParseValue(annotation, annotation_list, array_list);
-        }
-        return ret;
-    }
-
-    Array
-    ParseArray(const dex::u1 **array, AnnotationList &annotation_list, ArrayList &array_list) {
-        auto size = dex::ReadULeb128(array);
-        Array ret;
-        ret.reserve(size);
-        for (size_t i = 0; i < size; ++i) {
-            ret.emplace_back(ParseValue(array, annotation_list, array_list));
+        bool MatchClass(const DexParser &dex, const dex::ClassDef &class_def,
+                        const DexParser::ClassData &class_data) const {
+            auto flags = static_cast<jint>(class_def.access_flags);
+            if ((flags & class_flags_required) != class_flags_required ||
+                (flags & class_flags_forbidden) != 0) {
+                return false;
+            }
+            if (superclass && static_cast<jint>(class_def.superclass_idx) != *superclass) {
+                return false;
+            }
+            for (auto interface: interfaces) {
+                if (std::find(class_data.interfaces.begin(), class_data.interfaces.end(),
+                              interface) == class_data.interfaces.end()) {
+                    return false;
+                }
+            }
+            return HasAnnotationTypes(dex, dex.ClassAnnotations(class_data), class_annotations);
         }
-        return ret;
-    }
 
-    void ParseAnnotationSet(dex::Reader &dex, AnnotationList &annotation_list,
-                            ArrayList &array_list, std::vector<jint> &indices,
-                            const dex::AnnotationSetItem *annotation_set) {
-        if (annotation_set == nullptr) {
-            return;
-        }
-        for (size_t i = 0; i < annotation_set->size; ++i) {
-            auto *item = dex.dataPtr<dex::AnnotationItem>(annotation_set->entries[i]);
-            auto *annotation_data = item->annotation;
-            indices.emplace_back(annotation_list.size());
-            auto &[visibility, type, element_list] = annotation_list.emplace_back(
-                    ParseAnnotation(&annotation_data, annotation_list, array_list));
-            visibility = item->visibility;
+        // scratch holds the decoded body of methods that are not cached in method_bodies yet
+        bool MatchMethod(DexParser &dex, jint method_idx, jint flags, const dex::Code *code,
+                         DexParser::MethodBody &scratch) const {
+            if ((flags & method_flags_required) != method_flags_required ||
+                (flags & method_flags_forbidden) != 0) {
+                return false;
+            }
+            if (!method_annotations.empty() &&
+                !HasAnnotationTypes(dex, DexParser::AnnotationsOf(dex.method_annotations, method_idx),
+                                    method_annotations)) {
+                return false;
+            }
+            if (!has_body_predicates) return true;
+            if (code == nullptr) return false;
+
+            const DexParser::MethodBody *body;
+            if (auto it = dex.method_bodies.find(method_idx);
+                it != dex.method_bodies.end() && it->second.loaded) {
+                body = &it->second;
+            } else {
+                dex.LoadMethodBody(method_idx, code, scratch);
+                body = &scratch;
+            }
+            auto includes = [](const std::vector<jint> &ids, const std::vector<jint> &wanted) {
+                return std::includes(ids.begin(), ids.end(), wanted.begin(), wanted.end());
+            };
+            return includes(body->referred_strings, referred_strings) &&
+                   includes(body->invoked_methods, invoked_methods) &&
+                   includes(body->accessed_fields, accessed_fields) &&
+                   includes(body->assigned_fields, assigned_fields);
         }
-    }
+    };
 }
 
 namespace lspd {
-    LSP_DEF_NATIVE_METHOD(jobject, DexParserBridge, openDex, jobject data, jlongArray args) {
-        auto dex_size = env->GetDirectBufferCapacity(data);
-        if (dex_size == -1) {
-            env->ThrowNew(env->FindClass("java/io/IOException"), "Invalid dex data");
-            return nullptr;
-        }
-        auto *dex_data = env->GetDirectBufferAddress(data);
-
-        auto *dex_reader = new DexParser(reinterpret_cast<dex::u1 *>(dex_data), dex_size);
-        auto *args_ptr = env->GetLongArrayElements(args, nullptr);
-        auto include_annotations = args_ptr[1];
-        env->ReleaseLongArrayElements(args, args_ptr, JNI_ABORT);
-        env->SetLongArrayRegion(args, 0, 1, reinterpret_cast<const jlong *>(&dex_reader));
-        auto &dex = *dex_reader;
-        if (dex.IsCompact()) {
-            env->ThrowNew(env->FindClass("java/io/IOException"), "Compact dex is not supported");
-            return nullptr;
-        }
+    static jobjectArray ToJava(JNIEnv *env, DexParser &dex, bool include_annotations) {
         auto object_class = env->FindClass("java/lang/Object");
-        auto string_class = env->FindClass("java/lang/String");
         auto int_array_class = env->FindClass("[I");
-        auto out = env->NewObjectArray(8, object_class, nullptr);
-        auto out0 = env->NewObjectArray(static_cast<jint>(dex.StringIds().size()),
-                                        string_class, nullptr);
+        auto out = env->NewObjectArray(6, object_class, nullptr);
+        // only the string_data offsets, LSPosedDexParser decodes the strings it touches
         auto strings = dex.StringIds();
+        auto out0 = env->NewIntArray(static_cast<jint>(strings.size()));
+        auto *out0_ptr = env->GetIntArrayElements(out0, nullptr);
         for (size_t i = 0; i < strings.size(); ++i) {
-            const auto *ptr = dex.dataPtr<dex::u1>(strings[i].string_data_off);
-            [[maybe_unused]] size_t len = dex::ReadULeb128(&ptr);
-            auto str = env->NewStringUTF(reinterpret_cast<const char *>(ptr));
-            env->SetObjectArrayElement(out0, static_cast<jint>(i), str);
-            env->DeleteLocalRef(str);
+            out0_ptr[i] = static_cast<jint>(strings[i].string_data_off);
         }
+        env->ReleaseIntArrayElements(out0, out0_ptr, 0);
         env->SetObjectArrayElement(out, 0, out0);
         env->DeleteLocalRef(out0);
 
@@ -304,516 +266,373 @@ namespace lspd {
         env->SetObjectArrayElement(out, 4, out4);
         env->DeleteLocalRef(out4);
 
-        auto classes = dex.ClassDefs();
-        dex.class_data.resize(classes.size());
+        if (!include_annotations) return out;
 
-        AnnotationList annotation_list;
-        ArrayList array_list;
+        // the records are decoded on demand by LSPosedDexParser
+        auto &arena = dex.annotation_arena;
+        auto out5 = env->NewDirectByteBuffer(arena.data(),
+                                             static_cast<jlong>(arena.size() * sizeof(jint)));
+        env->SetObjectArrayElement(out, 5, out5);
+        env->DeleteLocalRef(out5);
 
-        for (size_t i = 0; i < classes.size(); ++i) {
-            auto &class_def = classes[i];
+        return out;
+    }
 
-            dex::u4 static_fields_count = 0;
-            dex::u4 instance_fields_count = 0;
-            dex::u4 direct_methods_count = 0;
-            dex::u4 virtual_methods_count = 0;
-            const dex::u1 *class_data_ptr = nullptr;
 
-            const dex::AnnotationsDirectoryItem *annotations = nullptr;
-            const dex::AnnotationSetItem *class_annotation = nullptr;
-            dex::u4 field_annotations_count = 0;
-            dex::u4 method_annotations_count = 0;
-            dex::u4 parameter_annotations_count = 0;
+    LSP_DEF_NATIVE_METHOD(jobject, DexParserBridge, openDex, jobject data, jlongArray args,
+                          jobject cache) {
+        auto dex_size = env->GetDirectBufferCapacity(data);
+        if (dex_size == -1) {
+            env->ThrowNew(env->FindClass("java/io/IOException"), "Invalid dex data");
+            return nullptr;
+        }
+        auto *dex_data = env->GetDirectBufferAddress(data);
 
-            auto &class_data = dex.class_data[i];
+        auto *dex_reader = new DexParser(reinterpret_cast<dex::u1 *>(dex_data), dex_size);
+        auto *args_ptr = env->GetLongArrayElements(args, nullptr);
+        auto include_annotations = args_ptr[1];
+        env->ReleaseLongArrayElements(args, args_ptr, JNI_ABORT);
+        env->SetLongArrayRegion(args, 0, 1, reinterpret_cast<const jlong *>(&dex_reader));
+        auto &dex = *dex_reader;
+        if (dex.IsCompact()) {
+            env->ThrowNew(env->FindClass("java/io/IOException"), "Compact dex is not supported");
+            return nullptr;
+        }
+        auto *cache_data = cache ? env->GetDirectBufferAddress(cache) : nullptr;
+        if (!include_annotations && cache_data &&
+            dex.LoadCache(cache_data, env->GetDirectBufferCapacity(cache))) {
+            jlong cached = 1;
+            env->SetLongArrayRegion(args, 2, 1, &cached);
+        } else {
+            dex.Parse(include_annotations);
+        }
+        return ToJava(env, dex, include_annotations);
+    }
 
-            if (class_def.interfaces_off) {
-                auto defined_interfaces = dex.dataPtr<dex::TypeList>(class_def.interfaces_off);
-                class_data.interfaces.resize(defined_interfaces->size);
-                for (size_t k = 0; k < class_data.interfaces.size(); ++k) {
-                    class_data.interfaces[k] = defined_interfaces->list[k].type_idx;
-                }
-            }
+    // Parses data on its own and writes the cache that openDex takes for it to a memfd,
+    // returns the fd or -1. It shares nothing with other parsers, so it can run on any thread.
+    LSP_DEF_NATIVE_METHOD(jint, DexParserBridge, writeDexCache, jobject data) {
+        auto dex_size = env->GetDirectBufferCapacity(data);
+        auto *dex_data = env->GetDirectBufferAddress(data);
+        if (dex_size == -1 || dex_data == nullptr) {
+            return -1;
+        }
+        DexParser dex(reinterpret_cast<dex::u1 *>(dex_data), dex_size);
+        if (dex.IsCompact()) {
+            return -1;
+        }
+        dex.Parse(false);
+        int fd = static_cast<int>(syscall(__NR_memfd_create, "lspd_dex_cache", MFD_CLOEXEC));
+        if (fd < 0) {
+            PLOGE("memfd_create");
+            return -1;
+        }
+        if (!dex.WriteCache(fd)) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
 
-            if (class_def.annotations_off != 0) {
-                annotations = dex.dataPtr<dex::AnnotationsDirectoryItem>(class_def.annotations_off);
-                if (annotations->class_annotations_off != 0) {
-                    class_annotation = dex.dataPtr<dex::AnnotationSetItem>(
-                            annotations->class_annotations_off);
-                }
-                field_annotations_count = annotations->fields_size;
-                method_annotations_count = annotations->methods_size;
-                parameter_annotations_count = annotations->parameters_size;
+    // caches holds what openDex takes as cache for every dex, or null, and cached is set for
+    // those that were loaded from it
+    LSP_DEF_NATIVE_METHOD(jobject, DexParserBridge, openDexes, jobjectArray data,
+                          jlongArray cookies, jobjectArray caches, jbooleanArray cached,
+                          jboolean include_annotations) {
+        auto count = env->GetArrayLength(data);
+        std::vector<DexParser *> parsers(count);
+        std::vector<DexCacheView> cache_data(count);
+        // annotation values are not cached
+        for (jint i = 0; !include_annotations && i < count; ++i) {
+            auto cache = env->GetObjectArrayElement(caches, i);
+            if (!cache) continue;
+            auto *cache_address = env->GetDirectBufferAddress(cache);
+            if (cache_address) cache_data[i] = {cache_address, env->GetDirectBufferCapacity(cache)};
+            env->DeleteLocalRef(cache);
+        }
+        for (jint i = 0; i < count; ++i) {
+            auto buffer = env->GetObjectArrayElement(data, i);
+            auto dex_size = env->GetDirectBufferCapacity(buffer);
+            auto *dex_data = env->GetDirectBufferAddress(buffer);
+            env->DeleteLocalRef(buffer);
+            if (dex_size == -1) {
+                env->ThrowNew(env->FindClass("java/io/IOException"), "Invalid dex data");
+                return nullptr;
             }
-
-            if (class_def.class_data_off != 0) {
-                class_data_ptr = dex.dataPtr<dex::u1>(class_def.class_data_off);
-                static_fields_count = dex::ReadULeb128(&class_data_ptr);
-                instance_fields_count = dex::ReadULeb128(&class_data_ptr);
-                direct_methods_count = dex::ReadULeb128(&class_data_ptr);
-                virtual_methods_count = dex::ReadULeb128(&class_data_ptr);
-                class_data.static_fields.resize(static_fields_count);
-                class_data.static_fields_access_flags.resize(static_fields_count);
-                class_data.instance_fields.resize(instance_fields_count);
-                class_data.instance_fields_access_flags.resize(instance_fields_count);
-                class_data.direct_methods.resize(direct_methods_count);
-                class_data.direct_methods_access_flags.resize(direct_methods_count);
-                class_data.direct_methods_code.resize(direct_methods_count);
-                class_data.virtual_methods.resize(virtual_methods_count);
-                class_data.virtual_methods_access_flags.resize(virtual_methods_count);
-                class_data.virtual_methods_code.resize(virtual_methods_count);
+            parsers[i] = new DexParser(reinterpret_cast<dex::u1 *>(dex_data), dex_size);
+            env->SetLongArrayRegion(cookies, i, 1, reinterpret_cast<const jlong *>(&parsers[i]));
+            if (parsers[i]->IsCompact()) {
+                env->ThrowNew(env->FindClass("java/io/IOException"), "Compact dex is not supported");
+                return nullptr;
             }
+        }
 
-            if (class_data_ptr) {
-                for (size_t k = 0, field_idx = 0; k < static_fields_count; ++k) {
-                    class_data.static_fields[k] = static_cast<jint>(field_idx += dex::ReadULeb128(
-                            &class_data_ptr));
-                    class_data.static_fields_access_flags[k] = static_cast<jint>(dex::ReadULeb128(
-                            &class_data_ptr));
-                }
+        // only the conversion below needs the calling thread
+        auto loaded = ParseDexes(parsers, cache_data, include_annotations);
+        env->SetBooleanArrayRegion(cached, 0, count, loaded.data());
 
-                for (size_t k = 0, field_idx = 0; k < instance_fields_count; ++k) {
-                    class_data.instance_fields[k] = static_cast<jint>(field_idx += dex::ReadULeb128(
-                            &class_data_ptr));
-                    class_data.instance_fields_access_flags[k] = static_cast<jint>(dex::ReadULeb128(
-                            &class_data_ptr));
-                }
+        auto out = env->NewObjectArray(count, env->FindClass("java/lang/Object"), nullptr);
+        for (jint i = 0; i < count; ++i) {
+            auto dex_out = ToJava(env, *parsers[i], include_annotations);
+            env->SetObjectArrayElement(out, i, dex_out);
+            env->DeleteLocalRef(dex_out);
+        }
+        return out;
+    }
 
-                for (size_t k = 0, method_idx = 0; k < direct_methods_count; ++k) {
-                    class_data.direct_methods[k] = static_cast<jint>(method_idx += dex::ReadULeb128(
-                            &class_data_ptr));
-                    class_data.direct_methods_access_flags[k] = static_cast<jint>(dex::ReadULeb128(
-                            &class_data_ptr));
-                    auto code_off = dex::ReadULeb128(&class_data_ptr);
-                    class_data.direct_methods_code[k] = code_off ? dex.dataPtr<dex::Code>(code_off)
-                                                                 : nullptr;
-                }
+    LSP_DEF_NATIVE_METHOD(void, DexParserBridge, closeDex, jlong cookie) {
+        if (cookie != 0)
+            delete reinterpret_cast<DexParser *>(cookie);
+    }
 
-                for (size_t k = 0, method_idx = 0; k < virtual_methods_count; ++k) {
-                    class_data.virtual_methods[k] = static_cast<jint>(method_idx += dex::ReadULeb128(
-                            &class_data_ptr));
-                    class_data.virtual_methods_access_flags[k] = static_cast<jint>(dex::ReadULeb128(
-                            &class_data_ptr));
-                    auto code_off = dex::ReadULeb128(&class_data_ptr);
-                    class_data.virtual_methods_code[k] = code_off ? dex.dataPtr<dex::Code>(code_off)
-                                                                  : nullptr;
-                }
-            }
+    // Fills buffer with records of the classes from `from` on, as many as fit, and returns
+    // the index of the first class left out. The first int of buffer is the number of ints
+    // written after it. If not even the class at `from` fits, nothing is written and the
+    // negated size of its record in ints is returned.
+    //
+    // A record is, with every list prefixed by its length:
+    //   class_idx access_flags superclass_idx source_file_idx [interfaces] [annotations]
+    //   [static_fields] static_fields_access_flags [instance_fields] instance_fields_access_flags
+    //   [direct_methods] direct_methods_access_flags direct_methods_code
+    //   [virtual_methods] virtual_methods_access_flags virtual_methods_code
+    //   [field annotations] for every static and instance field
+    //   [method annotations] [parameter annotations] for every direct and virtual method
+    // where the code of a method is what getMethodBody takes, or -1 if it has none.
+    LSP_DEF_NATIVE_METHOD(jint, DexParserBridge, visitClassBatch, jlong cookie, jobject buffer,
+                          jint from) {
+        if (cookie == 0) {
+            return from;
+        }
+        auto &dex = *reinterpret_cast<DexParser *>(cookie);
+        auto *out = static_cast<jint *>(env->GetDirectBufferAddress(buffer));
+        auto capacity = env->GetDirectBufferCapacity(buffer) / static_cast<jlong>(sizeof(jint));
+        if (out == nullptr || capacity < 1) {
+            env->ThrowNew(env->FindClass("java/lang/IllegalArgumentException"),
+                          "Invalid batch buffer");
+            return from;
+        }
 
-            if (!include_annotations) continue;
-            ParseAnnotationSet(dex, annotation_list, array_list, class_data.annotations,
-                               class_annotation);
-
-            auto *field_annotations = annotations
-                                      ? reinterpret_cast<const dex::FieldAnnotationsItem *>(
-                                              annotations + 1) : nullptr;
-            for (size_t k = 0; k < field_annotations_count; ++k) {
-                auto *field_annotation = dex.dataPtr<dex::AnnotationSetItem>(
-                        field_annotations[k].annotations_off);
-                ParseAnnotationSet(dex, annotation_list, array_list,
-                                   dex.field_annotations[static_cast<jint>(field_annotations[k].field_idx)],
-                                   field_annotation);
+        auto classes = dex.ClassDefs();
+        size_t pos = 1;
+        auto put = [&](jint value) { out[pos++] = value; };
+        auto put_list = [&](std::span<const jint> list) {
+            put(static_cast<jint>(list.size()));
+            std::copy(list.begin(), list.end(), out + pos);
+            pos += list.size();
+        };
+        auto put_code = [&](std::span<const dex::Code *> codes) {
+            auto first = static_cast<jint>(codes.data() - dex.class_methods_code.data());
+            for (size_t j = 0; j < codes.size(); ++j) {
+                put(codes[j] ? first + static_cast<jint>(j) : -1);
             }
+        };
 
-            auto *method_annotations = field_annotations
-                                       ? reinterpret_cast<const dex::MethodAnnotationsItem *>(
-                                               field_annotations + field_annotations_count)
-                                       : nullptr;
-            for (size_t k = 0; k < method_annotations_count; ++k) {
-                auto *method_annotation = dex.dataPtr<dex::AnnotationSetItem>(
-                        method_annotations[k].annotations_off);
-                ParseAnnotationSet(dex, annotation_list, array_list,
-                                   dex.method_annotations[static_cast<jint>(method_annotations[k].method_idx)],
-                                   method_annotation);
+        auto i = static_cast<size_t>(std::max(from, 0));
+        for (; i < classes.size(); ++i) {
+            auto &class_def = classes[i];
+            auto &class_data = dex.class_data[i];
+            auto annotations = dex.ClassAnnotations(class_data);
+            size_t size = 10 + class_data.interfaces.size() + annotations.size() +
+                          2 * class_data.static_fields.size() +
+                          2 * class_data.instance_fields.size() +
+                          3 * class_data.direct_methods.size() +
+                          3 * class_data.virtual_methods.size();
+            for (auto fields: {class_data.static_fields, class_data.instance_fields}) {
+                for (auto field_idx: fields) {
+                    size += 1 + DexParser::AnnotationsOf(dex.field_annotations, field_idx).size();
+                }
             }
-
-            auto *parameter_annotations = method_annotations
-                                          ? reinterpret_cast<const dex::ParameterAnnotationsItem *>(
-                                                  method_annotations + method_annotations_count)
-                                          : nullptr;
-            for (size_t k = 0; k < parameter_annotations_count; ++k) {
-                auto *parameter_annotation = dex.dataPtr<dex::AnnotationSetRefList>(
-                        parameter_annotations[k].annotations_off);
-                auto &indices = dex.parameter_annotations[static_cast<jint>(parameter_annotations[k].method_idx)];
-                for (size_t l = 0; l < parameter_annotation->size; ++l) {
-                    if (parameter_annotation->list[l].annotations_off != 0) {
-                        auto *parameter_annotation_item = dex.dataPtr<dex::AnnotationSetItem>(
-                                parameter_annotation->list[l].annotations_off);
-                        ParseAnnotationSet(dex, annotation_list, array_list, indices,
-                                           parameter_annotation_item);
-                    }
-                    indices.emplace_back(dex::kNoIndex);
+            for (auto methods: {class_data.direct_methods, class_data.virtual_methods}) {
+                for (auto method_idx: methods) {
+                    size += 2 +
+                            DexParser::AnnotationsOf(dex.method_annotations, method_idx).size() +
+                            DexParser::AnnotationsOf(dex.parameter_annotations, method_idx).size();
                 }
             }
-        }
-
-        if (!include_annotations) return out;
+            if (pos + size > static_cast<size_t>(capacity)) {
+                if (pos == 1) return -static_cast<jint>(size);
+                break;
+            }
 
-        auto out5 = env->NewIntArray(static_cast<jint>(2 * annotation_list.size()));
-        auto out6 = env->NewObjectArray(static_cast<jint>(2 * annotation_list.size()), object_class,
-                                        nullptr);
-        auto out5_ptr = env->GetIntArrayElements(out5, nullptr);
-        size_t i = 0;
-        for (auto &[visibility, type, items]: annotation_list) {
-            auto out6i0 = env->NewIntArray(static_cast<jint>(2 * items.size()));
-            auto out6i0_ptr = env->GetIntArrayElements(out6i0, nullptr);
-            auto out6i1 = env->NewObjectArray(static_cast<jint>(items.size()), object_class,
-                                              nullptr);
-            size_t j = 0;
-            for (auto&[name, value]: items) {
-                auto &[value_type, value_data] = value;
-                auto java_value = value_data.empty() ? nullptr : env->NewDirectByteBuffer(
-                        value_data.data(), value_data.size());
-                env->SetObjectArrayElement(out6i1, static_cast<jint>(j), java_value);
-                out6i0_ptr[2 * j] = name;
-                out6i0_ptr[2 * j + 1] = value_type;
-                env->DeleteLocalRef(java_value);
-                ++j;
+            put(static_cast<jint>(class_def.class_idx));
+            put(static_cast<jint>(class_def.access_flags));
+            put(static_cast<jint>(class_def.superclass_idx));
+            put(static_cast<jint>(class_def.source_file_idx));
+            put_list(class_data.interfaces);
+            put_list(annotations);
+            put_list(class_data.static_fields);
+            std::ranges::for_each(class_data.static_fields_access_flags, put);
+            put_list(class_data.instance_fields);
+            std::ranges::for_each(class_data.instance_fields_access_flags, put);
+            put_list(class_data.direct_methods);
+            std::ranges::for_each(class_data.direct_methods_access_flags, put);
+            put_code(class_data.direct_methods_code);
+            put_list(class_data.virtual_methods);
+            std::ranges::for_each(class_data.virtual_methods_access_flags, put);
+            put_code(class_data.virtual_methods_code);
+            for (auto fields: {class_data.static_fields, class_data.instance_fields}) {
+                for (auto field_idx: fields) {
+                    put_list(DexParser::AnnotationsOf(dex.field_annotations, field_idx));
+                }
             }
-            env->ReleaseIntArrayElements(out6i0, out6i0_ptr, 0);
-            env->SetObjectArrayElement(out6, static_cast<jint>(2 * i), out6i0);
-            env->SetObjectArrayElement(out6, static_cast<jint>(2 * i + 1), out6i1);
-            out5_ptr[2 * i] = visibility;
-            out5_ptr[2 * i + 1] = type;
-            env->DeleteLocalRef(out6i0);
-            env->DeleteLocalRef(out6i1);
-            ++i;
-        }
-        env->ReleaseIntArrayElements(out5, out5_ptr, 0);
-        env->SetObjectArrayElement(out, 5, out5);
-        env->SetObjectArrayElement(out, 6, out6);
-        env->DeleteLocalRef(out5);
-        env->DeleteLocalRef(out6);
-
-        auto out7 = env->NewObjectArray(static_cast<jint>(2 * array_list.size()), object_class,
-                                        nullptr);
-        i = 0;
-        for (auto &array: array_list) {
-
-            auto out7i0 = env->NewIntArray(static_cast<jint>(array.size()));
-            auto out7i0_ptr = env->GetIntArrayElements(out7i0, nullptr);
-            auto out7i1 = env->NewObjectArray(static_cast<jint>(array.size()), object_class,
-                                              nullptr);
-            size_t j = 0;
-            for (auto &value: array) {
-                auto &[value_type, value_data] = value;
-                auto java_value = value_data.empty() ? nullptr : env->NewDirectByteBuffer(
-                        value_data.data(), value_data.size());
-                out7i0_ptr[j] = value_type;
-                env->SetObjectArrayElement(out7i1, static_cast<jint>(j), java_value);
-                env->DeleteLocalRef(java_value);
-                ++j;
+            for (auto methods: {class_data.direct_methods, class_data.virtual_methods}) {
+                for (auto method_idx: methods) {
+                    put_list(DexParser::AnnotationsOf(dex.method_annotations, method_idx));
+                    put_list(DexParser::AnnotationsOf(dex.parameter_annotations, method_idx));
+                }
             }
-            env->ReleaseIntArrayElements(out7i0, out7i0_ptr, 0);
-            env->SetObjectArrayElement(out7, static_cast<jint>(2 * i), out7i0);
-            env->SetObjectArrayElement(out7, static_cast<jint>(2 * i + 1), out7i1);
-            env->DeleteLocalRef(out7i0);
-            env->DeleteLocalRef(out7i1);
-            ++i;
         }
-        env->SetObjectArrayElement(out, 7, out7);
-        env->DeleteLocalRef(out7);
-
-        return out;
+        out[0] = static_cast<jint>(pos - 1);
+        return static_cast<jint>(i);
     }
 
-    LSP_DEF_NATIVE_METHOD(void, DexParserBridge, closeDex, jlong cookie) {
-        if (cookie != 0)
-            delete reinterpret_cast<DexParser *>(cookie);
-    }
+    // The arguments of MethodBodyVisitor.visit for a code index from visitClassBatch
+    LSP_DEF_NATIVE_METHOD(jobject, DexParserBridge, getMethodBody, jlong cookie,
+                          jint method_idx, jint code_idx) {
+        if (cookie == 0) {
+            return nullptr;
+        }
+        auto &dex = *reinterpret_cast<DexParser *>(cookie);
+        if (code_idx < 0 || static_cast<size_t>(code_idx) >= dex.class_methods_code.size() ||
+            dex.class_methods_code[code_idx] == nullptr) {
+            return nullptr;
+        }
+        auto &body = dex.method_bodies[method_idx];
+        if (!body.loaded) {
+            dex.LoadMethodBody(method_idx, dex.class_methods_code[code_idx], body);
+        }
 
-    LSP_DEF_NATIVE_METHOD(void, DexParserBridge, visitClass, jlong cookie, jobject visitor,
-                          jclass field_visitor_class,
-                          jclass method_visitor_class,
-                          jobject class_visit_method,
-                          jobject field_visit_method,
-                          jobject method_visit_method,
-                          jobject method_body_visit_method,
-                          jobject stop_method) {
-        static constexpr dex::u1 kOpcodeMask = 0xff;
-        static constexpr dex::u1 kOpcodeNoOp = 0x00;
-        static constexpr dex::u1 kOpcodeConstString = 0x1a;
-        static constexpr dex::u1 kOpcodeConstStringJumbo = 0x1b;
-        static constexpr dex::u1 kOpcodeIGetStart = 0x52;
-        static constexpr dex::u1 kOpcodeIGetEnd = 0x58;
-        static constexpr dex::u1 kOpcodeSGetStart = 0x60;
-        static constexpr dex::u1 kOpcodeSGetEnd = 0x66;
-        static constexpr dex::u1 kOpcodeIPutStart = 0x59;
-        static constexpr dex::u1 kOpcodeIPutEnd = 0x5f;
-        static constexpr dex::u1 kOpcodeSPutStart = 0x67;
-        static constexpr dex::u1 kOpcodeSPutEnd = 0x6d;
-        static constexpr dex::u1 kOpcodeInvokeStart = 0x6e;
-        static constexpr dex::u1 kOpcodeInvokeEnd = 0x72;
-        static constexpr dex::u1 kOpcodeInvokeRangeStart = 0x74;
-        static constexpr dex::u1 kOpcodeInvokeRangeEnd = 0x78;
-        static constexpr dex::u2 kInstPackedSwitchPlayLoad = 0x0100;
-        static constexpr dex::u2 kInstSparseSwitchPlayLoad = 0x0200;
-        static constexpr dex::u2 kInstFillArrayDataPlayLoad = 0x0300;
+        auto out = env->NewObjectArray(5, env->FindClass("java/lang/Object"), nullptr);
+        jint i = 0;
+        for (auto *ids: {&body.referred_strings, &body.invoked_methods, &body.accessed_fields,
+                         &body.assigned_fields}) {
+            auto array = env->NewIntArray(static_cast<jint>(ids->size()));
+            env->SetIntArrayRegion(array, 0, static_cast<jint>(ids->size()), ids->data());
+            env->SetObjectArrayElement(out, i++, array);
+            env->DeleteLocalRef(array);
+        }
+        auto opcodes = env->NewByteArray(static_cast<jint>(body.opcodes.size()));
+        env->SetByteArrayRegion(opcodes, 0, static_cast<jint>(body.opcodes.size()),
+                                body.opcodes.data());
+        env->SetObjectArrayElement(out, i, opcodes);
+        env->DeleteLocalRef(opcodes);
+        return out;
+    }
 
+    // Runs a DexQuery over all classes without calling into Java. Returns the class_idx of
+    // every matching class, or with methods set, the method_idx of every matching method.
+    // A class only matches a query with method predicates if one of its methods does.
+    LSP_DEF_NATIVE_METHOD(jintArray, DexParserBridge, query, jlong cookie, jintArray predicates,
+                          jboolean methods) {
         if (cookie == 0) {
-            return;
+            return nullptr;
         }
         auto &dex = *reinterpret_cast<DexParser *>(cookie);
-        auto *visit_class = env->FromReflectedMethod(class_visit_method);
-        auto *visit_field = env->FromReflectedMethod(field_visit_method);
-        auto *visit_method = env->FromReflectedMethod(method_visit_method);
-        auto *visit_method_body = env->FromReflectedMethod(method_body_visit_method);
-        auto *stop = env->FromReflectedMethod(stop_method);
+        std::vector<jint> data(env->GetArrayLength(predicates));
+        env->GetIntArrayRegion(predicates, 0, static_cast<jint>(data.size()), data.data());
+        auto query = Query::Parse(data);
+        if (!query) {
+            env->ThrowNew(env->FindClass("java/lang/IllegalArgumentException"), "Invalid query");
+            return nullptr;
+        }
 
+        std::vector<jint> res;
+        DexParser::MethodBody scratch{};
         auto classes = dex.ClassDefs();
-
-
         for (size_t i = 0; i < classes.size(); ++i) {
             auto &class_def = classes[i];
             auto &class_data = dex.class_data[i];
-            auto interfaces = env->NewIntArray(
-                    static_cast<jint>(class_data.interfaces.size()));
-            env->SetIntArrayRegion(interfaces, 0,
-                                   static_cast<jint>(class_data.interfaces.size()),
-                                   class_data.interfaces.data());
-            auto static_fields = env->NewIntArray(
-                    static_cast<jint>(class_data.static_fields.size()));
-            env->SetIntArrayRegion(static_fields, 0,
-                                   static_cast<jint>(class_data.static_fields.size()),
-                                   class_data.static_fields.data());
-            auto static_fields_access_flags = env->NewIntArray(
-                    static_cast<jint>(class_data.static_fields_access_flags.size()));
-            env->SetIntArrayRegion(static_fields_access_flags, 0,
-                                   static_cast<jint>(
-                                           class_data.static_fields_access_flags.size()),
-                                   class_data.static_fields_access_flags.data());
-            auto instance_fields = env->NewIntArray(
-                    static_cast<jint>(class_data.instance_fields.size()));
-            env->SetIntArrayRegion(instance_fields, 0,
-                                   static_cast<jint>(class_data.instance_fields.size()),
-                                   class_data.instance_fields.data());
-            auto instance_fields_access_flags = env->NewIntArray(
-                    static_cast<jint>(class_data.instance_fields_access_flags.size()));
-            env->SetIntArrayRegion(instance_fields_access_flags, 0,
-                                   static_cast<jint>(
-                                           class_data.instance_fields_access_flags.size()),
-                                   class_data.instance_fields_access_flags.data());
-            auto direct_methods = env->NewIntArray(
-                    static_cast<jint>(class_data.direct_methods.size()));
-            env->SetIntArrayRegion(direct_methods, 0,
-                                   static_cast<jint>(class_data.direct_methods.size()),
-                                   class_data.direct_methods.data());
-            auto direct_methods_access_flags = env->NewIntArray(
-                    static_cast<jint>(class_data.direct_methods_access_flags.size()));
-            env->SetIntArrayRegion(direct_methods_access_flags, 0,
-                                   static_cast<jint>(
-                                           class_data.direct_methods_access_flags.size()),
-                                   class_data.direct_methods_access_flags.data());
-            auto virtual_methods = env->NewIntArray(
-                    static_cast<jint>(class_data.virtual_methods.size()));
-            env->SetIntArrayRegion(virtual_methods, 0,
-                                   static_cast<jint>(class_data.virtual_methods.size()),
-                                   class_data.virtual_methods.data());
-            auto virtual_methods_access_flags = env->NewIntArray(
-                    static_cast<jint>(class_data.virtual_methods_access_flags.size()));
-            env->SetIntArrayRegion(virtual_methods_access_flags, 0,
-                                   static_cast<jint>(
-                                           class_data.virtual_methods_access_flags.size()),
-                                   class_data.virtual_methods_access_flags.data());
-            auto class_annotations = env->NewIntArray(
-                    static_cast<jint>(class_data.annotations.size()));
-            env->SetIntArrayRegion(class_annotations, 0,
-                                   static_cast<jint>(class_data.annotations.size()),
-                                   class_data.annotations.data());
-            jobject member_visitor = env->CallObjectMethod(visitor, visit_class,
-                                                           static_cast<jint>(class_def.class_idx),
-                                                           static_cast<jint>(class_def.access_flags),
-                                                           static_cast<jint>(class_def.superclass_idx),
-                                                           interfaces,
-                                                           static_cast<jint>(class_def.source_file_idx),
-                                                           static_fields,
-                                                           static_fields_access_flags,
-                                                           instance_fields,
-                                                           instance_fields_access_flags,
-                                                           direct_methods,
-                                                           direct_methods_access_flags,
-                                                           virtual_methods,
-                                                           virtual_methods_access_flags,
-                                                           class_annotations
-            );
-            env->DeleteLocalRef(interfaces);
-            env->DeleteLocalRef(static_fields);
-            env->DeleteLocalRef(static_fields_access_flags);
-            env->DeleteLocalRef(instance_fields);
-            env->DeleteLocalRef(instance_fields_access_flags);
-            env->DeleteLocalRef(direct_methods);
-            env->DeleteLocalRef(direct_methods_access_flags);
-            env->DeleteLocalRef(virtual_methods);
-            env->DeleteLocalRef(virtual_methods_access_flags);
-            env->DeleteLocalRef(class_annotations);
-            if (member_visitor && env->IsInstanceOf(member_visitor, field_visitor_class)) {
-                jboolean stopped = JNI_FALSE;
-                for (auto &[fields, fields_access_flags]: {
-                        std::make_tuple(class_data.static_fields,
-                                        class_data.static_fields_access_flags),
-                        std::make_tuple(class_data.instance_fields,
-                                        class_data.instance_fields_access_flags)}) {
-                    for (size_t j = 0; j < fields.size(); j++) {
-                        auto field_idx = fields[j];
-                        auto access_flags = fields_access_flags[j];
-                        auto &field_annotations = dex.field_annotations[field_idx];
-                        auto annotations = env->NewIntArray(
-                                static_cast<jint>(field_annotations.size()));
-                        env->SetIntArrayRegion(annotations, 0,
-                                               static_cast<jint>(field_annotations.size()),
-                                               field_annotations.data());
-                        env->CallVoidMethod(member_visitor, visit_field, field_idx,
-                                            access_flags, annotations);
-                        env->DeleteLocalRef(annotations);
-                        stopped = env->CallBooleanMethod(member_visitor, stop);
-                        if (stopped == JNI_TRUE) break;
-                    }
-                    if (stopped == JNI_TRUE) break;
-                }
+            if (!query->MatchClass(dex, class_def, class_data)) continue;
+            if (!methods && !query->has_method_predicates) {
+                res.emplace_back(static_cast<jint>(class_def.class_idx));
+                continue;
             }
-            if (member_visitor && env->IsInstanceOf(member_visitor, method_visitor_class)) {
-                jboolean stopped = JNI_FALSE;
-                for (auto &[methods, methods_access_flags, methods_code]: {
-                        std::make_tuple(class_data.direct_methods,
-                                        class_data.direct_methods_access_flags,
-                                        class_data.direct_methods_code),
-                        std::make_tuple(class_data.virtual_methods,
-                                        class_data.virtual_methods_access_flags,
-                                        class_data.virtual_methods_code)}) {
-                    for (size_t j = 0; j < methods.size(); j++) {
-                        auto method_idx = methods[j];
-                        auto access_flags = methods_access_flags[j];
-                        auto code = methods_code[j];
-                        auto method_annotation = dex.method_annotations[method_idx];
-                        auto method_annotations = env->NewIntArray(
-                                static_cast<jint>(method_annotation.size()));
-                        env->SetIntArrayRegion(method_annotations, 0,
-                                               static_cast<jint>(method_annotation.size()),
-                                               method_annotation.data());
-                        auto parameter_annotation = dex.parameter_annotations[method_idx];
-                        auto parameter_annotations = env->NewIntArray(
-                                static_cast<jint>(parameter_annotation.size()));
-                        env->SetIntArrayRegion(parameter_annotations, 0,
-                                               static_cast<jint>(parameter_annotation.size()),
-                                               parameter_annotation.data());
-                        auto body_visitor = env->CallObjectMethod(member_visitor, visit_method,
-                                                                  method_idx,
-                                                                  access_flags, code != nullptr,
-                                                                  method_annotations,
-                                                                  parameter_annotations);
-                        env->DeleteLocalRef(method_annotations);
-                        env->DeleteLocalRef(parameter_annotations);
-                        if (body_visitor && code != nullptr) {
-                            auto body = dex.method_bodies[method_idx];
-                            if (!body.loaded) {
-                                std::set<jint> referred_strings;
-                                std::set<jint> assigned_fields;
-                                std::set<jint> accessed_fields;
-                                std::set<jint> invoked_methods;
-
-                                const dex::u2 *inst = code->insns;
-                                const dex::u2 *end = inst + code->insns_size;
-                                while (inst < end) {
-                                    dex::u1 opcode = *inst & kOpcodeMask;
-                                    body.opcodes.push_back(static_cast<jbyte>(opcode));
-                                    if (opcode == kOpcodeConstString) {
-                                        auto str_idx = inst[1];
-                                        referred_strings.emplace(str_idx);
-                                    }
-                                    if (opcode == kOpcodeConstStringJumbo) {
-                                        auto str_idx = *reinterpret_cast<const dex::u4 *>(&inst[1]);
-                                        referred_strings.emplace(static_cast<jint>(str_idx));
-                                    }
-                                    if ((opcode >= kOpcodeIGetStart && opcode <= kOpcodeIGetEnd) ||
-                                        (opcode >= kOpcodeSGetStart && opcode <= kOpcodeSGetEnd)) {
-                                        auto field_idx = inst[1];
-                                        accessed_fields.emplace(field_idx);
-                                    }
-                                    if ((opcode >= kOpcodeIPutStart && opcode <= kOpcodeIPutEnd) ||
-                                        (opcode >= kOpcodeSPutStart && opcode <= kOpcodeSPutEnd)) {
-                                        auto field_idx = inst[1];
-                                        assigned_fields.emplace(field_idx);
-                                    }
-                                    if ((opcode >= kOpcodeInvokeStart &&
-                                         opcode <= kOpcodeInvokeEnd) ||
-                                        (opcode >= kOpcodeInvokeRangeStart &&
-                                         opcode <= kOpcodeInvokeRangeEnd)) {
-                                        auto callee = inst[1];
-                                        invoked_methods.emplace(callee);
-                                    }
-                                    if (opcode == kOpcodeNoOp) {
-                                        if (*inst == kInstPackedSwitchPlayLoad) {
-                                            inst += inst[1] * 2 + 3;
-                                        } else if (*inst == kInstSparseSwitchPlayLoad) {
-                                            inst += inst[1] * 4 + 1;
-                                        } else if (*inst == kInstFillArrayDataPlayLoad) {
-                                            inst += (*reinterpret_cast<const dex::u4 *>(&inst[2]) *
-                                                     inst[1] + 1) /
-                                                    2 + 3;
-                                        }
-                                    }
-                                    inst += dex::opcode_len[opcode];
-                                }
-                                body.referred_strings.insert(body.referred_strings.end(),
-                                                             referred_strings.begin(),
-                                                             referred_strings.end());
-                                body.assigned_fields.insert(body.assigned_fields.end(),
-                                                            assigned_fields.begin(),
-                                                            assigned_fields.end());
-                                body.accessed_fields.insert(body.accessed_fields.end(),
-                                                            accessed_fields.begin(),
-                                                            accessed_fields.end());
-                                body.invoked_methods.insert(body.invoked_methods.end(),
-                                                            invoked_methods.begin(),
-                                                            invoked_methods.end());
-                                body.loaded = true;
-                            }
-                            auto referred_strings = env->NewIntArray(
-                                    static_cast<jint>(body.referred_strings.size()));
-                            env->SetIntArrayRegion(referred_strings, 0,
-                                                   static_cast<jint>(body.referred_strings.size()),
-                                                   body.referred_strings.data());
-                            auto accessed_fields = env->NewIntArray(
-                                    static_cast<jint>(body.accessed_fields.size()));
-                            env->SetIntArrayRegion(accessed_fields, 0,
-                                                   static_cast<jint>(body.accessed_fields.size()),
-                                                   body.accessed_fields.data());
-                            auto assigned_fields = env->NewIntArray(
-                                    static_cast<jint>(body.assigned_fields.size()));
-                            env->SetIntArrayRegion(assigned_fields, 0,
-                                                   static_cast<jint>(body.assigned_fields.size()),
-                                                   body.assigned_fields.data());
-                            auto invoked_methods = env->NewIntArray(
-                                    static_cast<jint>(body.invoked_methods.size()));
-                            env->SetIntArrayRegion(invoked_methods, 0,
-                                                   static_cast<jint>(body.invoked_methods.size()),
-                                                   body.invoked_methods.data());
-                            auto opcodes = env->NewByteArray(
-                                    static_cast<jint>(body.opcodes.size()));
-                            env->SetByteArrayRegion(opcodes, 0,
-                                                    static_cast<jint>(body.opcodes.size()),
-                                                    body.opcodes.data());
-                            env->CallVoidMethod(body_visitor, visit_method_body,
-                                                referred_strings,
-                                                invoked_methods,
-                                                accessed_fields, assigned_fields, opcodes);
-                        }
-                        stopped = env->CallBooleanMethod(member_visitor, stop);
-                        if (stopped == JNI_TRUE) break;
+            bool matched = false;
+            for (auto &[ids, access_flags, codes]: {
+                    std::make_tuple(class_data.direct_methods,
+                                    class_data.direct_methods_access_flags,
+                                    class_data.direct_methods_code),
+                    std::make_tuple(class_data.virtual_methods,
+                                    class_data.virtual_methods_access_flags,
+                                    class_data.virtual_methods_code)}) {
+                for (size_t j = 0; j < ids.size() && (methods || !matched); ++j) {
+                    if (!query->MatchMethod(dex, ids[j], access_flags[j], codes[j], scratch)) {
+                        continue;
                     }
-                    if (stopped == JNI_TRUE) break;
+                    matched = true;
+                    if (methods) res.emplace_back(ids[j]);
                 }
             }
-            if (env->CallBooleanMethod(visitor, stop) == JNI_TRUE) break;
+            if (matched && !methods) {
+                res.emplace_back(static_cast<jint>(class_def.class_idx));
+            }
+        }
+
+        auto out = env->NewIntArray(static_cast<jint>(res.size()));
+        env->SetIntArrayRegion(out, 0, static_cast<jint>(res.size()), res.data());
+        return out;
+    }
+
+    // Builds the reverse index getXrefs answers from, a no-op if it exists already
+    LSP_DEF_NATIVE_METHOD(void, DexParserBridge, buildXrefIndex, jlong cookie,
+                          jboolean parallel) {
+        if (cookie == 0) {
+            return;
         }
+        auto &dex = *reinterpret_cast<DexParser *>(cookie);
+        if (!dex.xref_index) {
+            dex.BuildXrefIndex(parallel);
+        }
+    }
+
+    // Sorted method ids that refer to the string (kind 0), invoke the method (1), read the
+    // field (2) or write the field (3) id. Null if the index has not been built.
+    LSP_DEF_NATIVE_METHOD(jintArray, DexParserBridge, getXrefs, jlong cookie, jint kind,
+                          jint id) {
+        if (cookie == 0) {
+            return nullptr;
+        }
+        auto &dex = *reinterpret_cast<DexParser *>(cookie);
+        if (!dex.xref_index) {
+            return nullptr;
+        }
+        const DexParser::ReverseIndex *index;
+        switch (kind) {
+            case 0:
+                index = &dex.xref_index->string_referrers;
+                break;
+            case 1:
+                index = &dex.xref_index->method_callers;
+                break;
+            case 2:
+                index = &dex.xref_index->field_readers;
+                break;
+            case 3:
+                index = &dex.xref_index->field_writers;
+                break;
+            default:
+                env->ThrowNew(env->FindClass("java/lang/IllegalArgumentException"),
+                              "Invalid xref kind");
+                return nullptr;
+        }
+        auto methods = id < 0 ? std::span<const jint>() : (*index)[id];
+        auto out = env->NewIntArray(static_cast<jint>(methods.size()));
+        env->SetIntArrayRegion(out, 0, static_cast<jint>(methods.size()), methods.data());
+        return out;
     }
 
     static JNINativeMethod gMethods[] = {
             LSP_NATIVE_METHOD(DexParserBridge, openDex,
-                              "(Ljava/nio/ByteBuffer;[J)Ljava/lang/Object;"),
+                              "(Ljava/nio/ByteBuffer;[JLjava/nio/ByteBuffer;)Ljava/lang/Object;"),
+            LSP_NATIVE_METHOD(DexParserBridge, writeDexCache, "(Ljava/nio/ByteBuffer;)I"),
+            LSP_NATIVE_METHOD(DexParserBridge, openDexes,
+                              "([Ljava/nio/ByteBuffer;[J[Ljava/nio/ByteBuffer;[ZZ)Ljava/lang/Object;"),
             LSP_NATIVE_METHOD(DexParserBridge, closeDex, "(J)V"),
-            LSP_NATIVE_METHOD(DexParserBridge, visitClass,
-                              "(JLjava/lang/Object;Ljava/lang/Class;Ljava/lang/Class;Ljava/lang/reflect/Method;Ljava/lang/reflect/Method;Ljava/lang/reflect/Method;Ljava/lang/reflect/Method;Ljava/lang/reflect/Method;)V"),
+            LSP_NATIVE_METHOD(DexParserBridge, visitClassBatch, "(JLjava/nio/ByteBuffer;I)I"),
+            LSP_NATIVE_METHOD(DexParserBridge, getMethodBody, "(JII)Ljava/lang/Object;"),
+            LSP_NATIVE_METHOD(DexParserBridge, query, "(J[IZ)[I"),
+            LSP_NATIVE_METHOD(DexParserBridge, buildXrefIndex, "(JZ)V"),
+            LSP_NATIVE_METHOD(DexParserBridge, getXrefs, "(JII)[I"),
     };
 
 
@@ -17,26 +17,41 @@
  * Copyright (C) 2022 LSPosed Contributors
  */
 
+#include "call_plan.h"
 #include "hook_bridge.h"
+#include "hook_profiler.h"
 #include "native_util.h"
 #include "lsplant.hpp"
 #include <parallel_hashmap/phmap.h>
+#include <array>
+#include <atomic>
 #include <memory>
 #include <shared_mutex>
 #include <mutex>
 #include <set>
+#include <vector>
 
 using namespace lsplant;
 
 namespace {
-struct ModuleCallback {
-    jmethodID before_method;
-    jmethodID after_method;
-};
+using lspd::CallPlan;
+using lspd::SpecialCallPlan;
+
+jmethodID invoke = nullptr;
+// Object and Object[], for the callback snapshots
+jclass object_class = nullptr;
+jclass object_array_class = nullptr;
+// NativeHooker.callbacks, set by HookerClass::Resolve before the first hooker is published
+std::atomic<jfieldID> hooker_callbacks = nullptr;
 
 struct HookItem {
+    // global refs to the HookerCallback and XC_MethodHook objects
     std::multimap<jint, jobject, std::greater<>> legacy_callbacks;
-    std::multimap<jint, ModuleCallback, std::greater<>> modern_callbacks;
+    std::multimap<jint, jobject, std::greater<>> modern_callbacks;
+    // the NativeHooker the hooked method calls into, null if hooking failed
+    jobject hooker = nullptr;
+    // null if the backup can only be called through Method.invoke
+    std::unique_ptr<const CallPlan> call_plan;
 private:
     std::atomic<jobject> backup {nullptr};
     static_assert(decltype(backup)::is_always_lock_free);
@@ -56,6 +71,31 @@ public:
                                        std::memory_order_acq_rel, std::memory_order_relaxed);
         backup.notify_all();
     }
+
+    // Replaces the callbacks of the hooker with a fresh {modern, legacy} array. Callers hold
+    // the backup monitor. The hooked method reads the field without locking, and an old
+    // snapshot still in use stays valid until the GC collects it.
+    void PublishCallbacks(JNIEnv *env) {
+        auto modern = env->NewObjectArray(static_cast<jsize>(modern_callbacks.size()), object_class, nullptr);
+        auto legacy = modern ? env->NewObjectArray(static_cast<jsize>(legacy_callbacks.size()),
+                                                   object_class, nullptr) : nullptr;
+        auto res = legacy ? env->NewObjectArray(2, object_array_class, nullptr) : nullptr;
+        // on OOM the hooker keeps its old snapshot and the exception goes to the caller
+        if (res) {
+            for (jsize i = 0; auto &[priority, callback]: modern_callbacks) {
+                env->SetObjectArrayElement(modern, i++, callback);
+            }
+            for (jsize i = 0; auto &[priority, callback]: legacy_callbacks) {
+                env->SetObjectArrayElement(legacy, i++, callback);
+            }
+            env->SetObjectArrayElement(res, 0, modern);
+            env->SetObjectArrayElement(res, 1, legacy);
+            env->SetObjectField(hooker, hooker_callbacks.load(std::memory_order_relaxed), res);
+        }
+        env->DeleteLocalRef(res);
+        env->DeleteLocalRef(legacy);
+        env->DeleteLocalRef(modern);
+    }
 };
 
 template <class K, class V, class Hash = phmap::priv::hash_default_hash<K>,
@@ -65,15 +105,36 @@ using SharedHashMap = phmap::parallel_flat_hash_map<K, V, Hash, Eq, Alloc, N, st
 
 SharedHashMap<jmethodID, std::unique_ptr<HookItem>> hooked_methods;
 
-jmethodID invoke = nullptr;
-jmethodID callback_ctor = nullptr;
-jfieldID before_method_field = nullptr;
-jfieldID after_method_field = nullptr;
+// calls with up to this many arguments marshal them on the stack
+constexpr size_t kInlineArgs = 8;
+
+SharedHashMap<jmethodID, std::unique_ptr<const SpecialCallPlan>> special_call_plans;
+
 }
 
 namespace lspd {
-LSP_DEF_NATIVE_METHOD(jboolean, HookBridge, hookMethod, jboolean useModernApi, jobject hookMethod,
-                      jclass hooker, jint priority, jobject callback) {
+// What hooking needs from the NativeHooker class. It is resolved on the first new hook
+// only, and once for a whole batch.
+struct HookerClass {
+    jclass clazz;
+    jmethodID init = nullptr;
+    jobject callback_method = nullptr;
+
+    void Resolve(JNIEnv *env) {
+        if (init) return;
+        init = env->GetMethodID(clazz, "<init>", "(Ljava/lang/reflect/Executable;)V");
+        if (!hooker_callbacks.load(std::memory_order_relaxed)) {
+            hooker_callbacks.store(env->GetFieldID(clazz, "callbacks", "[[Ljava/lang/Object;"),
+                                   std::memory_order_relaxed);
+        }
+        callback_method = env->ToReflectedMethod(clazz, env->GetMethodID(clazz, "callback",
+                                                                         "([Ljava/lang/Object;)Ljava/lang/Object;"),
+                                                 false);
+    }
+};
+
+static bool HookMethod(JNIEnv *env, bool useModernApi, jobject hookMethod, HookerClass &hooker,
+                       jint priority, jobject callback) {
     bool newHook = false;
 #ifndef NDEBUG
     struct finally {
@@ -101,35 +162,52 @@ LSP_DEF_NATIVE_METHOD(jboolean, HookBridge, hookMethod, jboolean useModernApi, j
         newHook = true;
     });
     if (newHook) {
-        auto init = env->GetMethodID(hooker, "<init>", "(Ljava/lang/reflect/Executable;)V");
-        auto callback_method = env->ToReflectedMethod(hooker, env->GetMethodID(hooker, "callback",
-                                                                               "([Ljava/lang/Object;)Ljava/lang/Object;"),
-                                                      false);
-        auto hooker_object = env->NewObject(hooker, init, hookMethod);
-        hook_item->SetBackup(lsplant::Hook(env, hookMethod, hooker_object, callback_method));
+        hooker.Resolve(env);
+        auto hooker_object = env->NewObject(hooker.clazz, hooker.init, hookMethod);
+        if (!hooker_object) {
+            // the constructor threw, leave the exception to the caller
+            hook_item->SetBackup(nullptr);
+            return false;
+        }
+        auto new_backup = lsplant::Hook(env, hookMethod, hooker_object, hooker.callback_method);
+        if (new_backup) {
+            hook_item->hooker = env->NewGlobalRef(hooker_object);
+            hook_item->call_plan = CallPlan::Create(env, hookMethod, new_backup);
+        }
+        hook_item->SetBackup(new_backup);
         env->DeleteLocalRef(hooker_object);
     }
     jobject backup = hook_item->GetBackup();
-    if (!backup) return JNI_FALSE;
+    if (!backup) return false;
     JNIMonitor monitor(env, backup);
-    if (useModernApi) {
-        if (before_method_field == nullptr) {
-            auto callback_class = JNI_GetObjectClass(env, callback);
-            callback_ctor = JNI_GetMethodID(env, callback_class, "<init>", "(Ljava/lang/reflect/Method;Ljava/lang/reflect/Method;)V");
-            before_method_field = JNI_GetFieldID(env, callback_class, "beforeInvocation", "Ljava/lang/reflect/Method;");
-            after_method_field = JNI_GetFieldID(env, callback_class, "afterInvocation", "Ljava/lang/reflect/Method;");
-        }
-        auto before_method = JNI_GetObjectField(env, callback, before_method_field);
-        auto after_method = JNI_GetObjectField(env, callback, after_method_field);
-        auto callback_type = ModuleCallback {
-                .before_method = env->FromReflectedMethod(before_method.get()),
-                .after_method = env->FromReflectedMethod(after_method.get()),
-        };
-        hook_item->modern_callbacks.emplace(priority, callback_type);
-    } else {
-        hook_item->legacy_callbacks.emplace(priority, env->NewGlobalRef(callback));
+    auto &callbacks = useModernApi ? hook_item->modern_callbacks : hook_item->legacy_callbacks;
+    callbacks.emplace(priority, env->NewGlobalRef(callback));
+    hook_item->PublishCallbacks(env);
+    return true;
+}
+
+LSP_DEF_NATIVE_METHOD(jboolean, HookBridge, hookMethod, jboolean useModernApi, jobject hookMethod,
+                      jclass hooker, jint priority, jobject callback) {
+    HookerClass hooker_class{.clazz = hooker};
+    return HookMethod(env, useModernApi, hookMethod, hooker_class, priority, callback);
+}
+
+LSP_DEF_NATIVE_METHOD(jbooleanArray, HookBridge, hookMethods, jboolean useModernApi,
+                      jobjectArray hookMethods, jclass hooker, jint priority, jobject callback) {
+    auto count = env->GetArrayLength(hookMethods);
+    HookerClass hooker_class{.clazz = hooker};
+    std::vector<jboolean> hooked(count);
+    for (jsize i = 0; i < count; ++i) {
+        auto hook_method = env->GetObjectArrayElement(hookMethods, i);
+        hooked[i] = HookMethod(env, useModernApi, hook_method, hooker_class, priority, callback);
+        env->DeleteLocalRef(hook_method);
+        // no JNI call is allowed with an exception pending, so let XposedBridge.hookMethods
+        // see it instead of hooking the rest
+        if (env->ExceptionCheck()) return nullptr;
     }
-    return JNI_TRUE;
+    auto res = env->NewBooleanArray(count);
+    env->SetBooleanArrayRegion(res, 0, count, hooked.data());
+    return res;
 }
 
 LSP_DEF_NATIVE_METHOD(jboolean, HookBridge, unhookMethod, jboolean useModernApi, jobject hookMethod, jobject callback) {
@@ -142,22 +220,13 @@ LSP_DEF_NATIVE_METHOD(jboolean, HookBridge, unhookMethod, jboolean useModernApi,
     jobject backup = hook_item->GetBackup();
     if (!backup) return JNI_FALSE;
     JNIMonitor monitor(env, backup);
-    if (useModernApi) {
-        auto before_method = JNI_GetObjectField(env, callback, before_method_field);
-        auto before = env->FromReflectedMethod(before_method.get());
-        for (auto i = hook_item->modern_callbacks.begin(); i != hook_item->modern_callbacks.end(); ++i) {
-            if (before == i->second.before_method) {
-                hook_item->modern_callbacks.erase(i);
-                return JNI_TRUE;
-            }
-        }
-    } else {
-        for (auto i = hook_item->legacy_callbacks.begin(); i != hook_item->legacy_callbacks.end(); ++i) {
-            if (env->IsSameObject(i->second, callback)) {
-                env->DeleteGlobalRef(i->second);
-                hook_item->legacy_callbacks.erase(i);
-                return JNI_TRUE;
-            }
+    auto &callbacks = useModernApi ? hook_item->modern_callbacks : hook_item->legacy_callbacks;
+    for (auto i = callbacks.begin(); i != callbacks.end(); ++i) {
+        if (env->IsSameObject(i->second, callback)) {
+            env->DeleteGlobalRef(i->second);
+            callbacks.erase(i);
+            hook_item->PublishCallbacks(env);
+            return JNI_TRUE;
         }
     }
     return JNI_FALSE;
@@ -175,34 +244,37 @@ LSP_DEF_NATIVE_METHOD(jobject, HookBridge, invokeOriginalMethod, jobject hookMet
     hooked_methods.if_contains(target, [&hook_item](const auto &it) {
         hook_item = it.second.get();
     });
-    return env->CallObjectMethod(hook_item ? hook_item->GetBackup() : hookMethod, invoke, thiz, args);
+    jobject backup = hook_item ? hook_item->GetBackup() : nullptr;
+    if (jobject result; backup && hook_item->call_plan &&
+                        hook_item->call_plan->Invoke(env, thiz, args, result)) {
+        return result;
+    }
+    return env->CallObjectMethod(backup ? backup : hookMethod, invoke, thiz, args);
 }
 
 LSP_DEF_NATIVE_METHOD(jobject, HookBridge, allocateObject, jclass cls) {
     return env->AllocObject(cls);
 }
 
-LSP_DEF_NATIVE_METHOD(jobject, HookBridge, invokeSpecialMethod, jobject method, jcharArray shorty,
-                      jclass cls, jobject thiz, jobjectArray args) {
-    static auto* const get_int = env->GetMethodID(env->FindClass("java/lang/Integer"), "intValue", "()I");
-    static auto* const get_double = env->GetMethodID(env->FindClass("java/lang/Double"), "doubleValue", "()D");
-    static auto* const get_long = env->GetMethodID(env->FindClass("java/lang/Long"), "longValue", "()J");
-    static auto* const get_float = env->GetMethodID(env->FindClass("java/lang/Float"), "floatValue", "()F");
-    static auto* const get_short = env->GetMethodID(env->FindClass("java/lang/Short"), "shortValue", "()S");
-    static auto* const get_byte = env->GetMethodID(env->FindClass("java/lang/Byte"), "byteValue", "()B");
-    static auto* const get_char = env->GetMethodID(env->FindClass("java/lang/Character"), "charValue", "()C");
-    static auto* const get_boolean = env->GetMethodID(env->FindClass("java/lang/Boolean"), "booleanValue", "()Z");
-    static auto* const set_int = env->GetStaticMethodID(env->FindClass("java/lang/Integer"), "valueOf", "(I)Ljava/lang/Integer;");
-    static auto* const set_double = env->GetStaticMethodID(env->FindClass("java/lang/Double"), "valueOf", "(D)Ljava/lang/Double;");
-    static auto* const set_long = env->GetStaticMethodID(env->FindClass("java/lang/Long"), "valueOf", "(J)Ljava/lang/Long;");
-    static auto* const set_float = env->GetStaticMethodID(env->FindClass("java/lang/Float"), "valueOf", "(F)Ljava/lang/Float;");
-    static auto* const set_short = env->GetStaticMethodID(env->FindClass("java/lang/Short"), "valueOf", "(S)Ljava/lang/Short;");
-    static auto* const set_byte = env->GetStaticMethodID(env->FindClass("java/lang/Byte"), "valueOf", "(B)Ljava/lang/Byte;");
-    static auto* const set_char = env->GetStaticMethodID(env->FindClass("java/lang/Character"), "valueOf", "(C)Ljava/lang/Character;");
-    static auto* const set_boolean = env->GetStaticMethodID(env->FindClass("java/lang/Boolean"), "valueOf", "(Z)Ljava/lang/Boolean;");
-
+LSP_DEF_NATIVE_METHOD(jobject, HookBridge, invokeSpecialMethod, jobject method, jclass cls,
+                      jobject thiz, jobjectArray args) {
     auto target = env->FromReflectedMethod(method);
-    auto param_len = env->GetArrayLength(shorty) - 1;
+    const SpecialCallPlan *plan = nullptr;
+    special_call_plans.if_contains(target, [&plan](const auto &it) {
+        plan = it.second.get();
+    });
+    if (!plan) {
+        auto created = SpecialCallPlan::Create(env, method);
+        if (!created) return nullptr;
+        special_call_plans.lazy_emplace_l(target, [&plan](auto &it) {
+            plan = it.second.get();
+        }, [&plan, &target, &created](const auto &ctor) {
+            plan = created.get();
+            ctor(target, std::move(created));
+        });
+    }
+
+    auto param_len = static_cast<jsize>(plan->params.size());
     if (env->GetArrayLength(args) != param_len) {
         env->ThrowNew(env->FindClass("java/lang/IllegalArgumentException"), "args.length != parameters.length");
         return nullptr;
@@ -211,80 +283,52 @@ LSP_DEF_NATIVE_METHOD(jobject, HookBridge, invokeSpecialMethod, jobject method,
         env->ThrowNew(env->FindClass("java/lang/IllegalArgumentException"), "this == null");
         return nullptr;
     }
-    std::vector<jvalue> a(param_len);
-    auto *const shorty_char = env->GetCharArrayElements(shorty, nullptr);
-    for (jint i = 0; i != param_len; ++i) {
-        jobject element;
-        switch(shorty_char[i + 1]) {
-            case 'I':
-                a[i].i = env->CallIntMethod(element = env->GetObjectArrayElement(args, i), get_int);
-                break;
-            case 'D':
-                a[i].d = env->CallDoubleMethod(element = env->GetObjectArrayElement(args, i), get_double);
-                break;
-            case 'J':
-                a[i].j = env->CallLongMethod(element = env->GetObjectArrayElement(args, i), get_long);
-                break;
-            case 'F':
-                a[i].f = env->CallFloatMethod(element = env->GetObjectArrayElement(args, i), get_float);
-                break;
-            case 'S':
-                a[i].s = env->CallShortMethod(element = env->GetObjectArrayElement(args, i), get_short);
-                break;
-            case 'B':
-                a[i].b = env->CallByteMethod(element = env->GetObjectArrayElement(args, i), get_byte);
-                break;
-            case 'C':
-                a[i].c = env->CallCharMethod(element = env->GetObjectArrayElement(args, i), get_char);
-                break;
-            case 'Z':
-                a[i].z = env->CallBooleanMethod(element = env->GetObjectArrayElement(args, i), get_boolean);
-                break;
-            default:
-            case 'L':
-                a[i].l = env->GetObjectArrayElement(args, i);
-                element = nullptr;
-                break;
+    std::array<jvalue, kInlineArgs> inline_args;
+    std::vector<jvalue> heap_args;
+    auto *a = inline_args.data();
+    if (param_len > static_cast<jsize>(kInlineArgs)) {
+        heap_args.resize(param_len);
+        a = heap_args.data();
+    }
+    for (jsize i = 0; i != param_len; ++i) {
+        auto *primitive = plan->params[i];
+        auto element = env->GetObjectArrayElement(args, i);
+        if (!primitive) {
+            a[i].l = element;
+            continue;
+        }
+        switch (primitive->shorty) {
+            case 'Z': a[i].z = env->CallBooleanMethod(element, primitive->unbox); break;
+            case 'B': a[i].b = env->CallByteMethod(element, primitive->unbox); break;
+            case 'C': a[i].c = env->CallCharMethod(element, primitive->unbox); break;
+            case 'S': a[i].s = env->CallShortMethod(element, primitive->unbox); break;
+            case 'I': a[i].i = env->CallIntMethod(element, primitive->unbox); break;
+            case 'J': a[i].j = env->CallLongMethod(element, primitive->unbox); break;
+            case 'F': a[i].f = env->CallFloatMethod(element, primitive->unbox); break;
+            case 'D': a[i].d = env->CallDoubleMethod(element, primitive->unbox); break;
         }
-        if (element) env->DeleteLocalRef(element);
+        env->DeleteLocalRef(element);
         if (env->ExceptionCheck()) return nullptr;
     }
-    jobject value = nullptr;
-    switch(shorty_char[0]) {
-        case 'I':
-            value = env->CallStaticObjectMethod(jclass{nullptr}, set_int, env->CallNonvirtualIntMethodA(thiz, cls, target, a.data()));
-            break;
-        case 'D':
-            value = env->CallStaticObjectMethod(jclass{nullptr}, set_double, env->CallNonvirtualDoubleMethodA(thiz, cls, target, a.data()));
-            break;
-        case 'J':
-            value = env->CallStaticObjectMethod(jclass{nullptr}, set_long, env->CallNonvirtualLongMethodA(thiz, cls, target, a.data()));
-            break;
-        case 'F':
-            value = env->CallStaticObjectMethod(jclass{nullptr}, set_float, env->CallNonvirtualFloatMethodA(thiz, cls, target, a.data()));
-            break;
-        case 'S':
-            value = env->CallStaticObjectMethod(jclass{nullptr}, set_short, env->CallNonvirtualShortMethodA(thiz, cls, target, a.data()));
-            break;
-        case 'B':
-            value = env->CallStaticObjectMethod(jclass{nullptr}, set_byte, env->CallNonvirtualByteMethodA(thiz, cls, target, a.data()));
-            break;
-        case 'C':
-            value = env->CallStaticObjectMethod(jclass{nullptr}, set_char, env->CallNonvirtualCharMethodA(thiz, cls, target, a.data()));
-            break;
-        case 'Z':
-            value = env->CallStaticObjectMethod(jclass{nullptr}, set_boolean, env->CallNonvirtualBooleanMethodA(thiz, cls, target, a.data()));
-            break;
-        case 'L':
-            value = env->CallNonvirtualObjectMethodA(thiz, cls, target, a.data());
-            break;
+    jvalue ret{};
+    switch (plan->return_shorty) {
+        case 'Z': ret.z = env->CallNonvirtualBooleanMethodA(thiz, cls, target, a); break;
+        case 'B': ret.b = env->CallNonvirtualByteMethodA(thiz, cls, target, a); break;
+        case 'C': ret.c = env->CallNonvirtualCharMethodA(thiz, cls, target, a); break;
+        case 'S': ret.s = env->CallNonvirtualShortMethodA(thiz, cls, target, a); break;
+        case 'I': ret.i = env->CallNonvirtualIntMethodA(thiz, cls, target, a); break;
+        case 'J': ret.j = env->CallNonvirtualLongMethodA(thiz, cls, target, a); break;
+        case 'F': ret.f = env->CallNonvirtualFloatMethodA(thiz, cls, target, a); break;
+        case 'D': ret.d = env->CallNonvirtualDoubleMethodA(thiz, cls, target, a); break;
+        case 'L': return env->CallNonvirtualObjectMethodA(thiz, cls, target, a);
         default:
         case 'V':
-            env->CallNonvirtualVoidMethodA(thiz, cls, target, a.data());
-            break;
+            env->CallNonvirtualVoidMethodA(thiz, cls, target, a);
+            return nullptr;
     }
-    env->ReleaseCharArrayElements(shorty, shorty_char, JNI_ABORT);
-    return value;
+    if (env->ExceptionCheck()) return nullptr;
+    auto *primitive = plan->return_primitive;
+    return env->CallStaticObjectMethodA(primitive->boxed, primitive->box, &ret);
 }
 
 LSP_DEF_NATIVE_METHOD(jboolean, HookBridge, instanceOf, jobject object, jclass expected_class) {
@@ -295,44 +339,49 @@ LSP_DEF_NATIVE_METHOD(jboolean, HookBridge, setTrusted, jobject cookie) {
     return lsplant::MakeDexFileTrusted(env, cookie);
 }
 
-LSP_DEF_NATIVE_METHOD(jobjectArray, HookBridge, callbackSnapshot, jclass callback_class, jobject method) {
-    auto target = env->FromReflectedMethod(method);
-    HookItem *hook_item = nullptr;
-    hooked_methods.if_contains(target, [&hook_item](const auto &it) {
-        hook_item = it.second.get();
-    });
-    if (!hook_item) return nullptr;
-    jobject backup = hook_item->GetBackup();
-    if (!backup) return nullptr;
-    JNIMonitor monitor(env, backup);
+LSP_DEF_NATIVE_METHOD(jboolean, HookBridge, profilerEnabled) {
+    return hook_profiler::Enabled();
+}
 
-    auto res = env->NewObjectArray(2, env->FindClass("[Ljava/lang/Object;"), nullptr);
-    auto modern = env->NewObjectArray((jsize) hook_item->modern_callbacks.size(), env->FindClass("java/lang/Object"), nullptr);
-    auto legacy = env->NewObjectArray((jsize) hook_item->legacy_callbacks.size(), env->FindClass("java/lang/Object"), nullptr);
-    for (jsize i = 0; auto callback: hook_item->modern_callbacks) {
-        auto before_method = JNI_ToReflectedMethod(env, clazz, callback.second.before_method, JNI_TRUE);
-        auto after_method = JNI_ToReflectedMethod(env, clazz, callback.second.after_method, JNI_TRUE);
-        auto callback_object = JNI_NewObject(env, callback_class, callback_ctor, before_method, after_method);
-        env->SetObjectArrayElement(modern, i++, env->NewLocalRef(callback_object.get()));
-    }
-    for (jsize i = 0; auto callback: hook_item->legacy_callbacks) {
-        env->SetObjectArrayElement(legacy, i++, env->NewLocalRef(callback.second));
-    }
-    env->SetObjectArrayElement(res, 0, modern);
-    env->SetObjectArrayElement(res, 1, legacy);
-    return res;
+LSP_DEF_NATIVE_METHOD(jlong, HookBridge, profilerNow) {
+    return static_cast<jlong>(hook_profiler::Now());
+}
+
+LSP_DEF_NATIVE_METHOD(jint, HookBridge, profilerRegisterName, jstring name) {
+    JUTFString str(env, name);
+    return static_cast<jint>(hook_profiler::RegisterName(str.get()));
+}
+
+LSP_DEF_NATIVE_METHOD(void, HookBridge, profilerRecord, jint method, jint callback, jint phase,
+                      jlong start) {
+    hook_profiler::Record(method, callback, static_cast<hook_profiler::Phase>(phase),
+                          hook_profiler::Now() - start);
+}
+
+LSP_DEF_NATIVE_METHOD(jbyteArray, HookBridge, profilerReport) {
+    auto report = hook_profiler::Report();
+    auto array = env->NewByteArray(static_cast<jsize>(report.size()));
+    if (!array) return nullptr;
+    env->SetByteArrayRegion(array, 0, static_cast<jsize>(report.size()),
+                            reinterpret_cast<const jbyte *>(report.data()));
+    return array;
 }
 
 static JNINativeMethod gMethods[] = {
     LSP_NATIVE_METHOD(HookBridge, hookMethod, "(ZLjava/lang/reflect/Executable;Ljava/lang/Class;ILjava/lang/Object;)Z"),
+    LSP_NATIVE_METHOD(HookBridge, hookMethods, "(Z[Ljava/lang/reflect/Executable;Ljava/lang/Class;ILjava/lang/Object;)[Z"),
     LSP_NATIVE_METHOD(HookBridge, unhookMethod, "(ZLjava/lang/reflect/Executable;Ljava/lang/Object;)Z"),
     LSP_NATIVE_METHOD(HookBridge, deoptimizeMethod, "(Ljava/lang/reflect/Executable;)Z"),
     LSP_NATIVE_METHOD(HookBridge, invokeOriginalMethod, "(Ljava/lang/reflect/Executable;Ljava/lang/Object;[Ljava/lang/Object;)Ljava/lang/Object;"),
-    LSP_NATIVE_METHOD(HookBridge, invokeSpecialMethod, "(Ljava/lang/reflect/Executable;[CLjava/lang/Class;Ljava/lang/Object;[Ljava/lang/Object;)Ljava/lang/Object;"),
+    LSP_NATIVE_METHOD(HookBridge, invokeSpecialMethod, "(Ljava/lang/reflect/Executable;Ljava/lang/Class;Ljava/lang/Object;[Ljava/lang/Object;)Ljava/lang/Object;"),
     LSP_NATIVE_METHOD(HookBridge, allocateObject, "(Ljava/lang/Class;)Ljava/lang/Object;"),
     LSP_NATIVE_METHOD(HookBridge, instanceOf, "(Ljava/lang/Object;Ljava/lang/Class;)Z"),
     LSP_NATIVE_METHOD(HookBridge, setTrusted, "(Ljava/lang/Object;)Z"),
-    LSP_NATIVE_METHOD(HookBridge, callbackSnapshot, "(Ljava/lang/Class;Ljava/lang/reflect/Executable;)[[Ljava/lang/Object;"),
+    LSP_NATIVE_METHOD(HookBridge, profilerEnabled, "()Z"),
+    LSP_NATIVE_METHOD(HookBridge, profilerNow, "()J"),
+    LSP_NATIVE_METHOD(HookBridge, profilerRegisterName, "(Ljava/lang/String;)I"),
+    LSP_NATIVE_METHOD(HookBridge, profilerRecord, "(IIIJ)V"),
+    LSP_NATIVE_METHOD(HookBridge, profilerReport, "()[B"),
 };
 
 void RegisterHookBridge(JNIEnv *env) {
@@ -341,6 +390,13 @@ void RegisterHookBridge(JNIEnv *env) {
             method, "invoke",
             "(Ljava/lang/Object;[Ljava/lang/Object;)Ljava/lang/Object;");
     env->DeleteLocalRef(method);
+    InitCallPlans(env);
+    auto object = env->FindClass("java/lang/Object");
+    object_class = static_cast<jclass>(env->NewGlobalRef(object));
+    env->DeleteLocalRef(object);
+    auto object_array = env->FindClass("[Ljava/lang/Object;");
+    object_array_class = static_cast<jclass>(env->NewGlobalRef(object_array));
+    env->DeleteLocalRef(object_array);
     REGISTER_LSP_NATIVE_METHODS(HookBridge);
 }
 } // namespace lspd
@@ -27,6 +27,7 @@
 #include "config_bridge.h"
 
 using namespace lsplant;
+using SandHook::operator""_elf;
 
 namespace lspd {
     using TYPE_GET_ATTR_NAME_ID = int32_t (*)(void *, int);
@@ -62,17 +63,21 @@ namespace lspd {
         if (!fw.isValid()) {
             return false;
         };
-        if (!(ResXMLParser_next = fw.getSymbAddress<TYPE_NEXT>(
-                "_ZN7android12ResXMLParser4nextEv"))) {
+        constexpr SandHook::ElfSymbol symbols[] = {
+                "_ZN7android12ResXMLParser4nextEv"_elf,
+                "_ZN7android12ResXMLParser7restartEv"_elf,
+                LP_SELECT("_ZNK7android12ResXMLParser18getAttributeNameIDEj"_elf,
+                          "_ZNK7android12ResXMLParser18getAttributeNameIDEm"_elf),
+        };
+        auto addresses = fw.getSymbAddresses(symbols);
+        if (!(ResXMLParser_next = reinterpret_cast<TYPE_NEXT>(addresses[0]))) {
             return false;
         }
-        if (!(ResXMLParser_restart = fw.getSymbAddress<TYPE_RESTART>(
-                "_ZN7android12ResXMLParser7restartEv"))) {
+        if (!(ResXMLParser_restart = reinterpret_cast<TYPE_RESTART>(addresses[1]))) {
             return false;
         };
-        if (!(ResXMLParser_getAttributeNameID = fw.getSymbAddress<TYPE_GET_ATTR_NAME_ID>(
-                LP_SELECT("_ZNK7android12ResXMLParser18getAttributeNameIDEj",
-                          "_ZNK7android12ResXMLParser18getAttributeNameIDEm")))) {
+        if (!(ResXMLParser_getAttributeNameID =
+                      reinterpret_cast<TYPE_GET_ATTR_NAME_ID>(addresses[2]))) {
             return false;
         }
         return android::ResStringPool::setup(InitInfo {
@@ -0,0 +1,204 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2021 LSPosed Contributors
+ */
+#include "proc_maps.h"
+
+#include <fcntl.h>
+#include <link.h>
+#include <sys/system_properties.h>
+#include <unistd.h>
+
+#include <mutex>
+
+#include "logging.h"
+
+namespace SandHook {
+    namespace {
+        struct MapLine {
+            uintptr_t start;
+            std::string_view perms;
+            std::string_view path;
+        };
+
+        // start-end perms offset dev inode [path]
+        // Like the sscanf this replaced, the path ends at the first whitespace, so a
+        // " (deleted)" suffix is not part of it
+        bool ParseLine(std::string_view line, MapLine &out) {
+            size_t i = 0;
+            uintptr_t start = 0;
+            for (; i < line.size(); ++i) {
+                char c = line[i];
+                if (c >= '0' && c <= '9') start = (start << 4) | (c - '0');
+                else if (c >= 'a' && c <= 'f') start = (start << 4) | (c - 'a' + 10);
+                else break;
+            }
+            if (i == 0 || i >= line.size() || line[i] != '-') return false;
+            auto skip_field = [&] {
+                while (i < line.size() && line[i] != ' ') ++i;
+                while (i < line.size() && line[i] == ' ') ++i;
+            };
+            skip_field();  // end
+            if (i + 4 > line.size()) return false;
+            out.perms = line.substr(i, 4);
+            skip_field();  // perms
+            skip_field();  // offset
+            skip_field();  // dev
+            skip_field();  // inode
+            out.start = start;
+            out.path = line.substr(i, line.find_first_of(" \t", i) - i);
+            return true;
+        }
+
+        struct Candidate {
+            bool done = false;
+            bool prev_readonly = false;
+            MapLine prev{};
+            MapLine first_exec{};
+        };
+
+        // reused across scans, the maps of an app are easily a megabyte
+        std::mutex buffer_lock;
+        std::string buffer;
+
+        bool ReadMaps(std::string &out) {
+            int fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                PLOGE("failed to open /proc/self/maps");
+                return false;
+            }
+            out.clear();
+            if (out.capacity() < 256 * 1024) out.reserve(256 * 1024);
+            size_t size = 0;
+            while (true) {
+                if (out.size() - size < 64 * 1024) out.resize(std::max(out.capacity(), size + 64 * 1024));
+                auto n = TEMP_FAILURE_RETRY(read(fd, out.data() + size, out.size() - size));
+                if (n <= 0) break;
+                size += n;
+            }
+            close(fd);
+            out.resize(size);
+            return true;
+        }
+    }  // namespace
+
+    std::vector<ModuleMapping> ScanModuleBases(std::string_view maps,
+                                               std::span<const std::string_view> names) {
+        std::vector<Candidate> candidates(names.size());
+        std::vector<ModuleMapping> res(names.size());
+        size_t remaining = names.size();
+
+        for (size_t pos = 0; pos < maps.size() && remaining > 0;) {
+            auto eol = maps.find('\n', pos);
+            if (eol == std::string_view::npos) eol = maps.size();
+            auto line = maps.substr(pos, eol - pos);
+            pos = eol + 1;
+
+            MapLine entry;
+            if (!ParseLine(line, entry) || entry.path.empty()) continue;
+            for (size_t n = 0; n < names.size(); ++n) {
+                auto &c = candidates[n];
+                if (c.done || entry.path.find(names[n]) == std::string_view::npos) continue;
+                bool exec = entry.perms == "r-xp";
+                if (exec && c.prev_readonly) {
+                    // `r--p` followed by `r-xp` is final
+                    res[n] = {c.prev.start, std::string(c.prev.path)};
+                    c.done = true;
+                    --remaining;
+                    continue;
+                }
+                if (exec && c.first_exec.start == 0) c.first_exec = entry;
+                c.prev_readonly = entry.perms == "r--p";
+                c.prev = entry;
+            }
+        }
+
+        for (size_t n = 0; n < names.size(); ++n) {
+            auto &c = candidates[n];
+            if (!c.done && c.first_exec.start != 0) {
+                res[n] = {c.first_exec.start, std::string(c.first_exec.path)};
+            }
+            if (res[n].valid()) {
+                LOGD("get module base {}: {:#x}", res[n].path, res[n].base);
+            } else {
+                LOGE("Could not determine a base address for {}", names[n]);
+            }
+        }
+        return res;
+    }
+
+    std::vector<ModuleMapping> ScanModuleBases(std::span<const std::string_view> names) {
+        std::lock_guard lk(buffer_lock);
+        if (!ReadMaps(buffer)) return std::vector<ModuleMapping>(names.size());
+        return ScanModuleBases(buffer, names);
+    }
+
+    // the maps scanner stays the default until dl_iterate_phdr has been measured on devices
+    static bool UseIteratePhdr() {
+        static const bool use = [] {
+            char value[PROP_VALUE_MAX]{};
+            __system_property_get("debug.lsposed.modbase", value);
+            return std::string_view(value) == "phdr";
+        }();
+        return use;
+    }
+
+    std::vector<ModuleMapping> IteratePhdrModuleBases(std::span<const std::string_view> names) {
+        std::vector<ModuleMapping> res(names.size());
+        struct Context {
+            std::span<const std::string_view> names;
+            std::vector<ModuleMapping> &res;
+        } context{names, res};
+        dl_iterate_phdr(
+            [](dl_phdr_info *info, size_t, void *data) -> int {
+                auto &[names, res] = *static_cast<Context *>(data);
+                if (info->dlpi_name == nullptr || info->dlpi_name[0] == '\0') return 0;
+                std::string_view path = info->dlpi_name;
+                size_t remaining = 0;
+                for (size_t n = 0; n < names.size(); ++n) {
+                    if (res[n].valid()) continue;
+                    if (path.find(names[n]) != std::string_view::npos) {
+                        res[n] = {static_cast<uintptr_t>(info->dlpi_addr), std::string(path), true};
+                        LOGD("get module bias {}: {:#x} by dl_iterate_phdr", path, res[n].base);
+                    } else {
+                        ++remaining;
+                    }
+                }
+                return remaining == 0;
+            },
+            &context);
+        return res;
+    }
+
+    std::vector<ModuleMapping> ResolveModuleBases(std::span<const std::string_view> names) {
+        auto res = UseIteratePhdr() ? IteratePhdrModuleBases(names)
+                                    : std::vector<ModuleMapping>(names.size());
+        std::vector<std::string_view> missing;
+        std::vector<size_t> missing_pos;
+        for (size_t n = 0; n < names.size(); ++n) {
+            if (res[n].valid()) continue;
+            missing.emplace_back(names[n]);
+            missing_pos.emplace_back(n);
+        }
+        if (missing.empty()) return res;
+        auto scanned = ScanModuleBases(missing);
+        for (size_t i = 0; i < missing.size(); ++i) {
+            res[missing_pos[i]] = std::move(scanned[i]);
+        }
+        return res;
+    }
+}  // namespace SandHook
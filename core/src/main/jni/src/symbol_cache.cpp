@@ -26,25 +26,62 @@
 #include "elf_util.h"
 #include "macros.h"
 #include "config.h"
+#include "trace.h"
+#include <mutex>
 #include <vector>
 #include <logging.h>
 
 namespace lspd {
+    static std::unique_ptr<const SandHook::SymbolIndex> kArtIndex = nullptr;
+    static bool kRecordArtSymbols = false;
+
+    // one maps scan serves all the libraries we are going to look into
+    static void PrefetchModuleBases() {
+        static std::once_flag kOnce;
+        std::call_once(kOnce, [] {
+            constexpr std::string_view names[] = {kLibArtName, kLibBinderName, kLinkerName,
+                                                  kLibFwName};
+            SandHook::ElfImg::PrefetchModuleBases(names);
+        });
+    }
+
+    void SetArtSymbolIndex(std::unique_ptr<const SandHook::SymbolIndex> index) {
+        kArtIndex = std::move(index);
+    }
+
+    void RecordArtSymbols() {
+        kRecordArtSymbols = true;
+    }
+
     std::unique_ptr<const SandHook::ElfImg> &GetArt(bool release) {
         static std::unique_ptr<const SandHook::ElfImg> kArtImg = nullptr;
         if (release) {
             kArtImg.reset();
+            kArtIndex.reset();
+            // startup is over once libart is released
+            trace::Dump();
         } else if (!kArtImg) {
-            kArtImg = std::make_unique<SandHook::ElfImg>(kLibArtName);
+            PrefetchModuleBases();
+            auto art = std::make_unique<SandHook::ElfImg>(kLibArtName, std::move(kArtIndex));
+            if (kRecordArtSymbols) art->RecordResolvedSymbols();
+            kArtImg = std::move(art);
         }
         return kArtImg;
     }
 
+    void ReleaseArtDebugData() {
+        if (auto &art = GetArt(); art) {
+            // kArtImg is always created non-const, it is only exposed as const to lookups
+            const_cast<SandHook::ElfImg *>(art.get())->ReleaseDebugData();
+        }
+    }
+
     std::unique_ptr<const SandHook::ElfImg> &GetLibBinder(bool release) {
         static std::unique_ptr<const SandHook::ElfImg> kImg = nullptr;
         if (release) {
             kImg.reset();
         } else if (!kImg) {
+            PrefetchModuleBases();
             kImg = std::make_unique<SandHook::ElfImg>(kLibBinderName);
         }
         return kImg;
@@ -55,6 +92,7 @@ namespace lspd {
         if (release) {
             kImg.reset();
         } else if (!kImg) {
+            PrefetchModuleBases();
             kImg = std::make_unique<SandHook::ElfImg>(kLinkerName);
         }
         return kImg;
@@ -0,0 +1,232 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2021 LSPosed Contributors
+ */
+#include "symbol_index.h"
+
+#include <link.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+
+#include "logging.h"
+
+using namespace SandHook;
+
+struct SymbolIndex::Header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t addr_size;
+    uint32_t hot_count;
+    uint32_t count;
+    uint32_t prefix_count;
+    uint32_t reserved;
+    uint64_t strings_size;
+    int64_t bias;
+    Key key;
+};
+
+struct SymbolIndex::Entry {
+    uint32_t gnu_hash;
+    uint32_t name_len;
+    uint32_t name_off;
+    uint32_t source;
+    uint64_t value;
+};
+
+static_assert(sizeof(SymbolIndex::Key) == 40);
+
+namespace {
+    constexpr uint32_t kMagic = 0x49534c4c;  // "LLSI"
+    constexpr uint16_t kVersion = 2;
+
+    bool WriteFully(int fd, const void *data, size_t size) {
+        auto *p = static_cast<const char *>(data);
+        while (size > 0) {
+            auto written = TEMP_FAILURE_RETRY(write(fd, p, size));
+            if (written <= 0) return false;
+            p += written;
+            size -= written;
+        }
+        return true;
+    }
+}  // namespace
+
+std::unique_ptr<const SymbolIndex> SymbolIndex::Open(int fd, size_t size) {
+    if (fd < 0 || size < sizeof(Header)) return nullptr;
+    auto *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        PLOGE("mmap symbol index");
+        return nullptr;
+    }
+    std::unique_ptr<SymbolIndex> index(new SymbolIndex(map, size));
+
+    auto *header = static_cast<const Header *>(map);
+    if (header->magic != kMagic || header->version != kVersion ||
+        header->addr_size != sizeof(ElfW(Addr))) {
+        LOGW("symbol index has mismatched format, ignoring");
+        return nullptr;
+    }
+    auto expected = sizeof(Header) + (uint64_t{header->hot_count} + header->count) * sizeof(Entry) +
+                    uint64_t{header->prefix_count} * sizeof(uint32_t) + header->strings_size;
+    if (expected != size) {
+        LOGW("symbol index has unexpected size {} vs {}, ignoring", size, expected);
+        return nullptr;
+    }
+
+    auto *hot = reinterpret_cast<const Entry *>(header + 1);
+    auto *entries = hot + header->hot_count;
+    auto *prefix = reinterpret_cast<const uint32_t *>(entries + header->count);
+    index->header_ = header;
+    index->hot_ = {hot, header->hot_count};
+    index->entries_ = {entries, header->count};
+    index->prefix_ = {prefix, header->prefix_count};
+    index->strings_ = reinterpret_cast<const char *>(prefix + header->prefix_count);
+
+    for (const auto &entry : std::span<const Entry>(hot, header->hot_count + header->count)) {
+        if (uint64_t{entry.name_off} + entry.name_len > header->strings_size) {
+            LOGW("symbol index has out of bound names, ignoring");
+            return nullptr;
+        }
+    }
+    for (auto i : index->prefix_) {
+        if (i >= header->count) {
+            LOGW("symbol index has out of bound prefix table, ignoring");
+            return nullptr;
+        }
+    }
+    LOGD("opened symbol index with {} symbols, {} hot", header->count, header->hot_count);
+    return index;
+}
+
+bool SymbolIndex::Write(int fd, const Key &key, off_t bias, std::vector<Symbol> &&symbols,
+                        std::vector<Symbol> &&hot) {
+    // keep the same precedence as ElfImg::getSymbOffset: dynsym before symtab
+    auto order = [](const auto &a, const auto &b) {
+        if (a.gnu_hash != b.gnu_hash) return a.gnu_hash < b.gnu_hash;
+        if (a.name != b.name) return a.name < b.name;
+        return a.source < b.source;
+    };
+    std::stable_sort(symbols.begin(), symbols.end(), order);
+    std::stable_sort(hot.begin(), hot.end(), order);
+    auto [dup_begin, dup_end] = std::ranges::unique(hot, [](const auto &a, const auto &b) {
+        return a.name == b.name && a.source == b.source;
+    });
+    hot.erase(dup_begin, dup_end);
+
+    std::string strings;
+    std::unordered_map<std::string_view, uint32_t> string_offsets;
+    auto to_entry = [&](const Symbol &symbol) -> Entry {
+        auto [it, inserted] =
+            string_offsets.try_emplace(symbol.name, static_cast<uint32_t>(strings.size()));
+        if (inserted) strings.append(symbol.name);
+        return {symbol.gnu_hash, static_cast<uint32_t>(symbol.name.size()), it->second,
+                symbol.source, symbol.value};
+    };
+    std::vector<Entry> hot_entries;
+    std::vector<Entry> entries;
+    std::vector<uint32_t> prefix;
+    hot_entries.reserve(hot.size());
+    entries.reserve(symbols.size());
+    for (const auto &symbol : hot) {
+        hot_entries.push_back(to_entry(symbol));
+    }
+    for (const auto &symbol : symbols) {
+        if (symbol.source == kSymtab) prefix.emplace_back(entries.size());
+        entries.push_back(to_entry(symbol));
+    }
+    std::stable_sort(prefix.begin(), prefix.end(), [&](auto a, auto b) {
+        return std::string_view(strings.data() + entries[a].name_off, entries[a].name_len) <
+               std::string_view(strings.data() + entries[b].name_off, entries[b].name_len);
+    });
+
+    Header header{
+        .magic = kMagic,
+        .version = kVersion,
+        .addr_size = sizeof(ElfW(Addr)),
+        .hot_count = static_cast<uint32_t>(hot_entries.size()),
+        .count = static_cast<uint32_t>(entries.size()),
+        .prefix_count = static_cast<uint32_t>(prefix.size()),
+        .reserved = 0,
+        .strings_size = strings.size(),
+        .bias = bias,
+        .key = key,
+    };
+    if (!WriteFully(fd, &header, sizeof(header)) ||
+        !WriteFully(fd, hot_entries.data(), hot_entries.size() * sizeof(Entry)) ||
+        !WriteFully(fd, entries.data(), entries.size() * sizeof(Entry)) ||
+        !WriteFully(fd, prefix.data(), prefix.size() * sizeof(uint32_t)) ||
+        !WriteFully(fd, strings.data(), strings.size())) {
+        PLOGE("write symbol index");
+        return false;
+    }
+    LOGD("wrote symbol index with {} symbols, {} hot, {} bytes of names", entries.size(),
+         hot_entries.size(), strings.size());
+    return true;
+}
+
+SymbolIndex::SymbolIndex(void *map, size_t size) : map_(map), size_(size) {}
+
+SymbolIndex::~SymbolIndex() {
+    if (map_) munmap(map_, size_);
+}
+
+bool SymbolIndex::Matches(const Key &key) const { return header_->key == key; }
+
+off_t SymbolIndex::bias() const { return static_cast<off_t>(header_->bias); }
+
+std::string_view SymbolIndex::NameOf(const Entry &entry) const {
+    return {strings_ + entry.name_off, entry.name_len};
+}
+
+const SymbolIndex::Entry *SymbolIndex::Find(std::span<const Entry> entries,
+                                            std::string_view name, uint32_t gnu_hash,
+                                            bool prefix) const {
+    auto i = std::ranges::lower_bound(entries, gnu_hash, {}, &Entry::gnu_hash);
+    for (; i != entries.end() && i->gnu_hash == gnu_hash; ++i) {
+        if ((i->source == kPrefix) == prefix && NameOf(*i) == name) return &*i;
+    }
+    return nullptr;
+}
+
+uint64_t SymbolIndex::Lookup(std::string_view name, uint32_t gnu_hash) const {
+    if (auto *entry = Find(hot_, name, gnu_hash, false)) return entry->value;
+    if (auto *entry = Find(entries_, name, gnu_hash, false)) return entry->value;
+    return 0;
+}
+
+std::vector<uint64_t> SymbolIndex::RangeLookup(std::string_view name, uint32_t gnu_hash) const {
+    std::vector<uint64_t> res;
+    auto i = std::ranges::lower_bound(entries_, gnu_hash, {}, &Entry::gnu_hash);
+    for (; i != entries_.end() && i->gnu_hash == gnu_hash; ++i) {
+        if (i->source == kSymtab && NameOf(*i) == name) res.emplace_back(i->value);
+    }
+    return res;
+}
+
+uint64_t SymbolIndex::PrefixLookupFirst(std::string_view prefix, uint32_t gnu_hash) const {
+    if (auto *entry = Find(hot_, prefix, gnu_hash, true)) return entry->value;
+    auto i = std::ranges::lower_bound(prefix_, prefix, {},
+                                      [this](auto idx) { return NameOf(entries_[idx]); });
+    if (i != prefix_.end() && NameOf(entries_[*i]).starts_with(prefix)) {
+        return entries_[*i].value;
+    }
+    return 0;
+}
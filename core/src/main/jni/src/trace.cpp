@@ -0,0 +1,135 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2021 LSPosed Contributors
+ */
+#include "trace.h"
+
+#include <sys/system_properties.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <string_view>
+
+#include "logging.h"
+
+namespace lspd::trace {
+    namespace {
+        constexpr auto kTag = "LSPosedTrace";
+        constexpr size_t kRingSize = 1024;
+
+        constexpr std::array<std::string_view, static_cast<size_t>(Event::kCount)> kEventNames = {
+            "ElfImg::ElfImg",
+            "ElfImg::findModuleBase",
+            "ElfImg::xzdecompress",
+            "ElfImg::MayInitLinearMap",
+            "lookup",
+            "batch lookup",
+            "index hit",
+            "gnu hash hit",
+            "elf hash hit",
+            "symtab hit",
+            "lookup miss",
+            "Context::InitArtHooker",
+            "Context::InitHooks",
+        };
+
+        // seq is 0 while a slot is written and `position + 1` once it is complete, so a
+        // reader can tell torn or overwritten slots apart without taking a lock
+        struct Slot {
+            std::atomic<uint64_t> seq;
+            std::atomic<uint64_t> start;
+            std::atomic<uint64_t> duration;
+            std::atomic<uint32_t> value;
+            std::atomic<uint16_t> event;
+        };
+
+        std::array<Slot, kRingSize> ring;
+        std::atomic<uint64_t> head{0};
+        std::mutex dump_lock;
+        uint64_t dumped = 0;
+    }  // namespace
+
+    bool Enabled() {
+        static const bool enabled = [] {
+            char value[PROP_VALUE_MAX]{};
+            __system_property_get("debug.lsposed.trace", value);
+            return value[0] == '1';
+        }();
+        return enabled;
+    }
+
+    uint64_t Now() {
+        timespec ts{};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    void Record(Event event, uint64_t start_ns, uint64_t duration_ns, uint32_t value) {
+        auto pos = head.fetch_add(1, std::memory_order_relaxed);
+        auto &slot = ring[pos % kRingSize];
+        slot.seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.start.store(start_ns, std::memory_order_relaxed);
+        slot.duration.store(duration_ns, std::memory_order_relaxed);
+        slot.value.store(value, std::memory_order_relaxed);
+        slot.event.store(static_cast<uint16_t>(event), std::memory_order_relaxed);
+        slot.seq.store(pos + 1, std::memory_order_release);
+    }
+
+    void Dump() {
+        if (!Enabled()) return;
+        std::lock_guard lk(dump_lock);
+        auto end = head.load(std::memory_order_acquire);
+        auto begin = std::max(dumped, end > kRingSize ? end - kRingSize : 0);
+        if (begin > dumped) {
+            LOG(ANDROID_LOG_WARN, kTag, "{} events dropped", begin - dumped);
+        }
+        std::array<uint64_t, kEventNames.size()> counts{}, totals{};
+        for (auto pos = begin; pos < end; ++pos) {
+            auto &slot = ring[pos % kRingSize];
+            if (slot.seq.load(std::memory_order_acquire) != pos + 1) continue;
+            auto start = slot.start.load(std::memory_order_relaxed);
+            auto duration = slot.duration.load(std::memory_order_relaxed);
+            auto value = slot.value.load(std::memory_order_relaxed);
+            auto event = slot.event.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) != pos + 1 || event >= kEventNames.size()) {
+                continue;
+            }
+            ++counts[event];
+            totals[event] += duration;
+            if (duration > 0) {
+                LOG(ANDROID_LOG_INFO, kTag, "{} at {}us took {}us value {}", kEventNames[event],
+                    start / 1000, duration / 1000, value);
+            }
+        }
+        for (size_t event = 0; event < kEventNames.size(); ++event) {
+            if (counts[event] == 0) continue;
+            if (totals[event] == 0) {
+                LOG(ANDROID_LOG_INFO, kTag, "pid {} {}: count {}", getpid(), kEventNames[event],
+                    counts[event]);
+            } else {
+                LOG(ANDROID_LOG_INFO, kTag, "pid {} {}: count {} total {}us", getpid(),
+                    kEventNames[event], counts[event], totals[event] / 1000);
+            }
+        }
+        dumped = end;
+    }
+}  // namespace lspd::trace
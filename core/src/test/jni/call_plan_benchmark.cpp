@@ -0,0 +1,133 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "jni/call_plan.h"
+#include "jvm.h"
+
+namespace {
+    constexpr auto kTarget = "org/lsposed/lspd/test/CallPlanTarget";
+
+    // A method of CallPlanTarget with the given number of parameters and boxed arguments
+    // for it, all global
+    struct Call {
+        jobject method;
+        jobject thiz;
+        jobjectArray args;
+    };
+
+    jobject Box(JNIEnv *env, const char *box, char shorty, jvalue value) {
+        auto clazz = env->FindClass(box);
+        auto signature = std::string("(") + shorty + ")L" + box + ";";
+        auto value_of = env->GetStaticMethodID(clazz, "valueOf", signature.c_str());
+        return env->CallStaticObjectMethodA(clazz, value_of, &value);
+    }
+
+    const Call &CallOf(JNIEnv *env, int arity) {
+        static std::vector<std::unique_ptr<Call>> calls(7);
+        auto &call = calls[arity];
+        if (call) return *call;
+
+        auto target = env->FindClass(kTarget);
+        auto thiz = env->NewObject(target, env->GetMethodID(target, "<init>", "()V"));
+        std::vector<jobject> args;
+        jobject method;
+        switch (arity) {
+            case 0:
+                method = lspd::test::ReflectedMethod(env, kTarget, "none", "()I", true);
+                break;
+            case 1:
+                method = lspd::test::ReflectedMethod(env, kTarget, "one", "(I)I", false);
+                args = {Box(env, "java/lang/Integer", 'I', {.i = 1})};
+                break;
+            case 3:
+                method = lspd::test::ReflectedMethod(env, kTarget, "three",
+                                                     "(IJLjava/lang/String;)J", false);
+                args = {Box(env, "java/lang/Integer", 'I', {.i = 1}),
+                        Box(env, "java/lang/Long", 'J', {.j = 2}), env->NewStringUTF("three")};
+                break;
+            default:
+                method = lspd::test::ReflectedMethod(env, kTarget, "six",
+                                                     "(ZBCSFD)Ljava/lang/String;", false);
+                args = {Box(env, "java/lang/Boolean", 'Z', {.z = JNI_TRUE}),
+                        Box(env, "java/lang/Byte", 'B', {.b = 1}),
+                        Box(env, "java/lang/Character", 'C', {.c = 'c'}),
+                        Box(env, "java/lang/Short", 'S', {.s = 2}),
+                        Box(env, "java/lang/Float", 'F', {.f = 3}),
+                        Box(env, "java/lang/Double", 'D', {.d = 4})};
+                break;
+        }
+        auto array = env->NewObjectArray(static_cast<jsize>(args.size()),
+                                         env->FindClass("java/lang/Object"), nullptr);
+        for (jsize i = 0; auto arg : args) env->SetObjectArrayElement(array, i++, arg);
+        call = std::make_unique<Call>(Call{
+                .method = env->NewGlobalRef(method),
+                .thiz = env->NewGlobalRef(thiz),
+                .args = static_cast<jobjectArray>(env->NewGlobalRef(array)),
+        });
+        return *call;
+    }
+
+    JNIEnv *Env() {
+        static JNIEnv *env = [] {
+            auto *env = lspd::test::StartJvm(false);
+            lspd::InitCallPlans(env);
+            return env;
+        }();
+        return env;
+    }
+
+    // The bridge calling the backup of a hooked method with the arguments it got, Arg is the
+    // number of parameters
+    void BM_CallPlanInvoke(benchmark::State &state) {
+        auto *env = Env();
+        auto &call = CallOf(env, static_cast<int>(state.range(0)));
+        auto plan = lspd::CallPlan::Create(env, call.method, call.method);
+        if (!plan) return state.SkipWithError("no plan");
+        for (auto _ : state) {
+            jobject result = nullptr;
+            if (!plan->Invoke(env, call.thiz, call.args, result) || env->ExceptionCheck()) {
+                return state.SkipWithError("the plan fell back");
+            }
+            env->DeleteLocalRef(result);
+        }
+    }
+
+    // What the bridge did before CallPlan, and still does when a plan falls back
+    void BM_MethodInvoke(benchmark::State &state) {
+        auto *env = Env();
+        auto &call = CallOf(env, static_cast<int>(state.range(0)));
+        auto method_class = env->FindClass("java/lang/reflect/Method");
+        auto invoke = env->GetMethodID(method_class, "invoke",
+                                       "(Ljava/lang/Object;[Ljava/lang/Object;)Ljava/lang/Object;");
+        for (auto _ : state) {
+            auto result = env->CallObjectMethod(call.method, invoke, call.thiz, call.args);
+            if (env->ExceptionCheck()) return state.SkipWithError("Method.invoke threw");
+            env->DeleteLocalRef(result);
+        }
+        env->DeleteLocalRef(method_class);
+    }
+}  // namespace
+
+BENCHMARK(BM_CallPlanInvoke)->Arg(0)->Arg(1)->Arg(3)->Arg(6);
+BENCHMARK(BM_MethodInvoke)->Arg(0)->Arg(1)->Arg(3)->Arg(6);
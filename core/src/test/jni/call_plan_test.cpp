@@ -0,0 +1,217 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+
+#include <gtest/gtest.h>
+
+#include <initializer_list>
+#include <string>
+
+#include "jni/call_plan.h"
+#include "jvm.h"
+
+namespace {
+    constexpr auto kTarget = "org/lsposed/lspd/test/CallPlanTarget";
+
+    class CallPlanTest : public testing::Test {
+    protected:
+        static void SetUpTestSuite() {
+            env = lspd::test::StartJvm(true);
+            static bool initialized = [] {
+                lspd::InitCallPlans(env);
+                return true;
+            }();
+            (void) initialized;
+        }
+
+        void SetUp() override {
+            ASSERT_EQ(env->PushLocalFrame(256), JNI_OK);
+            auto method = env->FindClass("java/lang/reflect/Method");
+            invoke = env->GetMethodID(method, "invoke",
+                                      "(Ljava/lang/Object;[Ljava/lang/Object;)Ljava/lang/Object;");
+            auto target = env->FindClass(kTarget);
+            receiver = env->NewObject(target, env->GetMethodID(target, "<init>", "()V"));
+            ASSERT_NE(receiver, nullptr);
+        }
+
+        void TearDown() override {
+            EXPECT_FALSE(env->ExceptionCheck());
+            env->ExceptionClear();
+            env->PopLocalFrame(nullptr);
+        }
+
+        static jobject Method(const char *name, const char *signature, bool is_static = false) {
+            auto method = lspd::test::ReflectedMethod(env, kTarget, name, signature, is_static);
+            EXPECT_NE(method, nullptr) << name;
+            return method;
+        }
+
+        static jobject Box(const char *box, char shorty, jvalue value) {
+            auto clazz = env->FindClass(box);
+            auto signature = std::string("(") + shorty + ")L" + box + ";";
+            auto value_of = env->GetStaticMethodID(clazz, "valueOf", signature.c_str());
+            return env->CallStaticObjectMethodA(clazz, value_of, &value);
+        }
+
+        static jobject Int(jint i) { return Box("java/lang/Integer", 'I', {.i = i}); }
+
+        static jobject Long(jlong j) { return Box("java/lang/Long", 'J', {.j = j}); }
+
+        static jobjectArray Args(std::initializer_list<jobject> args) {
+            auto array = env->NewObjectArray(static_cast<jsize>(args.size()),
+                                             env->FindClass("java/lang/Object"), nullptr);
+            for (jsize i = 0; auto arg : args) env->SetObjectArrayElement(array, i++, arg);
+            return array;
+        }
+
+        static bool Equals(jobject a, jobject b) {
+            auto objects = env->FindClass("java/util/Objects");
+            auto equals = env->GetStaticMethodID(objects, "equals",
+                                                 "(Ljava/lang/Object;Ljava/lang/Object;)Z");
+            return env->CallStaticBooleanMethod(objects, equals, a, b);
+        }
+
+        static std::string Describe(jobject object) {
+            if (!object) return "null";
+            auto string = env->FindClass("java/lang/String");
+            auto value_of = env->GetStaticMethodID(string, "valueOf",
+                                                   "(Ljava/lang/Object;)Ljava/lang/String;");
+            auto str = static_cast<jstring>(env->CallStaticObjectMethod(string, value_of, object));
+            auto *chars = env->GetStringUTFChars(str, nullptr);
+            std::string res(chars);
+            env->ReleaseStringUTFChars(str, chars);
+            return res;
+        }
+
+        static jthrowable TakeException() {
+            auto exception = env->ExceptionOccurred();
+            env->ExceptionClear();
+            return exception;
+        }
+
+        static jobject CauseOf(jthrowable exception) {
+            auto throwable = env->FindClass("java/lang/Throwable");
+            return env->CallObjectMethod(
+                    exception, env->GetMethodID(throwable, "getCause", "()Ljava/lang/Throwable;"));
+        }
+
+        // Calls method through its plan and through Method.invoke, which have to agree on
+        // the result or the exception
+        void ExpectSameAsInvoke(jobject method, jobject thiz, jobjectArray args) {
+            auto plan = lspd::CallPlan::Create(env, method, method);
+            ASSERT_NE(plan, nullptr);
+            jobject result = nullptr;
+            ASSERT_TRUE(plan->Invoke(env, thiz, args, result));
+            auto exception = TakeException();
+            auto expected = env->CallObjectMethod(method, invoke, thiz, args);
+            auto expected_exception = TakeException();
+
+            EXPECT_TRUE(Equals(result, expected)) << Describe(result) << " vs " << Describe(expected);
+            ASSERT_EQ(exception == nullptr, expected_exception == nullptr);
+            if (exception) {
+                EXPECT_TRUE(env->IsSameObject(env->GetObjectClass(exception),
+                                              env->GetObjectClass(expected_exception)));
+                EXPECT_EQ(Describe(CauseOf(exception)), Describe(CauseOf(expected_exception)));
+            }
+        }
+
+        // Invoke has to leave the call to Method.invoke without calling anything
+        void ExpectFallback(jobject method, jobject thiz, jobjectArray args) {
+            auto plan = lspd::CallPlan::Create(env, method, method);
+            ASSERT_NE(plan, nullptr);
+            jobject result = nullptr;
+            EXPECT_FALSE(plan->Invoke(env, thiz, args, result));
+            EXPECT_FALSE(env->ExceptionCheck());
+        }
+
+        inline static JNIEnv *env = nullptr;
+        jmethodID invoke = nullptr;
+        jobject receiver = nullptr;
+    };
+}  // namespace
+
+TEST_F(CallPlanTest, MatchesMethodInvoke) {
+    ExpectSameAsInvoke(Method("none", "()I", true), nullptr, nullptr);
+    ExpectSameAsInvoke(Method("none", "()I", true), nullptr, Args({}));
+    ExpectSameAsInvoke(Method("one", "(I)I"), receiver, Args({Int(41)}));
+    ExpectSameAsInvoke(Method("three", "(IJLjava/lang/String;)J"), receiver,
+                       Args({Int(1), Long(1L << 40), env->NewStringUTF("abc")}));
+    ExpectSameAsInvoke(Method("six", "(ZBCSFD)Ljava/lang/String;"), receiver,
+                       Args({Box("java/lang/Boolean", 'Z', {.z = JNI_TRUE}),
+                             Box("java/lang/Byte", 'B', {.b = -3}),
+                             Box("java/lang/Character", 'C', {.c = u'é'}),
+                             Box("java/lang/Short", 'S', {.s = -300}),
+                             Box("java/lang/Float", 'F', {.f = 1.5f}),
+                             Box("java/lang/Double", 'D', {.d = -2.25})}));
+    auto objects = Method("objects", "(Ljava/lang/Object;Ljava/lang/CharSequence;)Ljava/lang/Object;",
+                          true);
+    ExpectSameAsInvoke(objects, nullptr, Args({nullptr, env->NewStringUTF("b")}));
+    ExpectSameAsInvoke(objects, nullptr, Args({Int(1), nullptr}));
+    ExpectSameAsInvoke(Method("nothing", "()V"), receiver, Args({}));
+    ExpectSameAsInvoke(Method("widen", "(JD)D"), receiver,
+                       Args({Long(3), Box("java/lang/Double", 'D', {.d = 0.5})}));
+}
+
+TEST_F(CallPlanTest, WrapsExceptionsLikeMethodInvoke) {
+    ExpectSameAsInvoke(Method("fail", "(I)I"), receiver, Args({Int(7)}));
+}
+
+TEST_F(CallPlanTest, AcceptsSubclassReceiver) {
+    auto sub = env->FindClass("org/lsposed/lspd/test/CallPlanTarget$Sub");
+    auto thiz = env->NewObject(sub, env->GetMethodID(sub, "<init>", "()V"));
+    ExpectSameAsInvoke(Method("one", "(I)I"), thiz, Args({Int(1)}));
+}
+
+TEST_F(CallPlanTest, FallsBackForBoxOfAnotherType) {
+    // Method.invoke widens these, the plan only takes the exact box
+    ExpectFallback(Method("one", "(I)I"), receiver,
+                   Args({Box("java/lang/Short", 'S', {.s = 1})}));
+    ExpectFallback(Method("widen", "(JD)D"), receiver, Args({Int(3), Int(4)}));
+    ExpectFallback(Method("one", "(I)I"), receiver, Args({Long(1)}));
+}
+
+TEST_F(CallPlanTest, FallsBackForNullPrimitive) {
+    ExpectFallback(Method("one", "(I)I"), receiver, Args({nullptr}));
+}
+
+TEST_F(CallPlanTest, FallsBackForReferenceOfAnotherType) {
+    auto objects = Method("objects", "(Ljava/lang/Object;Ljava/lang/CharSequence;)Ljava/lang/Object;",
+                          true);
+    ExpectFallback(objects, nullptr, Args({nullptr, Int(1)}));
+}
+
+TEST_F(CallPlanTest, FallsBackForMismatchedReceiver) {
+    auto one = Method("one", "(I)I");
+    ExpectFallback(one, env->NewStringUTF("not a target"), Args({Int(1)}));
+    ExpectFallback(one, nullptr, Args({Int(1)}));
+}
+
+TEST_F(CallPlanTest, FallsBackForWrongArgumentCount) {
+    auto one = Method("one", "(I)I");
+    ExpectFallback(one, receiver, Args({}));
+    ExpectFallback(one, receiver, Args({Int(1), Int(2)}));
+    ExpectFallback(one, receiver, nullptr);
+}
+
+TEST_F(CallPlanTest, FallsBackForMoreThanMaxArgs) {
+    auto many = Method("many", "(IIIIIIIIIIIIIIIII)I", true);
+    ASSERT_GT(17u, lspd::CallPlan::kMaxArgs);
+    auto args = Args({Int(0), Int(1), Int(2), Int(3), Int(4), Int(5), Int(6), Int(7), Int(8),
+                      Int(9), Int(10), Int(11), Int(12), Int(13), Int(14), Int(15), Int(16)});
+    ExpectFallback(many, nullptr, args);
+}
@@ -0,0 +1,68 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "dex_corpus.h"
+#include "jni/dex_body.h"
+#include "legacy_dex_body.h"
+
+namespace {
+    const std::vector<const dex::Code *> &CorpusCodeItems() {
+        static const auto codes = [] {
+            std::vector<const dex::Code *> codes;
+            for (auto &dex : lspd::test::DexCorpus::Get().dexes()) {
+                if (!dex.image) continue;
+                auto items = lspd::test::CodeItems(dex);
+                codes.insert(codes.end(), items.begin(), items.end());
+            }
+            return codes;
+        }();
+        return codes;
+    }
+
+    // One iteration decodes every method of the corpus, as BuildXrefIndex does
+    void BM_DecodeMethodBody(benchmark::State &state) {
+        auto &codes = CorpusCodeItems();
+        if (codes.empty()) return state.SkipWithError("LSPD_TEST_DEX is not set");
+        lspd::MethodBody body{};
+        for (auto _ : state) {
+            for (auto *code : codes) {
+                lspd::DecodeMethodBody(code, body);
+                benchmark::DoNotOptimize(body.opcodes.data());
+            }
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * codes.size()));
+    }
+
+    void BM_LegacyDecodeMethodBody(benchmark::State &state) {
+        auto &codes = CorpusCodeItems();
+        if (codes.empty()) return state.SkipWithError("LSPD_TEST_DEX is not set");
+        for (auto _ : state) {
+            for (auto *code : codes) {
+                auto body = lspd::test::LegacyDecodeMethodBody(code);
+                benchmark::DoNotOptimize(body.opcodes.data());
+            }
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * codes.size()));
+    }
+}  // namespace
+
+BENCHMARK(BM_DecodeMethodBody)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LegacyDecodeMethodBody)->Unit(benchmark::kMillisecond);
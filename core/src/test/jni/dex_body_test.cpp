@@ -0,0 +1,193 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "dex_corpus.h"
+#include "jni/dex_body.h"
+#include "legacy_dex_body.h"
+
+using lspd::MethodBody;
+using lspd::test::LegacyDecodeMethodBody;
+
+namespace {
+    void ExpectSameBody(const dex::Code *code) {
+        auto expected = LegacyDecodeMethodBody(code);
+        MethodBody body{};
+        lspd::DecodeMethodBody(code, body);
+        EXPECT_TRUE(body.loaded);
+        EXPECT_EQ(body.referred_strings, expected.referred_strings);
+        EXPECT_EQ(body.accessed_fields, expected.accessed_fields);
+        EXPECT_EQ(body.assigned_fields, expected.assigned_fields);
+        EXPECT_EQ(body.invoked_methods, expected.invoked_methods);
+        EXPECT_EQ(body.opcodes, expected.opcodes);
+    }
+
+    // A code item in u2 units, 4-byte aligned like in a dex
+    class CodeBuilder {
+    public:
+        CodeBuilder() : units_(kHeaderUnits) {}
+
+        CodeBuilder &Add(std::initializer_list<dex::u2> units) {
+            units_.insert(units_.end(), units);
+            return *this;
+        }
+
+        CodeBuilder &Add32(dex::u4 value) {
+            return Add({static_cast<dex::u2>(value), static_cast<dex::u2>(value >> 16)});
+        }
+
+        const dex::Code *Build() {
+            auto insns_size = static_cast<dex::u4>(units_.size() - kHeaderUnits);
+            storage_.assign((units_.size() + 1) / 2, 0);
+            std::memcpy(storage_.data(), units_.data(), units_.size() * sizeof(dex::u2));
+            auto *code = reinterpret_cast<dex::Code *>(storage_.data());
+            code->insns_size = insns_size;
+            return code;
+        }
+
+    private:
+        static constexpr size_t kHeaderUnits = offsetof(dex::Code, insns) / sizeof(dex::u2);
+
+        std::vector<dex::u2> units_;
+        std::vector<dex::u4> storage_;
+    };
+}  // namespace
+
+TEST(DexBodyTest, CollectsIdsSortedAndUnique) {
+    CodeBuilder builder;
+    builder.Add({0x001a, 7})                    // const-string v0, string@7
+            .Add({0x001b}).Add32(0x12345)       // const-string/jumbo v0, string@0x12345
+            .Add({0x001a, 7})                   // const-string v0, string@7
+            .Add({0x1052, 3})                   // iget v0, v1, field@3
+            .Add({0x0060, 1})                   // sget v0, field@1
+            .Add({0x1059, 3})                   // iput v0, v1, field@3
+            .Add({0x0067, 2})                   // sput v0, field@2
+            .Add({0x206e, 9, 0x0010})           // invoke-virtual {v0, v1}, method@9
+            .Add({0x0277, 4, 0x0000})           // invoke-static/range {v0, v1}, method@4
+            .Add({0x106e, 4, 0x0000})           // invoke-virtual {v0}, method@4
+            .Add({0x000e});                     // return-void
+    auto *code = builder.Build();
+    ExpectSameBody(code);
+
+    MethodBody body{};
+    lspd::DecodeMethodBody(code, body);
+    EXPECT_EQ(body.referred_strings, (std::vector<int32_t>{7, 0x12345}));
+    EXPECT_EQ(body.accessed_fields, (std::vector<int32_t>{1, 3}));
+    EXPECT_EQ(body.assigned_fields, (std::vector<int32_t>{2, 3}));
+    EXPECT_EQ(body.invoked_methods, (std::vector<int32_t>{4, 9}));
+    EXPECT_EQ(body.opcodes.size(), 11u);
+}
+
+TEST(DexBodyTest, SkipsPayloads) {
+    CodeBuilder builder;
+    builder.Add({0x0000})                               // nop
+            .Add({0x002b}).Add32(6)                     // packed-switch v0, +6
+            .Add({0x000e})                              // return-void
+            .Add({0x0100, 2}).Add32(0)                  // packed-switch-payload, 2 targets
+            .Add32(0x001a).Add32(0x206e)
+            .Add({0x0200, 1}).Add32(0x001a).Add32(0x0060)  // sparse-switch-payload, 1 key
+            .Add({0x0300, 2}).Add32(3)                  // fill-array-data-payload, 3 shorts
+            .Add({0x001a, 0x0052, 0x106e})
+            .Add({0x0300, 1}).Add32(3)                  // fill-array-data-payload, 3 bytes
+            .Add({0x001a, 0x0052})
+            .Add({0x001a, 5});                          // const-string v0, string@5
+    auto *code = builder.Build();
+    ExpectSameBody(code);
+
+    MethodBody body{};
+    lspd::DecodeMethodBody(code, body);
+    EXPECT_EQ(body.referred_strings, (std::vector<int32_t>{5}));
+    EXPECT_TRUE(body.accessed_fields.empty());
+    EXPECT_TRUE(body.invoked_methods.empty());
+    EXPECT_EQ(body.opcodes, (std::vector<int8_t>{0x00, 0x2b, 0x0e, 0x00, 0x00, 0x00, 0x00, 0x1a}));
+}
+
+TEST(DexBodyTest, MatchesLegacyDecoderOnRandomCode) {
+    // opcodes whose operands the scan reads, and some it only steps over
+    constexpr dex::u1 kOpcodes[] = {
+            0x01, 0x0e, 0x13, 0x18, 0x1a, 0x1b, 0x28, 0x2b, 0x52, 0x55, 0x58, 0x59, 0x5f, 0x60,
+            0x66, 0x67, 0x6d, 0x6e, 0x71, 0x72, 0x74, 0x77, 0x78, 0x90, 0xd8,
+    };
+    std::mt19937 rng(0x15a05ed);
+    std::uniform_int_distribution<dex::u4> unit(0, 0xffff);
+    for (int round = 0; round < 1000; ++round) {
+        CodeBuilder builder;
+        for (int i = 0, count = 1 + round % 64; i < count; ++i) {
+            switch (rng() % 8) {
+                case 0: {
+                    dex::u2 size = rng() % 8;
+                    builder.Add({0x0100, size}).Add32(unit(rng));
+                    for (int j = 0; j < size * 2; ++j) {
+                        builder.Add({static_cast<dex::u2>(unit(rng))});
+                    }
+                    break;
+                }
+                case 1: {
+                    dex::u2 size = rng() % 8;
+                    builder.Add({0x0200, size});
+                    for (int j = 0; j < size * 4; ++j) {
+                        builder.Add({static_cast<dex::u2>(unit(rng))});
+                    }
+                    break;
+                }
+                case 2: {
+                    dex::u2 width = 1 << rng() % 4;
+                    dex::u4 size = rng() % 16;
+                    builder.Add({0x0300, width}).Add32(size);
+                    for (dex::u4 j = 0; j < (size * width + 1) / 2; ++j) {
+                        builder.Add({static_cast<dex::u2>(unit(rng))});
+                    }
+                    break;
+                }
+                default: {
+                    auto opcode = kOpcodes[rng() % std::size(kOpcodes)];
+                    builder.Add({static_cast<dex::u2>(unit(rng) << 8 | opcode)});
+                    for (int j = 1; j < dex::opcode_len[opcode]; ++j) {
+                        builder.Add({static_cast<dex::u2>(unit(rng))});
+                    }
+                    break;
+                }
+            }
+        }
+        ExpectSameBody(builder.Build());
+        if (HasFailure()) return;
+    }
+}
+
+TEST(DexBodyTest, MatchesLegacyDecoderOnDexFiles) {
+    auto &corpus = lspd::test::DexCorpus::Get();
+    if (corpus.empty()) GTEST_SKIP() << "LSPD_TEST_DEX is not set";
+    size_t methods = 0;
+    for (auto &dex : corpus.dexes()) {
+        SCOPED_TRACE(dex.path);
+        ASSERT_NE(dex.image, nullptr);
+        for (auto *code : lspd::test::CodeItems(dex)) {
+            ExpectSameBody(code);
+            if (HasFailure()) return;
+            ++methods;
+        }
+    }
+    EXPECT_GT(methods, 0u);
+}
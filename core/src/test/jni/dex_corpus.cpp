@@ -0,0 +1,90 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+
+#include "dex_corpus.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace lspd::test {
+    const DexCorpus &DexCorpus::Get() {
+        static const DexCorpus corpus;
+        return corpus;
+    }
+
+    DexCorpus::DexCorpus() {
+        auto *paths = getenv("LSPD_TEST_DEX");
+        if (!paths) return;
+        std::string list(paths);
+        for (size_t begin = 0, end; begin < list.size(); begin = end + 1) {
+            end = std::min(list.find(':', begin), list.size());
+            if (end == begin) continue;
+            auto &dex = dexes_.emplace_back(Dex{.path = list.substr(begin, end - begin)});
+            int fd = open(dex.path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) continue;
+            struct stat st{};
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                auto *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (map != MAP_FAILED) {
+                    dex.image = static_cast<const dex::u1 *>(map);
+                    dex.size = static_cast<size_t>(st.st_size);
+                }
+            }
+            close(fd);
+        }
+    }
+
+    DexCorpus::~DexCorpus() {
+        for (auto &dex : dexes_) {
+            if (dex.image) munmap(const_cast<dex::u1 *>(dex.image), dex.size);
+        }
+    }
+
+    std::vector<const dex::Code *> CodeItems(const DexCorpus::Dex &dex) {
+        std::vector<const dex::Code *> codes;
+        auto *image = dex.image;
+        auto *header = reinterpret_cast<const dex::Header *>(image);
+        auto *class_defs = reinterpret_cast<const dex::ClassDef *>(image + header->class_defs_off);
+        for (dex::u4 i = 0; i < header->class_defs_size; ++i) {
+            if (!class_defs[i].class_data_off) continue;
+            const dex::u1 *data = image + class_defs[i].class_data_off;
+            auto static_fields = dex::ReadULeb128(&data);
+            auto instance_fields = dex::ReadULeb128(&data);
+            auto direct_methods = dex::ReadULeb128(&data);
+            auto virtual_methods = dex::ReadULeb128(&data);
+            for (dex::u4 j = 0; j < static_fields + instance_fields; ++j) {
+                dex::ReadULeb128(&data);
+                dex::ReadULeb128(&data);
+            }
+            for (dex::u4 j = 0; j < direct_methods + virtual_methods; ++j) {
+                dex::ReadULeb128(&data);
+                dex::ReadULeb128(&data);
+                if (auto code_off = dex::ReadULeb128(&data)) {
+                    codes.push_back(reinterpret_cast<const dex::Code *>(image + code_off));
+                }
+            }
+        }
+        return codes;
+    }
+}  // namespace lspd::test
@@ -0,0 +1,54 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "slicer/reader.h"
+
+namespace lspd::test {
+    // The dex files listed in LSPD_TEST_DEX, colon separated, mapped read-only for the whole
+    // run. Tests and benchmarks that need real code skip when it is not set.
+    class DexCorpus {
+    public:
+        struct Dex {
+            std::string path;
+            // null if the file could not be mapped
+            const dex::u1 *image = nullptr;
+            size_t size = 0;
+        };
+
+        static const DexCorpus &Get();
+
+        bool empty() const { return dexes_.empty(); }
+
+        const std::vector<Dex> &dexes() const { return dexes_; }
+
+        ~DexCorpus();
+
+    private:
+        DexCorpus();
+
+        std::vector<Dex> dexes_;
+    };
+
+    // Every code item of dex, in class_data order
+    std::vector<const dex::Code *> CodeItems(const DexCorpus::Dex &dex);
+}  // namespace lspd::test
@@ -0,0 +1,127 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+#include <benchmark/benchmark.h>
+#include <malloc.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "dex_corpus.h"
+#include "jni/dex_file.h"
+#include "legacy_class_data.h"
+
+namespace {
+    // every operator new of the benchmark binary, for the allocation counts below
+    std::atomic_size_t allocations = 0;
+}  // namespace
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+namespace {
+    // Opens every dex of LSPD_TEST_DEX on the calling thread with parse and reports, per
+    // dex, the heap it keeps and the allocations it takes
+    template<typename Parse>
+    void ParseCorpus(benchmark::State &state, Parse &&parse) {
+        auto &corpus = lspd::test::DexCorpus::Get();
+        if (corpus.empty()) return state.SkipWithError("LSPD_TEST_DEX is not set");
+        size_t heap = 0;
+        size_t allocated = 0;
+        size_t dexes = 0;
+        for (auto _ : state) {
+            for (auto &dex : corpus.dexes()) {
+                if (!dex.image) continue;
+                state.PauseTiming();
+                auto before = mallinfo2().uordblks;
+                auto allocations_before = allocations.load(std::memory_order_relaxed);
+                state.ResumeTiming();
+                auto parsed = parse(dex);
+                benchmark::DoNotOptimize(parsed);
+                state.PauseTiming();
+                heap += mallinfo2().uordblks - before;
+                allocated += allocations.load(std::memory_order_relaxed) - allocations_before;
+                ++dexes;
+                parsed.reset();
+                state.ResumeTiming();
+            }
+        }
+        state.counters["heap_per_dex"] = benchmark::Counter(
+                static_cast<double>(heap) / static_cast<double>(dexes),
+                benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+        state.counters["allocs_per_dex"] = static_cast<double>(allocated) / static_cast<double>(dexes);
+        state.SetItemsProcessed(static_cast<int64_t>(dexes));
+    }
+
+    // The class data of the dex-wide arrays, what opening a dex without annotations costs
+    void BM_ParseClassData(benchmark::State &state) {
+        ParseCorpus(state, [](const lspd::test::DexCorpus::Dex &dex) {
+            auto parser = std::make_unique<lspd::DexParser>(dex.image, dex.size);
+            parser->Parse(false);
+            return parser;
+        });
+    }
+
+    // The same with the vectors every class had before
+    void BM_LegacyParseClassData(benchmark::State &state) {
+        ParseCorpus(state, [](const lspd::test::DexCorpus::Dex &dex) {
+            auto parser = std::make_unique<lspd::DexParser>(dex.image, dex.size);
+            auto class_data = std::make_unique<std::vector<lspd::test::LegacyClassData>>(
+                    lspd::test::LegacyParseClassData(*parser));
+            return std::make_unique<std::pair<decltype(parser), decltype(class_data)>>(
+                    std::move(parser), std::move(class_data));
+        });
+    }
+
+    // One iteration opens every dex of LSPD_TEST_DEX as openDexes does for an apk, Arg is the
+    // most workers ParseDexes may use. Wall time, as that is what the app waits for.
+    void BM_ParseDexes(benchmark::State &state) {
+        auto &corpus = lspd::test::DexCorpus::Get();
+        if (corpus.empty()) return state.SkipWithError("LSPD_TEST_DEX is not set");
+        auto workers = static_cast<size_t>(state.range(0));
+        for (auto _ : state) {
+            std::vector<std::unique_ptr<lspd::DexParser>> owned;
+            std::vector<lspd::DexParser *> parsers;
+            for (auto &dex : corpus.dexes()) {
+                if (!dex.image) continue;
+                owned.push_back(std::make_unique<lspd::DexParser>(dex.image, dex.size));
+                parsers.push_back(owned.back().get());
+            }
+            auto loaded = lspd::ParseDexes(parsers, {}, false, workers);
+            benchmark::DoNotOptimize(loaded.data());
+            state.PauseTiming();
+            owned.clear();
+            state.ResumeTiming();
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * corpus.dexes().size()));
+    }
+}  // namespace
+
+BENCHMARK(BM_ParseClassData)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LegacyParseClassData)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ParseDexes)->Arg(1)->Arg(2)->Arg(4)->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -0,0 +1,145 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+#include <gtest/gtest.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "dex_corpus.h"
+#include "jni/dex_file.h"
+#include "legacy_class_data.h"
+
+using lspd::DexParser;
+
+namespace {
+    std::vector<std::unique_ptr<DexParser>> OpenCorpus() {
+        std::vector<std::unique_ptr<DexParser>> parsers;
+        for (auto &dex : lspd::test::DexCorpus::Get().dexes()) {
+            if (dex.image) parsers.push_back(std::make_unique<DexParser>(dex.image, dex.size));
+        }
+        return parsers;
+    }
+
+    std::vector<DexParser *> Pointers(const std::vector<std::unique_ptr<DexParser>> &parsers) {
+        std::vector<DexParser *> res;
+        for (auto &parser : parsers) res.push_back(parser.get());
+        return res;
+    }
+
+    // What Java sees of a class, with the spans compared by value
+    void ExpectSameClasses(const DexParser &a, const DexParser &b) {
+        ASSERT_EQ(a.class_data.size(), b.class_data.size());
+        auto same = [](auto x, auto y) { return std::ranges::equal(x, y); };
+        for (size_t i = 0; i < a.class_data.size(); ++i) {
+            auto &x = a.class_data[i];
+            auto &y = b.class_data[i];
+            EXPECT_TRUE(same(x.interfaces, y.interfaces)) << i;
+            EXPECT_TRUE(same(x.static_fields, y.static_fields)) << i;
+            EXPECT_TRUE(same(x.static_fields_access_flags, y.static_fields_access_flags)) << i;
+            EXPECT_TRUE(same(x.instance_fields, y.instance_fields)) << i;
+            EXPECT_TRUE(same(x.instance_fields_access_flags, y.instance_fields_access_flags)) << i;
+            EXPECT_TRUE(same(x.direct_methods, y.direct_methods)) << i;
+            EXPECT_TRUE(same(x.direct_methods_access_flags, y.direct_methods_access_flags)) << i;
+            EXPECT_TRUE(same(x.direct_methods_code, y.direct_methods_code)) << i;
+            EXPECT_TRUE(same(x.virtual_methods, y.virtual_methods)) << i;
+            EXPECT_TRUE(same(x.virtual_methods_access_flags, y.virtual_methods_access_flags)) << i;
+            EXPECT_TRUE(same(x.virtual_methods_code, y.virtual_methods_code)) << i;
+        }
+    }
+}  // namespace
+
+TEST(DexFileTest, MatchesLegacyClassData) {
+    if (lspd::test::DexCorpus::Get().empty()) GTEST_SKIP() << "LSPD_TEST_DEX is not set";
+    auto parsers = OpenCorpus();
+    lspd::ParseDexes(Pointers(parsers), {}, false);
+    for (auto &parser : parsers) {
+        auto expected = lspd::test::LegacyParseClassData(*parser);
+        ASSERT_EQ(parser->class_data.size(), expected.size());
+        auto same = [](auto x, auto &y) { return std::ranges::equal(x, y); };
+        for (size_t i = 0; i < expected.size(); ++i) {
+            auto &x = parser->class_data[i];
+            auto &y = expected[i];
+            EXPECT_TRUE(same(x.interfaces, y.interfaces)) << i;
+            EXPECT_TRUE(same(x.static_fields, y.static_fields)) << i;
+            EXPECT_TRUE(same(x.static_fields_access_flags, y.static_fields_access_flags)) << i;
+            EXPECT_TRUE(same(x.instance_fields, y.instance_fields)) << i;
+            EXPECT_TRUE(same(x.instance_fields_access_flags, y.instance_fields_access_flags)) << i;
+            EXPECT_TRUE(same(x.direct_methods, y.direct_methods)) << i;
+            EXPECT_TRUE(same(x.direct_methods_access_flags, y.direct_methods_access_flags)) << i;
+            EXPECT_TRUE(same(x.direct_methods_code, y.direct_methods_code)) << i;
+            EXPECT_TRUE(same(x.virtual_methods, y.virtual_methods)) << i;
+            EXPECT_TRUE(same(x.virtual_methods_access_flags, y.virtual_methods_access_flags)) << i;
+            EXPECT_TRUE(same(x.virtual_methods_code, y.virtual_methods_code)) << i;
+        }
+    }
+}
+
+TEST(DexFileTest, ParsesTheSameOnAnyWorkerCount) {
+    if (lspd::test::DexCorpus::Get().empty()) GTEST_SKIP() << "LSPD_TEST_DEX is not set";
+    auto serial = OpenCorpus();
+    auto parallel = OpenCorpus();
+    auto loaded = lspd::ParseDexes(Pointers(serial), {}, false, 1);
+    EXPECT_EQ(loaded, std::vector<jboolean>(serial.size(), JNI_FALSE));
+    lspd::ParseDexes(Pointers(parallel), {}, false, 4);
+    for (size_t i = 0; i < serial.size(); ++i) {
+        ExpectSameClasses(*serial[i], *parallel[i]);
+    }
+}
+
+TEST(DexFileTest, LoadsWhatWriteCacheWrote) {
+    auto &corpus = lspd::test::DexCorpus::Get();
+    if (corpus.empty()) GTEST_SKIP() << "LSPD_TEST_DEX is not set";
+    auto parsed = OpenCorpus();
+    lspd::ParseDexes(Pointers(parsed), {}, false);
+
+    std::vector<std::unique_ptr<FILE, decltype(&fclose)>> files;
+    std::vector<lspd::DexCacheView> caches;
+    for (auto &parser : parsed) {
+        auto &file = files.emplace_back(tmpfile(), &fclose);
+        ASSERT_TRUE(file);
+        auto fd = fileno(file.get());
+        ASSERT_TRUE(parser->WriteCache(fd));
+        auto size = static_cast<size_t>(lseek(fd, 0, SEEK_END));
+        auto *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ASSERT_NE(data, MAP_FAILED);
+        caches.emplace_back(data, size);
+    }
+    ASSERT_FALSE(caches.empty());
+    // the last one gets the cache of another dex, which has to be rejected
+    auto mapped = caches.size();
+    auto cache_of_last = caches.back();
+    if (mapped > 1) caches.back() = caches.front();
+
+    auto loaded = OpenCorpus();
+    auto from_cache = lspd::ParseDexes(Pointers(loaded), caches, false);
+    for (size_t i = 0; i < loaded.size(); ++i) {
+        auto rejected = i > 0 && i + 1 == loaded.size();
+        EXPECT_EQ(from_cache[i], rejected ? JNI_FALSE : JNI_TRUE) << i;
+        ExpectSameClasses(*parsed[i], *loaded[i]);
+    }
+    loaded.clear();
+    for (size_t i = 0; i < mapped; ++i) {
+        auto [data, size] = i + 1 < mapped || mapped == 1 ? caches[i] : cache_of_last;
+        munmap(const_cast<void *>(data), size);
+    }
+}
@@ -0,0 +1,64 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+
+#include "elf_corpus.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+namespace lspd::test {
+    const ElfCorpus &ElfCorpus::Get() {
+        static const ElfCorpus corpus;
+        return corpus;
+    }
+
+    ElfCorpus::ElfCorpus() {
+        auto *path = getenv("LSPD_TEST_ELF");
+        char real[PATH_MAX];
+        if (!realpath(path ? path : "/proc/self/exe", real)) return;
+        path_ = real;
+        int fd = open(real, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+        struct stat st{};
+        auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) > 2 * page) {
+            auto *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED && memcmp(map, ELFMAG, SELFMAG) != 0) {
+                munmap(map, st.st_size);
+            } else if (map != MAP_FAILED) {
+                header_ = static_cast<const ElfW(Ehdr) *>(map);
+                size_ = static_cast<size_t>(st.st_size);
+                // r--p followed by r-xp, what ScanModuleBases takes as the base of a library;
+                // fails on a noexec mount, this executable is found through its own mapping then
+                mprotect(static_cast<char *>(map) + page, page, PROT_READ | PROT_EXEC);
+            }
+        }
+        close(fd);
+    }
+
+    ElfCorpus::~ElfCorpus() {
+        if (header_) munmap(const_cast<ElfW(Ehdr) *>(header_), size_);
+    }
+}  // namespace lspd::test
@@ -0,0 +1,50 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+#pragma once
+
+#include <link.h>
+
+#include <string>
+
+namespace lspd::test {
+    // The ELF named by LSPD_TEST_ELF, this executable if it is not set, mapped read-only for
+    // the whole run. The mapping has an executable page so that ElfImg finds a base for it
+    // like for a loaded library. To measure ART, point it to an unstripped libart.so, from the
+    // symbols directory of an AOSP build, or to the decompressed .gnu_debugdata of a device one.
+    class ElfCorpus {
+    public:
+        static const ElfCorpus &Get();
+
+        bool valid() const { return header_ != nullptr; }
+
+        // canonical, the path maps shows for the mapping
+        const std::string &path() const { return path_; }
+
+        const ElfW(Ehdr) *header() const { return header_; }
+
+        ~ElfCorpus();
+
+    private:
+        ElfCorpus();
+
+        std::string path_;
+        const ElfW(Ehdr) *header_ = nullptr;
+        size_t size_ = 0;
+    };
+}  // namespace lspd::test
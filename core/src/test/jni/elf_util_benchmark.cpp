@@ -0,0 +1,167 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+#include <benchmark/benchmark.h>
+#include <malloc.h>
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "elf_corpus.h"
+#include "elf_util.h"
+#include "legacy_symtab.h"
+
+using SandHook::ElfImg;
+using SandHook::operator""_elf;
+
+namespace {
+    // up to 1024 names of the symtab, spread over it
+    std::vector<std::string_view> SampleNames(const lspd::test::LegacySymtab &legacy) {
+        std::vector<std::string_view> names;
+        auto step = std::max<size_t>(legacy.symbols().size() / 1024, 1);
+        size_t i = 0;
+        for (const auto &[name, sym] : legacy.symbols()) {
+            if (i++ % step == 0) names.emplace_back(name);
+        }
+        return names;
+    }
+
+    // Heap held by what make() returns, which is kept alive until the end of the benchmark.
+    // The symtab itself is file backed, this is the part of RSS each lookup structure adds.
+    template <typename Make>
+    auto MeasureHeap(benchmark::State &state, Make &&make) {
+        auto before = mallinfo2();
+        auto res = make();
+        auto after = mallinfo2();
+        state.counters["heap"] = benchmark::Counter(
+                static_cast<double>(after.uordblks - before.uordblks),
+                benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+        return res;
+    }
+
+    // Building the sorted index on the first symtab lookup, constructing ElfImg is not timed
+    void BM_SymtabIndexBuild(benchmark::State &state) {
+        auto &corpus = lspd::test::ElfCorpus::Get();
+        if (!corpus.valid()) return state.SkipWithError("no ELF to look up");
+        auto img = MeasureHeap(state, [&] {
+            auto img = std::make_unique<ElfImg>(corpus.path());
+            img->getAllSymbAddress("");
+            return img;
+        });
+        if (!img->isValid()) return state.SkipWithError("ElfImg found no base");
+        for (auto _ : state) {
+            state.PauseTiming();
+            ElfImg fresh(corpus.path());
+            state.ResumeTiming();
+            benchmark::DoNotOptimize(fresh.getAllSymbAddress(""));
+        }
+    }
+
+    // Building the std::map the symtab lookups used before
+    void BM_LegacySymtabMapBuild(benchmark::State &state) {
+        auto &corpus = lspd::test::ElfCorpus::Get();
+        if (!corpus.valid()) return state.SkipWithError("no ELF to look up");
+        auto legacy = MeasureHeap(state, [&] {
+            return std::make_unique<lspd::test::LegacySymtab>(corpus.header());
+        });
+        for (auto _ : state) {
+            lspd::test::LegacySymtab fresh(corpus.header());
+            benchmark::DoNotOptimize(fresh.LinearRangeLookup(""));
+        }
+        state.counters["symbols"] = static_cast<double>(legacy->symbols().size());
+    }
+
+    // A range lookup of each sampled name, the index already built
+    void BM_SymtabIndexLookup(benchmark::State &state) {
+        auto &corpus = lspd::test::ElfCorpus::Get();
+        if (!corpus.valid()) return state.SkipWithError("no ELF to look up");
+        ElfImg img(corpus.path());
+        if (!img.isValid()) return state.SkipWithError("ElfImg found no base");
+        auto names = SampleNames(lspd::test::LegacySymtab(corpus.header()));
+        for (auto _ : state) {
+            for (auto name : names) {
+                benchmark::DoNotOptimize(img.getAllSymbAddress(name));
+            }
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * names.size()));
+    }
+
+    void BM_LegacySymtabMapLookup(benchmark::State &state) {
+        auto &corpus = lspd::test::ElfCorpus::Get();
+        if (!corpus.valid()) return state.SkipWithError("no ELF to look up");
+        lspd::test::LegacySymtab legacy(corpus.header());
+        auto names = SampleNames(legacy);
+        for (auto _ : state) {
+            for (auto name : names) {
+                benchmark::DoNotOptimize(legacy.LinearRangeLookup(name));
+            }
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * names.size()));
+    }
+
+    // dynsym names of the libstdc++ this process has loaded, mangled like most of what is
+    // looked up in libart
+    constexpr std::array kLiterals{
+            "_Znwm"_elf,
+            "__cxa_throw"_elf,
+            "_ZSt9terminatev"_elf,
+            "_ZNSt13runtime_errorC1EPKc"_elf,
+            "_ZNSt6thread20hardware_concurrencyEv"_elf,
+            "_ZNSt6chrono3_V212steady_clock3nowEv"_elf,
+            "_ZNKSt7__cxx1112basic_stringIcSt11char_traitsIcESaIcEE7compareEPKc"_elf,
+            "_ZNSt7__cxx1118basic_stringstreamIcSt11char_traitsIcESaIcEEC1Ev"_elf,
+            "_ZNKSt7__cxx119money_putIcSt19ostreambuf_iteratorIcSt11char_traitsIcEEE6do_putES4_bRSt8ios_basece"_elf,
+    };
+
+    // Lookups with the hashes the _elf literal computed at compile time
+    void BM_GnuLookupLiteral(benchmark::State &state) {
+        ElfImg img("libstdc++.so");
+        if (!img.isValid()) return state.SkipWithError("libstdc++ is not loaded");
+        for (auto _ : state) {
+            for (const auto &symbol : kLiterals) {
+                benchmark::DoNotOptimize(img.getSymbAddress(symbol));
+            }
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * kLiterals.size()));
+    }
+
+    // The same names as plain strings, hashed on every lookup
+    void BM_GnuLookupRuntimeHash(benchmark::State &state) {
+        ElfImg img("libstdc++.so");
+        if (!img.isValid()) return state.SkipWithError("libstdc++ is not loaded");
+        std::vector<std::string> names;
+        for (const auto &symbol : kLiterals) names.emplace_back(symbol.name);
+        for (auto _ : state) {
+            for (const auto &name : names) {
+                benchmark::DoNotOptimize(img.getSymbAddress(name));
+            }
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * names.size()));
+    }
+}  // namespace
+
+BENCHMARK(BM_SymtabIndexBuild)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LegacySymtabMapBuild)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SymtabIndexLookup);
+BENCHMARK(BM_LegacySymtabMapLookup);
+BENCHMARK(BM_GnuLookupLiteral);
+BENCHMARK(BM_GnuLookupRuntimeHash);
@@ -0,0 +1,64 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "elf_corpus.h"
+#include "elf_util.h"
+#include "legacy_symtab.h"
+
+using SandHook::ElfImg;
+using SandHook::operator""_elf;
+
+TEST(ElfUtilTest, SymtabLookupsMatchLegacyMap) {
+    auto &corpus = lspd::test::ElfCorpus::Get();
+    if (!corpus.valid()) GTEST_SKIP() << "no ELF to look up";
+    ElfImg img(corpus.path());
+    ASSERT_TRUE(img.isValid());
+    lspd::test::LegacySymtab legacy(corpus.header());
+    ASSERT_FALSE(legacy.symbols().empty());
+
+    // addresses are offsets moved by the load base, which is the same for every symbol
+    std::optional<uintptr_t> load;
+    for (const auto &[name, sym] : legacy.symbols()) {
+        auto addresses = img.getAllSymbAddress(name);
+        ASSERT_FALSE(addresses.empty()) << name;
+        // the first of duplicated names is the one the map kept
+        auto delta = reinterpret_cast<uintptr_t>(addresses.front()) - legacy.LinearLookup(name);
+        if (!load) load = delta;
+        ASSERT_EQ(delta, *load) << name;
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(img.getSymbPrefixFirstAddress(name)) - *load,
+                  legacy.PrefixLookupFirst(name)) << name;
+    }
+    EXPECT_TRUE(img.getAllSymbAddress("_ZN4lspd4test15NotASymbolAtAllEv").empty());
+}
+
+TEST(ElfUtilTest, LiteralResolvesLikeRuntimeHash) {
+    static_assert("_Znwm"_elf.gnu_hash == ElfImg::GnuHash("_Znwm"));
+    static_assert("_Znwm"_elf.elf_hash == ElfImg::ElfHash("_Znwm"));
+    ElfImg img("libstdc++.so");
+    ASSERT_TRUE(img.isValid());
+    auto *address = img.getSymbAddress("_ZNSt6thread20hardware_concurrencyEv"_elf);
+    ASSERT_NE(address, nullptr);
+    EXPECT_EQ(address, img.getSymbAddress(std::string_view("_ZNSt6thread20hardware_concurrencyEv")));
+    EXPECT_EQ(img.getSymbAddress("_ZN4lspd4test15NotASymbolAtAllEv"_elf), nullptr);
+}
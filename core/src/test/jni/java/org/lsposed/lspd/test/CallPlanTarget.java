@@ -0,0 +1,69 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+
+package org.lsposed.lspd.test;
+
+/**
+ * Methods of the shapes CallPlan handles, called by call_plan_test and call_plan_benchmark.
+ */
+public class CallPlanTarget {
+    public int base = 1;
+
+    public static int none() {
+        return 42;
+    }
+
+    public int one(int a) {
+        return base + a;
+    }
+
+    public long three(int a, long b, String c) {
+        return base + a + b + c.length();
+    }
+
+    public String six(boolean z, byte b, char c, short s, float f, double d) {
+        return base + " " + z + " " + b + " " + c + " " + s + " " + f + " " + d;
+    }
+
+    public static Object objects(Object a, CharSequence b) {
+        return a != null ? a : b;
+    }
+
+    public void nothing() {
+        base++;
+    }
+
+    public double widen(long a, double b) {
+        return a + b;
+    }
+
+    public static int many(int a0, int a1, int a2, int a3, int a4, int a5, int a6, int a7,
+                           int a8, int a9, int a10, int a11, int a12, int a13, int a14,
+                           int a15, int a16) {
+        return a0 + a1 + a2 + a3 + a4 + a5 + a6 + a7 + a8 + a9 + a10 + a11 + a12 + a13 + a14 +
+                a15 + a16;
+    }
+
+    public int fail(int a) {
+        throw new IllegalStateException("fail " + a);
+    }
+
+    public static class Sub extends CallPlanTarget {
+    }
+}
@@ -0,0 +1,61 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+
+#include "jvm.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace lspd::test {
+    JNIEnv *StartJvm(bool check_jni) {
+        static JNIEnv *env = [check_jni] {
+            std::string class_path = "-Djava.class.path=" TEST_CLASS_PATH;
+            std::vector<JavaVMOption> options{{.optionString = class_path.data()}};
+            std::string check = "-Xcheck:jni";
+            if (check_jni) options.push_back({.optionString = check.data()});
+            JavaVMInitArgs args{
+                    .version = JNI_VERSION_1_8,
+                    .nOptions = static_cast<jint>(options.size()),
+                    .options = options.data(),
+                    .ignoreUnrecognized = JNI_FALSE,
+            };
+            JavaVM *vm = nullptr;
+            JNIEnv *env = nullptr;
+            if (JNI_CreateJavaVM(&vm, reinterpret_cast<void **>(&env), &args) != JNI_OK) {
+                fprintf(stderr, "failed to create the test JVM\n");
+                abort();
+            }
+            return env;
+        }();
+        return env;
+    }
+
+    jobject ReflectedMethod(JNIEnv *env, const char *class_name, const char *name,
+                            const char *signature, bool is_static) {
+        auto clazz = env->FindClass(class_name);
+        if (!clazz) return nullptr;
+        auto id = is_static ? env->GetStaticMethodID(clazz, name, signature)
+                            : env->GetMethodID(clazz, name, signature);
+        auto method = id ? env->ToReflectedMethod(clazz, id, is_static) : nullptr;
+        env->DeleteLocalRef(clazz);
+        return method;
+    }
+}  // namespace lspd::test
@@ -0,0 +1,32 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+#pragma once
+
+#include <jni.h>
+
+namespace lspd::test {
+    // Starts a JVM with the test classes on its class path on the first call and returns
+    // the env of the calling thread, which has to be the same for every call. check_jni is
+    // only looked at by the first call.
+    JNIEnv *StartJvm(bool check_jni);
+
+    // The reflected method of class_name, a slash separated name as for FindClass
+    jobject ReflectedMethod(JNIEnv *env, const char *class_name, const char *name,
+                            const char *signature, bool is_static);
+}  // namespace lspd::test
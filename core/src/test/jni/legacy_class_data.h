@@ -0,0 +1,111 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+#pragma once
+
+#include <vector>
+
+#include "jni/dex_file.h"
+
+namespace lspd::test {
+    // DexParser::ClassData as it was before the dex-wide arrays, one set of vectors per class
+    struct LegacyClassData {
+        std::vector<jint> interfaces;
+        std::vector<jint> static_fields;
+        std::vector<jint> static_fields_access_flags;
+        std::vector<jint> instance_fields;
+        std::vector<jint> instance_fields_access_flags;
+        std::vector<jint> direct_methods;
+        std::vector<jint> direct_methods_access_flags;
+        std::vector<const dex::Code *> direct_methods_code;
+        std::vector<jint> virtual_methods;
+        std::vector<jint> virtual_methods_access_flags;
+        std::vector<const dex::Code *> virtual_methods_code;
+        std::vector<jint> annotations;
+    };
+
+    // What DexParser::Parse(false) did with that layout, kept as the reference
+    inline std::vector<LegacyClassData> LegacyParseClassData(const dex::Reader &dex) {
+        auto classes = dex.ClassDefs();
+        std::vector<LegacyClassData> res(classes.size());
+        for (size_t i = 0; i < classes.size(); ++i) {
+            auto &class_def = classes[i];
+            auto &class_data = res[i];
+
+            if (class_def.interfaces_off) {
+                auto defined_interfaces = dex.dataPtr<dex::TypeList>(class_def.interfaces_off);
+                class_data.interfaces.resize(defined_interfaces->size);
+                for (size_t k = 0; k < class_data.interfaces.size(); ++k) {
+                    class_data.interfaces[k] = defined_interfaces->list[k].type_idx;
+                }
+            }
+
+            if (class_def.class_data_off == 0) continue;
+            auto *class_data_ptr = dex.dataPtr<dex::u1>(class_def.class_data_off);
+            auto static_fields_count = dex::ReadULeb128(&class_data_ptr);
+            auto instance_fields_count = dex::ReadULeb128(&class_data_ptr);
+            auto direct_methods_count = dex::ReadULeb128(&class_data_ptr);
+            auto virtual_methods_count = dex::ReadULeb128(&class_data_ptr);
+            class_data.static_fields.resize(static_fields_count);
+            class_data.static_fields_access_flags.resize(static_fields_count);
+            class_data.instance_fields.resize(instance_fields_count);
+            class_data.instance_fields_access_flags.resize(instance_fields_count);
+            class_data.direct_methods.resize(direct_methods_count);
+            class_data.direct_methods_access_flags.resize(direct_methods_count);
+            class_data.direct_methods_code.resize(direct_methods_count);
+            class_data.virtual_methods.resize(virtual_methods_count);
+            class_data.virtual_methods_access_flags.resize(virtual_methods_count);
+            class_data.virtual_methods_code.resize(virtual_methods_count);
+
+            for (size_t k = 0, field_idx = 0; k < static_fields_count; ++k) {
+                class_data.static_fields[k] = static_cast<jint>(field_idx += dex::ReadULeb128(
+                        &class_data_ptr));
+                class_data.static_fields_access_flags[k] = static_cast<jint>(dex::ReadULeb128(
+                        &class_data_ptr));
+            }
+
+            for (size_t k = 0, field_idx = 0; k < instance_fields_count; ++k) {
+                class_data.instance_fields[k] = static_cast<jint>(field_idx += dex::ReadULeb128(
+                        &class_data_ptr));
+                class_data.instance_fields_access_flags[k] = static_cast<jint>(dex::ReadULeb128(
+                        &class_data_ptr));
+            }
+
+            for (size_t k = 0, method_idx = 0; k < direct_methods_count; ++k) {
+                class_data.direct_methods[k] = static_cast<jint>(method_idx += dex::ReadULeb128(
+                        &class_data_ptr));
+                class_data.direct_methods_access_flags[k] = static_cast<jint>(dex::ReadULeb128(
+                        &class_data_ptr));
+                auto code_off = dex::ReadULeb128(&class_data_ptr);
+                class_data.direct_methods_code[k] = code_off ? dex.dataPtr<dex::Code>(code_off)
+                                                             : nullptr;
+            }
+
+            for (size_t k = 0, method_idx = 0; k < virtual_methods_count; ++k) {
+                class_data.virtual_methods[k] = static_cast<jint>(method_idx += dex::ReadULeb128(
+                        &class_data_ptr));
+                class_data.virtual_methods_access_flags[k] = static_cast<jint>(dex::ReadULeb128(
+                        &class_data_ptr));
+                auto code_off = dex::ReadULeb128(&class_data_ptr);
+                class_data.virtual_methods_code[k] = code_off ? dex.dataPtr<dex::Code>(code_off)
+                                                              : nullptr;
+            }
+        }
+        return res;
+    }
+}  // namespace lspd::test
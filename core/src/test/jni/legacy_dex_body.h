@@ -0,0 +1,97 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+#pragma once
+
+#include <set>
+
+#include "jni/dex_body.h"
+#include "slicer/reader.h"
+
+namespace lspd::test {
+    // The decoder as it was before DecodeMethodBody, kept as the reference
+    inline MethodBody LegacyDecodeMethodBody(const dex::Code *code) {
+        constexpr dex::u1 kOpcodeMask = 0xff;
+        constexpr dex::u1 kOpcodeNoOp = 0x00;
+        constexpr dex::u1 kOpcodeConstString = 0x1a;
+        constexpr dex::u1 kOpcodeConstStringJumbo = 0x1b;
+        constexpr dex::u1 kOpcodeIGetStart = 0x52;
+        constexpr dex::u1 kOpcodeIGetEnd = 0x58;
+        constexpr dex::u1 kOpcodeSGetStart = 0x60;
+        constexpr dex::u1 kOpcodeSGetEnd = 0x66;
+        constexpr dex::u1 kOpcodeIPutStart = 0x59;
+        constexpr dex::u1 kOpcodeIPutEnd = 0x5f;
+        constexpr dex::u1 kOpcodeSPutStart = 0x67;
+        constexpr dex::u1 kOpcodeSPutEnd = 0x6d;
+        constexpr dex::u1 kOpcodeInvokeStart = 0x6e;
+        constexpr dex::u1 kOpcodeInvokeEnd = 0x72;
+        constexpr dex::u1 kOpcodeInvokeRangeStart = 0x74;
+        constexpr dex::u1 kOpcodeInvokeRangeEnd = 0x78;
+        constexpr dex::u2 kInstPackedSwitchPlayLoad = 0x0100;
+        constexpr dex::u2 kInstSparseSwitchPlayLoad = 0x0200;
+        constexpr dex::u2 kInstFillArrayDataPlayLoad = 0x0300;
+
+        MethodBody body{};
+        std::set<int32_t> referred_strings;
+        std::set<int32_t> assigned_fields;
+        std::set<int32_t> accessed_fields;
+        std::set<int32_t> invoked_methods;
+
+        const dex::u2 *inst = code->insns;
+        const dex::u2 *end = inst + code->insns_size;
+        while (inst < end) {
+            dex::u1 opcode = *inst & kOpcodeMask;
+            body.opcodes.push_back(static_cast<int8_t>(opcode));
+            if (opcode == kOpcodeConstString) {
+                referred_strings.emplace(inst[1]);
+            }
+            if (opcode == kOpcodeConstStringJumbo) {
+                auto str_idx = *reinterpret_cast<const dex::u4 *>(&inst[1]);
+                referred_strings.emplace(static_cast<int32_t>(str_idx));
+            }
+            if ((opcode >= kOpcodeIGetStart && opcode <= kOpcodeIGetEnd) ||
+                (opcode >= kOpcodeSGetStart && opcode <= kOpcodeSGetEnd)) {
+                accessed_fields.emplace(inst[1]);
+            }
+            if ((opcode >= kOpcodeIPutStart && opcode <= kOpcodeIPutEnd) ||
+                (opcode >= kOpcodeSPutStart && opcode <= kOpcodeSPutEnd)) {
+                assigned_fields.emplace(inst[1]);
+            }
+            if ((opcode >= kOpcodeInvokeStart && opcode <= kOpcodeInvokeEnd) ||
+                (opcode >= kOpcodeInvokeRangeStart && opcode <= kOpcodeInvokeRangeEnd)) {
+                invoked_methods.emplace(inst[1]);
+            }
+            if (opcode == kOpcodeNoOp) {
+                if (*inst == kInstPackedSwitchPlayLoad) {
+                    inst += inst[1] * 2 + 3;
+                } else if (*inst == kInstSparseSwitchPlayLoad) {
+                    inst += inst[1] * 4 + 1;
+                } else if (*inst == kInstFillArrayDataPlayLoad) {
+                    inst += (*reinterpret_cast<const dex::u4 *>(&inst[2]) * inst[1] + 1) / 2 + 3;
+                }
+            }
+            inst += dex::opcode_len[opcode];
+        }
+        body.referred_strings.assign(referred_strings.begin(), referred_strings.end());
+        body.assigned_fields.assign(assigned_fields.begin(), assigned_fields.end());
+        body.accessed_fields.assign(accessed_fields.begin(), accessed_fields.end());
+        body.invoked_methods.assign(invoked_methods.begin(), invoked_methods.end());
+        body.loaded = true;
+        return body;
+    }
+}  // namespace lspd::test
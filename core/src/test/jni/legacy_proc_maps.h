@@ -0,0 +1,84 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "proc_maps.h"
+
+namespace lspd::test {
+    // ElfImg::findModuleBase as it was before ScanModuleBases, one sscanf pass per library,
+    // reading maps from memory instead of /proc/self/maps. Kept as the reference.
+    inline SandHook::ModuleMapping LegacyFindModuleBase(std::string_view maps, const char *elf) {
+        struct MapEntry {
+            uintptr_t start_addr;
+            char perms[5] = {0};
+            std::string pathname;
+        };
+        std::vector<MapEntry> filtered_list;
+        for (size_t pos = 0; pos < maps.size();) {
+            auto eol = maps.find('\n', pos);
+            if (eol == std::string_view::npos) eol = maps.size();
+            // what fgets would have read into its 512 byte buffer
+            char line_buffer[512];
+            auto length = std::min<size_t>(eol + 1 - pos, sizeof(line_buffer) - 1);
+            memcpy(line_buffer, maps.data() + pos, length);
+            line_buffer[length] = '\0';
+            pos = eol + 1;
+
+            unsigned long long temp_start;
+            char path_buffer[256] = {0};
+            char p[5] = {0};
+            int items_parsed =
+                sscanf(line_buffer, "%llx-%*x %4s %*x %*s %*d %255s", &temp_start, p, path_buffer);
+            if (items_parsed == 3 && strstr(path_buffer, elf) != nullptr) {
+                MapEntry entry;
+                entry.start_addr = static_cast<uintptr_t>(temp_start);
+                strncpy(entry.perms, p, 4);
+                entry.pathname = path_buffer;
+                filtered_list.push_back(std::move(entry));
+            }
+        }
+        if (filtered_list.empty()) return {};
+
+        const MapEntry *found_block = nullptr;
+        for (size_t i = 0; i < filtered_list.size() - 1; ++i) {
+            if (strcmp(filtered_list[i].perms, "r--p") == 0 &&
+                strcmp(filtered_list[i + 1].perms, "r-xp") == 0) {
+                found_block = &filtered_list[i];
+                break;
+            }
+        }
+        if (!found_block) {
+            for (const auto &entry : filtered_list) {
+                if (strcmp(entry.perms, "r-xp") == 0) {
+                    found_block = &entry;
+                    break;
+                }
+            }
+        }
+        if (!found_block) return {};
+        return {found_block->start_addr, found_block->pathname};
+    }
+}  // namespace lspd::test
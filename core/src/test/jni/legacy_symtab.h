@@ -0,0 +1,83 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+#pragma once
+
+#include <link.h>
+#include <linux/elf.h>
+
+#include <cstdint>
+#include <map>
+#include <string_view>
+#include <vector>
+
+namespace lspd::test {
+    // The symtab lookups of ElfImg as they were before the sorted index, a std::map from name
+    // to symbol where the first of duplicated names wins. Kept as the reference.
+    class LegacySymtab {
+    public:
+        // header is a whole ELF file mapped, its symtab is the one looked up
+        explicit LegacySymtab(const ElfW(Ehdr) *header) {
+            auto *base = reinterpret_cast<const char *>(header);
+            auto *sections = reinterpret_cast<const ElfW(Shdr) *>(base + header->e_shoff);
+            for (int i = 0; i < header->e_shnum; ++i) {
+                if (sections[i].sh_type != SHT_SYMTAB) continue;
+                auto *symtab = reinterpret_cast<const ElfW(Sym) *>(base + sections[i].sh_offset);
+                auto *strtab = base + sections[sections[i].sh_link].sh_offset;
+                auto count = sections[i].sh_size / sections[i].sh_entsize;
+                for (ElfW(Off) j = 0; j < count; j++) {
+                    unsigned int st_type = ELF_ST_TYPE(symtab[j].st_info);
+                    if ((st_type == STT_FUNC || st_type == STT_OBJECT) && symtab[j].st_size) {
+                        symtabs_.emplace(strtab + symtab[j].st_name, &symtab[j]);
+                    }
+                }
+                break;
+            }
+        }
+
+        ElfW(Addr) LinearLookup(std::string_view name) const {
+            if (auto i = symtabs_.find(name); i != symtabs_.end()) {
+                return i->second->st_value;
+            } else {
+                return 0;
+            }
+        }
+
+        std::vector<ElfW(Addr)> LinearRangeLookup(std::string_view name) const {
+            std::vector<ElfW(Addr)> res;
+            for (auto [i, end] = symtabs_.equal_range(name); i != end; ++i) {
+                res.emplace_back(i->second->st_value);
+            }
+            return res;
+        }
+
+        ElfW(Addr) PrefixLookupFirst(std::string_view prefix) const {
+            if (auto i = symtabs_.lower_bound(prefix);
+                i != symtabs_.end() && i->first.starts_with(prefix)) {
+                return i->second->st_value;
+            } else {
+                return 0;
+            }
+        }
+
+        const std::map<std::string_view, const ElfW(Sym) *> &symbols() const { return symtabs_; }
+
+    private:
+        std::map<std::string_view, const ElfW(Sym) *> symtabs_;
+    };
+}  // namespace lspd::test
@@ -0,0 +1,82 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "legacy_proc_maps.h"
+#include "proc_maps.h"
+#include "synthetic_maps.h"
+
+namespace {
+    // what ElfImg resolves during startup, all mapped near the end of the synthetic maps
+    const std::vector<std::string_view> kLibraries{"/apex/com.android.art/lib64/libart.so",
+                                                   "/system/lib64/libc++.so",
+                                                   "/system/lib64/libandroid_runtime.so"};
+    const std::vector<std::string_view> kNames{"libart.so", "libc++.so", "libandroid_runtime.so"};
+
+    // One scan resolving every name, Arg is the number of lines of the maps
+    void BM_ScanModuleBases(benchmark::State &state) {
+        auto maps = lspd::test::SyntheticMaps(static_cast<size_t>(state.range(0)), kLibraries);
+        for (auto _ : state) {
+            auto res = SandHook::ScanModuleBases(maps, kNames);
+            benchmark::DoNotOptimize(res.data());
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * maps.size()));
+    }
+
+    // A sscanf pass per name as before, from memory so that neither side pays for procfs
+    void BM_LegacyFindModuleBase(benchmark::State &state) {
+        auto maps = lspd::test::SyntheticMaps(static_cast<size_t>(state.range(0)), kLibraries);
+        std::vector<std::string> names(kNames.begin(), kNames.end());
+        for (auto _ : state) {
+            for (auto &name : names) {
+                auto res = lspd::test::LegacyFindModuleBase(maps, name.c_str());
+                benchmark::DoNotOptimize(res.base);
+            }
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * maps.size()));
+    }
+
+    // libraries every host process has loaded, for the engines that look at this process
+    const std::vector<std::string_view> kLoadedNames{"libc.so", "libm.so", "libstdc++.so"};
+
+    // The dl_iterate_phdr engine of ResolveModuleBases
+    void BM_IteratePhdrModuleBases(benchmark::State &state) {
+        for (auto _ : state) {
+            auto res = SandHook::IteratePhdrModuleBases(kLoadedNames);
+            benchmark::DoNotOptimize(res.data());
+        }
+    }
+
+    // The maps engine on the same names, reading /proc/self/maps included
+    void BM_ScanProcSelfMaps(benchmark::State &state) {
+        for (auto _ : state) {
+            auto res = SandHook::ScanModuleBases(kLoadedNames);
+            benchmark::DoNotOptimize(res.data());
+        }
+    }
+}  // namespace
+
+BENCHMARK(BM_ScanModuleBases)->Arg(1000)->Arg(5000)->Arg(20000);
+BENCHMARK(BM_LegacyFindModuleBase)->Arg(1000)->Arg(5000)->Arg(20000);
+BENCHMARK(BM_IteratePhdrModuleBases);
+BENCHMARK(BM_ScanProcSelfMaps);
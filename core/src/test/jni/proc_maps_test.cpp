@@ -0,0 +1,129 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+#include <gtest/gtest.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "legacy_proc_maps.h"
+#include "proc_maps.h"
+#include "synthetic_maps.h"
+
+using SandHook::ScanModuleBases;
+
+namespace {
+    std::vector<SandHook::ModuleMapping> Scan(std::string_view maps,
+                                              std::initializer_list<std::string_view> names) {
+        return ScanModuleBases(maps, std::span(names.begin(), names.size()));
+    }
+}  // namespace
+
+TEST(ProcMapsTest, TakesReadOnlyMappingBeforeExec) {
+    auto res = Scan(
+            "7000-8000 r--p 00000000 fd:05 11   /system/lib64/libfoo.so\n"
+            "8000-9000 r--p 00001000 fd:05 11   /system/lib64/libfoo.so\n"
+            "9000-a000 r-xp 00002000 fd:05 11   /system/lib64/libfoo.so\n"
+            "a000-b000 rw-p 00003000 fd:05 11   /system/lib64/libfoo.so\n",
+            {"libfoo.so"});
+    ASSERT_EQ(res.size(), 1u);
+    EXPECT_EQ(res[0].base, 0x8000u);
+    EXPECT_EQ(res[0].path, "/system/lib64/libfoo.so");
+    EXPECT_FALSE(res[0].exact_bias);
+}
+
+TEST(ProcMapsTest, FallsBackToFirstExec) {
+    auto res = Scan(
+            "7000-8000 r-xp 00000000 fd:05 11   /system/lib64/libfoo.so\n"
+            "8000-9000 rw-p 00001000 fd:05 11   /system/lib64/libfoo.so\n"
+            "9000-a000 r-xp 00002000 fd:05 11   /system/lib64/libfoo.so\n",
+            {"libfoo.so"});
+    EXPECT_EQ(res[0].base, 0x7000u);
+}
+
+TEST(ProcMapsTest, ResolvesEveryNameInOneScan) {
+    auto res = Scan(
+            "1000-2000 r--p 00000000 fd:05 11   /system/lib64/liba.so\n"
+            "2000-3000 r-xp 00001000 fd:05 11   /system/lib64/liba.so\n"
+            "3000-4000 r--p 00000000 fd:05 12   /system/lib64/libb.so\n"
+            "4000-5000 r-xp 00001000 fd:05 12   /system/lib64/libb.so\n",
+            {"libb.so", "libmissing.so", "liba.so"});
+    ASSERT_EQ(res.size(), 3u);
+    EXPECT_EQ(res[0].base, 0x3000u);
+    EXPECT_FALSE(res[1].valid());
+    EXPECT_EQ(res[2].base, 0x1000u);
+}
+
+TEST(ProcMapsTest, PathEndsAtFirstWhitespace) {
+    auto res = Scan(
+            "1000-2000 r--p 00000000 fd:05 11   /data/local/tmp/liba.so (deleted)\n"
+            "2000-3000 r-xp 00001000 fd:05 11   /data/local/tmp/liba.so (deleted)\n"
+            "3000-4000 r-xp 00000000 fd:05 12   /data/app/with space/libb.so\n",
+            {"liba.so", "libb.so"});
+    EXPECT_EQ(res[0].base, 0x1000u);
+    EXPECT_EQ(res[0].path, "/data/local/tmp/liba.so");
+    // as with sscanf, the part of a path after a space is not matched
+    EXPECT_FALSE(res[1].valid());
+}
+
+TEST(ProcMapsTest, SkipsAnonymousAndMalformedLines) {
+    auto res = Scan(
+            "\n"
+            "garbage\n"
+            "1000-2000 r-xp 00000000 00:00 0\n"
+            "2000-3000 r-xp 00000000 00:00 0    [anon:libfoo.so]\n"
+            "3000-4000 r--p 00000000 fd:05 11   /system/lib64/libfoo.so\n"
+            "4000-5000 r-xp 00001000 fd:05 11   /system/lib64/libfoo.so",
+            {"libfoo.so"});
+    // [anon:libfoo.so] contains the name as well, but is followed by an r--p
+    EXPECT_EQ(res[0].base, 0x3000u);
+    EXPECT_EQ(res[0].path, "/system/lib64/libfoo.so");
+}
+
+TEST(ProcMapsTest, MatchesLegacyScanOnSyntheticMaps) {
+    std::vector<std::string_view> libs{"/apex/com.android.art/lib64/libart.so",
+                                       "/system/lib64/libc++.so",
+                                       "/system/lib64/libandroid_runtime.so"};
+    for (size_t lines : {1000, 20000}) {
+        auto maps = lspd::test::SyntheticMaps(lines, libs);
+        std::vector<std::string_view> names{"libart.so", "libc++.so", "libandroid_runtime.so",
+                                            "libsynthetic12.so", "libnothere.so"};
+        auto res = ScanModuleBases(maps, names);
+        for (size_t n = 0; n < names.size(); ++n) {
+            auto expected = lspd::test::LegacyFindModuleBase(maps, std::string(names[n]).c_str());
+            EXPECT_EQ(res[n].base, expected.base) << names[n] << " in " << lines;
+            EXPECT_EQ(res[n].path, expected.path) << names[n] << " in " << lines;
+        }
+        EXPECT_TRUE(res[0].valid());
+        EXPECT_FALSE(res[4].valid());
+    }
+}
+
+TEST(ProcMapsTest, IteratePhdrAgreesWithMaps) {
+    // both have to find libc of this process, where the first mapping is at the load bias
+    std::vector<std::string_view> names{"libc.so", "libnothere.so"};
+    auto phdr = SandHook::IteratePhdrModuleBases(names);
+    auto maps = SandHook::ScanModuleBases(names);
+    ASSERT_TRUE(phdr[0].valid());
+    EXPECT_TRUE(phdr[0].exact_bias);
+    EXPECT_EQ(phdr[0].base, maps[0].base);
+    // the linker keeps the name it loaded by, maps the resolved one (e.g. /lib vs /usr/lib)
+    EXPECT_NE(phdr[0].path.find("libc.so"), std::string::npos);
+    EXPECT_FALSE(phdr[1].valid());
+}
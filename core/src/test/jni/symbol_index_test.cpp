@@ -0,0 +1,114 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <string_view>
+#include <vector>
+
+#include "symbol_index.h"
+
+using SandHook::SymbolIndex;
+
+namespace {
+    constexpr uint32_t GnuHash(std::string_view name) {
+        uint32_t hash = 5381;
+        for (unsigned char c : name) hash = hash * 33 + c;
+        return hash;
+    }
+
+    SymbolIndex::Symbol MakeSymbol(std::string_view name, uint64_t value,
+                                   SymbolIndex::Source source) {
+        return {name, GnuHash(name), value, source};
+    }
+
+    class SymbolIndexTest : public testing::Test {
+    protected:
+        void SetUp() override {
+            file_ = tmpfile();
+            ASSERT_NE(file_, nullptr);
+        }
+
+        void TearDown() override {
+            if (file_) fclose(file_);
+        }
+
+        int fd() const { return fileno(file_); }
+
+        size_t size() const { return static_cast<size_t>(lseek(fd(), 0, SEEK_END)); }
+
+        static constexpr SymbolIndex::Key kKey{1, 2, 3, 4, 5};
+        static constexpr std::string_view kInvoke = "_ZN3art9ArtMethod6InvokeEPNS_6ThreadE";
+        static constexpr std::string_view kPretty = "_ZN3art9ArtMethod12PrettyMethodEb";
+        static constexpr std::string_view kPrettyPrefix = "_ZN3art9ArtMethod12PrettyMethod";
+
+        FILE *file_ = nullptr;
+    };
+}  // namespace
+
+TEST_F(SymbolIndexTest, RoundTrip) {
+    std::vector symbols{
+            MakeSymbol("foo", 0x2000, SymbolIndex::kSymtab),
+            MakeSymbol("foo", 0x1000, SymbolIndex::kDynsym),
+            MakeSymbol(kInvoke, 0x3000, SymbolIndex::kSymtab),
+            MakeSymbol(kPretty, 0x4000, SymbolIndex::kSymtab),
+            MakeSymbol("bar", 0x5000, SymbolIndex::kDynsym),
+    };
+    std::vector hot{
+            MakeSymbol("foo", 0x1000, SymbolIndex::kDynsym),
+            MakeSymbol("foo", 0x1000, SymbolIndex::kDynsym),
+            MakeSymbol(kPrettyPrefix, 0x4000, SymbolIndex::kPrefix),
+    };
+    ASSERT_TRUE(SymbolIndex::Write(fd(), kKey, 0x100, std::move(symbols), std::move(hot)));
+
+    auto index = SymbolIndex::Open(fd(), size());
+    ASSERT_NE(index, nullptr);
+    EXPECT_TRUE(index->Matches(kKey));
+    EXPECT_FALSE(index->Matches({1, 2, 3, 4, 6}));
+    EXPECT_EQ(index->bias(), 0x100);
+
+    // dynsym wins over symtab, as in ElfImg::getSymbOffset
+    EXPECT_EQ(index->Lookup("foo", GnuHash("foo")), 0x1000u);
+    EXPECT_EQ(index->Lookup("bar", GnuHash("bar")), 0x5000u);
+    EXPECT_EQ(index->Lookup(kInvoke, GnuHash(kInvoke)), 0x3000u);
+    EXPECT_EQ(index->Lookup("baz", GnuHash("baz")), 0u);
+    // prefix entries only answer prefix lookups
+    EXPECT_EQ(index->Lookup(kPrettyPrefix, GnuHash(kPrettyPrefix)), 0u);
+
+    EXPECT_EQ(index->RangeLookup("foo", GnuHash("foo")), std::vector<uint64_t>{0x2000});
+    EXPECT_TRUE(index->RangeLookup("bar", GnuHash("bar")).empty());
+
+    EXPECT_EQ(index->PrefixLookupFirst(kPrettyPrefix, GnuHash(kPrettyPrefix)), 0x4000u);
+    // not a hot prefix, so it goes through the sorted prefix table
+    EXPECT_EQ(index->PrefixLookupFirst("_ZN3art9ArtMethod6Invoke",
+                                       GnuHash("_ZN3art9ArtMethod6Invoke")), 0x3000u);
+    EXPECT_EQ(index->PrefixLookupFirst("_ZN3art6Thread", GnuHash("_ZN3art6Thread")), 0u);
+}
+
+TEST_F(SymbolIndexTest, RejectsTruncatedIndex) {
+    std::vector symbols{MakeSymbol("foo", 0x1000, SymbolIndex::kDynsym)};
+    ASSERT_TRUE(SymbolIndex::Write(fd(), kKey, 0, std::move(symbols), {}));
+    auto full = size();
+    EXPECT_NE(SymbolIndex::Open(fd(), full), nullptr);
+    ASSERT_EQ(ftruncate(fd(), full - 1), 0);
+    EXPECT_EQ(SymbolIndex::Open(fd(), full - 1), nullptr);
+    EXPECT_EQ(SymbolIndex::Open(fd(), 0), nullptr);
+}
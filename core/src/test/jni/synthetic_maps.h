@@ -0,0 +1,76 @@
+/*
+ * This file is part of LSPosed.
+ *
+ * LSPosed is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LSPosed is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LSPosed.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) 2023 LSPosed Contributors
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace lspd::test {
+    // A /proc/self/maps of about `lines` lines in the kernel's format: anonymous and heap
+    // mappings and libraries of four mappings each (r--p r-xp r--p rw-p). Each of `libs` is
+    // mapped once, in order, towards the end, so a scan for them reads nearly everything.
+    inline std::string SyntheticMaps(size_t lines, std::span<const std::string_view> libs) {
+        std::string maps;
+        maps.reserve(lines * 100);
+        uintptr_t address = 0x6f0000000000;
+        size_t inode = 1000;
+        auto map = [&](const char *perms, std::string_view path) {
+            char line[128];
+            auto start = address;
+            address += 0x1000 * (1 + inode % 7);
+            snprintf(line, sizeof(line), "%012lx-%012lx %s %08zx fd:05 %-26zu ",
+                     static_cast<unsigned long>(start), static_cast<unsigned long>(address),
+                     perms, (inode % 3) * 0x1000, path.empty() ? 0 : inode);
+            maps += line;
+            maps += path;
+            maps += '\n';
+            ++inode;
+        };
+        auto map_library = [&](std::string_view path) {
+            map("r--p", path);
+            map("r-xp", path);
+            map("r--p", path);
+            map("rw-p", path);
+        };
+        auto tail = libs.size() * 4 + 2;
+        for (size_t i = 0, step = 0; i + tail < lines; ++step) {
+            switch (step % 5) {
+                case 3:
+                    map("rw-p", "[anon:dalvik-main space]");
+                    i += 1;
+                    break;
+                case 4:
+                    map("---p", "");
+                    i += 1;
+                    break;
+                default:
+                    map_library("/system/lib64/libsynthetic" + std::to_string(step) + ".so");
+                    i += 4;
+                    break;
+            }
+        }
+        for (auto lib : libs) map_library(lib);
+        map("rw-p", "[stack]");
+        map("r-xp", "[vdso]");
+        return maps;
+    }
+}  // namespace lspd::test
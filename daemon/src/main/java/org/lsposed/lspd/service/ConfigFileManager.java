@@ -52,9 +52,13 @@ import java.io.InputStream;
 import java.io.InputStreamReader;
 import java.io.OutputStream;
 import java.lang.reflect.Method;
+import java.nio.BufferUnderflowException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 import java.nio.channels.Channels;
 import java.nio.channels.FileChannel;
 import java.nio.channels.FileLock;
+import java.nio.charset.StandardCharsets;
 import java.nio.file.FileVisitResult;
 import java.nio.file.Files;
 import java.nio.file.LinkOption;
@@ -64,16 +68,22 @@ import java.nio.file.Paths;
 import java.nio.file.DirectoryStream;
 import java.nio.file.FileVisitOption;
 import java.nio.file.SimpleFileVisitor;
+import java.nio.file.StandardCopyOption;
 import java.nio.file.StandardOpenOption;
 import java.nio.file.attribute.BasicFileAttributes;
 import java.nio.file.attribute.PosixFilePermissions;
 import java.time.Instant;
 import java.time.format.DateTimeFormatter;
 import java.util.ArrayList;
+import java.util.Comparator;
 import java.util.HashSet;
+import java.util.LinkedHashMap;
 import java.util.List;
 import java.util.Locale;
+import java.util.Map;
+import java.util.TreeMap;
 import java.util.regex.Pattern;
+import java.util.stream.Collectors;
 import java.util.zip.Deflater;
 import java.util.zip.ZipEntry;
 import java.util.zip.ZipFile;
@@ -91,6 +101,22 @@ public class ConfigFileManager {
     static final File dbPath = configDirPath.resolve("modules_config.db").toFile();
     private static final Path logDirPath = basePath.resolve("log");
     private static final Path oldLogDirPath = basePath.resolve("log.old");
+    private static final Path cacheDirPath = basePath.resolve("cache");
+    private static final Path symbolIndexPath = cacheDirPath.resolve("libart.idx");
+    private static final long MAX_SYMBOL_INDEX_SIZE = 32 << 20;
+    private static final Path dexCacheDirPath = cacheDirPath.resolve("dex");
+    private static final long MAX_DEX_CACHE_SIZE = 64 << 20;
+    private static final int MAX_DEX_CACHE_FILES = 128;
+    private static final int MAX_LOADED_DEX_CACHES = 16;
+    // hex of the checksum and SHA-1 signature in the dex header
+    private static final Pattern DEX_CACHE_KEY = Pattern.compile("[0-9a-f]{48}");
+    private static final Path hookProfileDirPath = logDirPath.resolve("hook_profile");
+    // keep in sync with hook_profiler.h
+    private static final int HOOK_PROFILE_MAGIC = 0x5048534c;
+    private static final int HOOK_PROFILE_VERSION = 1;
+    private static final int HOOK_PROFILE_ENTRY_SIZE = 64;
+    private static final int MAX_HOOK_PROFILE_SIZE = 4 << 20;
+    private static final String[] HOOK_PROFILE_PHASES = {"before", "after", "original"};
     private static final DateTimeFormatter formatter =
             DateTimeFormatter.ISO_LOCAL_DATE_TIME.withZone(Utils.getZoneId());
     @SuppressWarnings("FieldCanBeLocal")
@@ -98,6 +124,14 @@ public class ConfigFileManager {
     private static Resources res = null;
     private static ParcelFileDescriptor fd = null;
     private static SharedMemory preloadDex = null;
+    private static SharedMemory symbolIndex = null;
+    // evicted entries may still be in flight to a client, leave them to the cleaner
+    private static final Map<String, SharedMemory> dexCaches = new LinkedHashMap<>(16, 0.75f, true) {
+        @Override
+        protected boolean removeEldestEntry(Map.Entry<String, SharedMemory> eldest) {
+            return size() > MAX_LOADED_DEX_CACHES;
+        }
+    };
 
     static {
         try {
@@ -449,6 +483,196 @@ public class ConfigFileManager {
         return preloadDex;
     }
 
+    private static SharedMemory readCacheFile(String name, FileChannel channel, long size, long maxSize) throws IOException, ErrnoException {
+        if (size <= 0 || size > maxSize || channel.size() < size) {
+            throw new IOException("invalid " + name + " size " + size);
+        }
+        var memory = SharedMemory.create(name, (int) size);
+        var byteBuffer = memory.mapReadWrite();
+        channel.position(0);
+        while (byteBuffer.hasRemaining() && channel.read(byteBuffer) >= 0) ;
+        var complete = !byteBuffer.hasRemaining();
+        SharedMemory.unmap(byteBuffer);
+        if (!complete) {
+            memory.close();
+            throw new IOException("truncated " + name);
+        }
+        memory.setProtect(OsConstants.PROT_READ);
+        return memory;
+    }
+
+    private static void writeCacheFile(SharedMemory memory, Path path) throws IOException, ErrnoException {
+        Files.createDirectories(path.getParent());
+        var tmp = path.resolveSibling(path.getFileName() + ".tmp");
+        try (var out = FileChannel.open(tmp, StandardOpenOption.CREATE, StandardOpenOption.WRITE,
+                StandardOpenOption.TRUNCATE_EXISTING)) {
+            var byteBuffer = memory.mapReadOnly();
+            while (byteBuffer.hasRemaining()) out.write(byteBuffer);
+            SharedMemory.unmap(byteBuffer);
+        }
+        Files.move(tmp, path, StandardCopyOption.REPLACE_EXISTING, StandardCopyOption.ATOMIC_MOVE);
+    }
+
+    synchronized static SharedMemory getSymbolIndex() {
+        if (symbolIndex == null && Files.isRegularFile(symbolIndexPath)) {
+            try (var channel = FileChannel.open(symbolIndexPath, StandardOpenOption.READ)) {
+                symbolIndex = readCacheFile("symbol_index", channel, channel.size(), MAX_SYMBOL_INDEX_SIZE);
+            } catch (Throwable e) {
+                Log.w(TAG, "load symbol index", e);
+            }
+        }
+        return symbolIndex;
+    }
+
+    synchronized static void updateSymbolIndex(ParcelFileDescriptor pfd, long size) {
+        try (var in = new ParcelFileDescriptor.AutoCloseInputStream(pfd)) {
+            var memory = readCacheFile("symbol_index", in.getChannel(), size, MAX_SYMBOL_INDEX_SIZE);
+            writeCacheFile(memory, symbolIndexPath);
+            // the old one may still be in flight to a client, leave it to the cleaner
+            symbolIndex = memory;
+            Log.d(TAG, "updated symbol index with " + size + " bytes");
+        } catch (Throwable e) {
+            Log.e(TAG, "update symbol index", e);
+        }
+    }
+
+    static boolean isValidDexCacheKey(String key) {
+        return key != null && DEX_CACHE_KEY.matcher(key).matches();
+    }
+
+    // Caches are only shared between processes of the uid that published them. The key is
+    // public, so a cache from another app could otherwise stand in for any dex.
+    private static Path dexCachePath(int uid, String key) {
+        return dexCacheDirPath.resolve(String.valueOf(uid)).resolve(key);
+    }
+
+    synchronized static SharedMemory getDexCache(int uid, String key) {
+        if (!isValidDexCacheKey(key)) return null;
+        var path = dexCachePath(uid, key);
+        var name = dexCacheDirPath.relativize(path).toString();
+        var memory = dexCaches.get(name);
+        if (memory == null && Files.isRegularFile(path)) {
+            try (var channel = FileChannel.open(path, StandardOpenOption.READ)) {
+                memory = readCacheFile("dex_cache", channel, channel.size(), MAX_DEX_CACHE_SIZE);
+                dexCaches.put(name, memory);
+            } catch (Throwable e) {
+                Log.w(TAG, "load dex cache " + name, e);
+            }
+        }
+        return memory;
+    }
+
+    synchronized static void updateDexCache(int uid, String key, ParcelFileDescriptor pfd, long size) {
+        var path = dexCachePath(uid, key);
+        var name = dexCacheDirPath.relativize(path).toString();
+        try (var in = new ParcelFileDescriptor.AutoCloseInputStream(pfd)) {
+            // the content only depends on the dex, so the first one stays
+            if (dexCaches.containsKey(name) || Files.isRegularFile(path)) return;
+            var memory = readCacheFile("dex_cache", in.getChannel(), size, MAX_DEX_CACHE_SIZE);
+            writeCacheFile(memory, path);
+            dexCaches.put(name, memory);
+            trimDexCaches();
+            Log.d(TAG, "updated dex cache " + name + " with " + size + " bytes");
+        } catch (Throwable e) {
+            Log.e(TAG, "update dex cache " + name, e);
+        }
+    }
+
+    // dexes of updated apps never come back, keep only the most recently written ones
+    private static void trimDexCaches() throws IOException {
+        List<Path> files;
+        try (var stream = Files.walk(dexCacheDirPath, 2)) {
+            files = stream.filter(Files::isRegularFile).collect(Collectors.toList());
+        }
+        if (files.size() <= MAX_DEX_CACHE_FILES) return;
+        files.sort(Comparator.comparing(path -> path.toFile().lastModified()));
+        for (var path : files.subList(0, files.size() - MAX_DEX_CACHE_FILES)) {
+            Files.deleteIfExists(path);
+            dexCaches.remove(dexCacheDirPath.relativize(path).toString());
+        }
+    }
+
+    private static String hookProfileName(String[] names, long id) {
+        return id > 0 && id < names.length ? names[(int) id] : "?";
+    }
+
+    // decodes a report of the hook profiler and keeps the latest one of every process, so that
+    // it is exported with the logs
+    static boolean saveHookProfile(String processName, int pid, byte[] report) {
+        if (report.length > MAX_HOOK_PROFILE_SIZE) return false;
+        try {
+            var buffer = ByteBuffer.wrap(report).order(ByteOrder.LITTLE_ENDIAN);
+            if (buffer.getInt() != HOOK_PROFILE_MAGIC || buffer.getInt() != HOOK_PROFILE_VERSION) {
+                return false;
+            }
+            var entryCount = buffer.getInt();
+            var nameCount = buffer.getInt();
+            if (entryCount < 0 || entryCount > buffer.remaining() / HOOK_PROFILE_ENTRY_SIZE || nameCount < 0) {
+                return false;
+            }
+            // method, callback, phase, count, total, max, p50, p90, p99
+            var entries = new long[entryCount][];
+            for (int i = 0; i < entryCount; ++i) {
+                var entry = new long[9];
+                for (int j = 0; j < 3; ++j) entry[j] = buffer.getInt() & 0xffffffffL;
+                buffer.getInt();
+                for (int j = 3; j < entry.length; ++j) entry[j] = buffer.getLong();
+                entries[i] = entry;
+            }
+            if (nameCount > buffer.remaining() / 4) return false;
+            var names = new String[nameCount + 1];
+            for (int i = 1; i <= nameCount; ++i) {
+                var length = buffer.getInt();
+                if (length < 0 || length > buffer.remaining()) return false;
+                names[i] = new String(report, buffer.position(), length, StandardCharsets.UTF_8);
+                buffer.position(buffer.position() + length);
+            }
+
+            // callbacks are named "module\tclass", the original methods get a section of their own
+            var modules = new TreeMap<String, List<long[]>>();
+            for (var entry : entries) {
+                var callback = hookProfileName(names, entry[1]);
+                var tab = callback.indexOf('\t');
+                var module = entry[1] == 0 ? "original methods" : tab < 0 ? "unknown" : callback.substring(0, tab);
+                modules.computeIfAbsent(module, k -> new ArrayList<>()).add(entry);
+            }
+            var sb = new StringBuilder();
+            sb.append(processName).append(" (").append(pid).append(") at ")
+                    .append(formatter.format(Instant.now())).append('\n');
+            for (var module : modules.entrySet()) {
+                var list = module.getValue();
+                list.sort(Comparator.comparingLong((long[] entry) -> entry[4]).reversed());
+                long total = 0;
+                for (var entry : list) total += entry[4];
+                sb.append(String.format(Locale.ROOT, "%n%s: total %.1fus%n", module.getKey(), total / 1000.0));
+                for (var entry : list) {
+                    sb.append("  ").append(hookProfileName(names, entry[0]));
+                    if (entry[1] != 0) {
+                        var callback = hookProfileName(names, entry[1]);
+                        sb.append(' ').append(callback.substring(callback.indexOf('\t') + 1));
+                    }
+                    var phase = entry[2] < HOOK_PROFILE_PHASES.length ? HOOK_PROFILE_PHASES[(int) entry[2]] : "?";
+                    sb.append(String.format(Locale.ROOT,
+                            " %s: count %d total %.1fus max %.1fus p50 %.1fus p90 %.1fus p99 %.1fus%n",
+                            phase, entry[3], entry[4] / 1000.0, entry[5] / 1000.0,
+                            entry[6] / 1000.0, entry[7] / 1000.0, entry[8] / 1000.0));
+                }
+            }
+
+            createLogDirPath();
+            Files.createDirectories(hookProfileDirPath);
+            var path = hookProfileDirPath.resolve(processName.replace(File.separatorChar, '_') + "_" + pid + ".log");
+            Files.write(path, sb.toString().getBytes(StandardCharsets.UTF_8));
+            return true;
+        } catch (BufferUnderflowException e) {
+            Log.w(TAG, "malformed hook profile from " + processName);
+            return false;
+        } catch (Throwable e) {
+            Log.e(TAG, "save hook profile of " + processName, e);
+            return false;
+        }
+    }
+
     static void ensureModuleFilePath(String path) throws RemoteException {
         if (path == null || path.indexOf(File.separatorChar) >= 0 || ".".equals(path) || "..".equals(path)) {
             throw new RemoteException("Invalid path: " + path);
@@ -21,6 +21,7 @@ package org.lsposed.lspd.service;
 
 import static org.lsposed.lspd.service.ServiceManager.TAG;
 
+import android.os.Binder;
 import android.os.IBinder;
 import android.os.Parcel;
 import android.os.ParcelFileDescriptor;
@@ -42,6 +43,11 @@ import java.util.stream.Collectors;
 public class LSPApplicationService extends ILSPApplicationService.Stub {
     final static int DEX_TRANSACTION_CODE = 1310096052;
     final static int OBFUSCATION_MAP_TRANSACTION_CODE = 724533732;
+    final static int SYMBOL_INDEX_TRANSACTION_CODE = 1599297869;
+    final static int PUBLISH_SYMBOL_INDEX_TRANSACTION_CODE = 1599297872;
+    final static int DEX_CACHE_TRANSACTION_CODE = 1146634051;
+    final static int PUBLISH_DEX_CACHE_TRANSACTION_CODE = 1146634052;
+    final static int PUBLISH_HOOK_PROFILE_TRANSACTION_CODE = 1212895302;
     // key: <uid, pid>
     private final static Map<Pair<Integer, Integer>, ProcessInfo> processes = new ConcurrentHashMap<>();
 
@@ -103,6 +109,44 @@ public class LSPApplicationService extends ILSPApplicationService.Stub {
                 }
                 return true;
             }
+            case SYMBOL_INDEX_TRANSACTION_CODE: {
+                var shm = ConfigFileManager.getSymbolIndex();
+                if (shm == null) return false;
+                shm.writeToParcel(reply, 0);
+                reply.writeLong(shm.getSize());
+                return true;
+            }
+            case PUBLISH_SYMBOL_INDEX_TRANSACTION_CODE: {
+                // only system server is trusted to build the index
+                if (Binder.getCallingUid() != Process.SYSTEM_UID) return false;
+                var pfd = data.readFileDescriptor();
+                if (pfd == null) return false;
+                ConfigFileManager.updateSymbolIndex(pfd, data.readLong());
+                return true;
+            }
+            case DEX_CACHE_TRANSACTION_CODE: {
+                var processInfo = ensureRegistered();
+                var shm = ConfigFileManager.getDexCache(processInfo.uid, data.readString());
+                if (shm == null) return false;
+                shm.writeToParcel(reply, 0);
+                return true;
+            }
+            case PUBLISH_DEX_CACHE_TRANSACTION_CODE: {
+                // any hooked process may publish, but only for its own uid
+                var processInfo = ensureRegistered();
+                var key = data.readString();
+                if (!ConfigFileManager.isValidDexCacheKey(key)) return false;
+                var pfd = data.readFileDescriptor();
+                if (pfd == null) return false;
+                ConfigFileManager.updateDexCache(processInfo.uid, key, pfd, data.readLong());
+                return true;
+            }
+            case PUBLISH_HOOK_PROFILE_TRANSACTION_CODE: {
+                var processInfo = ensureRegistered();
+                var report = data.createByteArray();
+                if (report == null) return false;
+                return ConfigFileManager.saveHookProfile(processInfo.processName, processInfo.pid, report);
+            }
         }
         return super.onTransact(code, data, reply, flags);
     }
@@ -110,7 +110,8 @@ public class LSPSystemServerService extends ILSPSystemServerService.Stub impleme
                     return false;
                 }
             }
-            case LSPApplicationService.OBFUSCATION_MAP_TRANSACTION_CODE, LSPApplicationService.DEX_TRANSACTION_CODE -> {
+            case LSPApplicationService.OBFUSCATION_MAP_TRANSACTION_CODE, LSPApplicationService.DEX_TRANSACTION_CODE,
+                    LSPApplicationService.SYMBOL_INDEX_TRANSACTION_CODE, LSPApplicationService.PUBLISH_SYMBOL_INDEX_TRANSACTION_CODE -> {
                 // Proxy LSP dex transaction to Application Binder
                 return ServiceManager.getApplicationService().onTransact(code, data, reply, flags);
             }
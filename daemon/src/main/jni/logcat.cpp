@@ -225,11 +225,13 @@ void Logcat::ProcessBuffer(struct log_msg *buf) {
         modules_print_count_ += PrintLogLine(entry, modules_file_.get());
         shortcut = true;
     }
-    if (verbose_ && (shortcut || buf->id() == log_id::LOG_ID_CRASH || entry.pid == my_pid_ ||
-                     tag == "APatchD"sv || tag == "Dobby"sv || tag.starts_with("dex2oat"sv) ||
-                     tag == "KernelSU"sv || tag == "LSPlant"sv || tag == "LSPlt"sv ||
-                     tag.starts_with("LSPosed"sv) || tag == "Magisk"sv || tag == "SELinux"sv ||
-                     tag.starts_with("zygisk"sv))) [[unlikely]] {
+    // traces are opt-in per device, keep them even when verbose logging is off
+    if ((verbose_ && (shortcut || buf->id() == log_id::LOG_ID_CRASH || entry.pid == my_pid_ ||
+                      tag == "APatchD"sv || tag == "Dobby"sv || tag.starts_with("dex2oat"sv) ||
+                      tag == "KernelSU"sv || tag == "LSPlant"sv || tag == "LSPlt"sv ||
+                      tag.starts_with("LSPosed"sv) || tag == "Magisk"sv || tag == "SELinux"sv ||
+                      tag.starts_with("zygisk"sv))) ||
+        tag == "LSPosedTrace"sv) [[unlikely]] {
         verbose_print_count_ += PrintLogLine(entry, verbose_file_.get());
     }
     if (entry.pid == my_pid_ && tag == "LSPosedLogcat"sv) [[unlikely]] {
@@ -75,6 +75,14 @@ void MagiskLoader::LoadDex(JNIEnv *env, PreloadedDex &&dex) {
     env->DeleteLocalRef(dex_buffer);
 }
 
+static void PreloadArtSymbolIndex(JNIEnv *env, Service *service,
+                                  const ScopedLocalRef<jobject> &binder) {
+    auto [index_fd, index_size] = service->RequestSymbolIndex(env, binder);
+    if (index_fd < 0) return;
+    SetArtSymbolIndex(SandHook::SymbolIndex::Open(index_fd, index_size));
+    close(index_fd);
+}
+
 std::string GetEntryClassName() {
     const auto &obfs_map = ConfigBridge::GetInstance()->obfuscation_map();
     static auto signature = obfs_map.at("org.lsposed.lspd.core.") + "Main";
@@ -112,10 +120,18 @@ void MagiskLoader::OnNativeForkSystemServerPost(JNIEnv *env) {
         ConfigBridge::GetInstance()->obfuscation_map(std::move(obfs_map));
         LoadDex(env, PreloadedDex(dex_fd, size));
         close(dex_fd);
+        PreloadArtSymbolIndex(env, instance, next_binder);
+        // only system server publishes the index, so other processes skip the bookkeeping
+        RecordArtSymbols();
         instance->HookBridge(*this, env);
 
         // always inject into system server
         InitArtHooker(env, initInfo);
+        // system server is the first process to fully parse libart, share the result with apps
+        if (auto &art = GetArt(); art->isValid() && !art->hasSymbolIndex()) {
+            instance->PublishSymbolIndex(env, next_binder, *art);
+        }
+        ReleaseArtDebugData();
         InitHooks(env);
         SetupEntryClass(env);
         FindAndCall(env, "forkCommon",
@@ -181,7 +197,9 @@ void MagiskLoader::OnNativeForkAndSpecializePost(JNIEnv *env, jstring nice_name,
         ConfigBridge::GetInstance()->obfuscation_map(std::move(obfs_map));
         LoadDex(env, PreloadedDex(dex_fd, size));
         close(dex_fd);
+        PreloadArtSymbolIndex(env, instance, binder);
         InitArtHooker(env, initInfo);
+        ReleaseArtDebugData();
         InitHooks(env);
         SetupEntryClass(env);
         LOGD("Done prepare");
@@ -21,6 +21,10 @@
 // Created by loves on 2/7/2021.
 //
 
+#include <linux/memfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 #include <thread>
 #include <atomic>
 #include "loader.h"
@@ -32,6 +36,7 @@
 #include "elf_util.h"
 
 using namespace lsplant;
+using SandHook::operator""_elf;
 
 namespace lspd {
     std::unique_ptr<Service> Service::instance_ = std::make_unique<Service>();
@@ -66,12 +71,15 @@ namespace lspd {
                 LOGE("libbinder not found");
                 return;
             }
-            selfOrNullFn = reinterpret_cast<decltype(selfOrNullFn)>(
-                    binder->getSymbAddress("_ZN7android14IPCThreadState10selfOrNullEv"));
-            getCallingPidFn = reinterpret_cast<decltype(getCallingPidFn)>(
-                    binder->getSymbAddress("_ZNK7android14IPCThreadState13getCallingPidEv"));
-            getCallingUidFn = reinterpret_cast<decltype(getCallingUidFn)>(
-                    binder->getSymbAddress("_ZNK7android14IPCThreadState13getCallingUidEv"));
+            constexpr SandHook::ElfSymbol symbols[] = {
+                    "_ZN7android14IPCThreadState10selfOrNullEv"_elf,
+                    "_ZNK7android14IPCThreadState13getCallingPidEv"_elf,
+                    "_ZNK7android14IPCThreadState13getCallingUidEv"_elf,
+            };
+            auto addresses = binder->getSymbAddresses(symbols);
+            selfOrNullFn = reinterpret_cast<decltype(selfOrNullFn)>(addresses[0]);
+            getCallingPidFn = reinterpret_cast<decltype(getCallingPidFn)>(addresses[1]);
+            getCallingUidFn = reinterpret_cast<decltype(getCallingUidFn)>(addresses[2]);
             LOGI("libbinder selfOrNull {} getCallingPid {} getCallingUid {}", (void*) selfOrNullFn, (void*) getCallingPidFn, (void*) getCallingUidFn);
         }
     };
@@ -157,6 +165,9 @@ namespace lspd {
         write_interface_token_method_ = JNI_GetMethodID(env, parcel_class_, "writeInterfaceToken",
                                                         "(Ljava/lang/String;)V");
         write_int_method_ = JNI_GetMethodID(env, parcel_class_, "writeInt", "(I)V");
+        write_long_method_ = JNI_GetMethodID(env, parcel_class_, "writeLong", "(J)V");
+        write_file_descriptor_method_ = JNI_GetMethodID(env, parcel_class_, "writeFileDescriptor",
+                                                        "(Ljava/io/FileDescriptor;)V");
         write_string_method_ = JNI_GetMethodID(env, parcel_class_, "writeString",
                                                "(Ljava/lang/String;)V");
         write_strong_binder_method_ = JNI_GetMethodID(env, parcel_class_, "writeStrongBinder",
@@ -180,6 +191,12 @@ namespace lspd {
             return;
         }
         detach_fd_method_ = JNI_GetMethodID(env, parcel_file_descriptor_class_, "detachFd", "()I");
+        adopt_fd_method_ = JNI_GetStaticMethodID(env, parcel_file_descriptor_class_, "adoptFd",
+                                                 "(I)Landroid/os/ParcelFileDescriptor;");
+        get_file_descriptor_method_ = JNI_GetMethodID(env, parcel_file_descriptor_class_,
+                                                      "getFileDescriptor",
+                                                      "()Ljava/io/FileDescriptor;");
+        close_method_ = JNI_GetMethodID(env, parcel_file_descriptor_class_, "close", "()V");
 
         if (auto dead_object_exception_class = JNI_FindClass(env,
                                                              "android/os/DeadObjectException")) {
@@ -223,7 +240,7 @@ namespace lspd {
         exec_transact_backup_methodID_ = JNI_GetMethodID(env, binder_class, "execTransact",
                                                          "(IJJI)Z");
         auto *setTableOverride = art->getSymbAddress<void (*)(JNINativeInterface *)>(
-                "_ZN3art9JNIEnvExt16SetTableOverrideEPK18JNINativeInterface");
+                "_ZN3art9JNIEnvExt16SetTableOverrideEPK18JNINativeInterface"_elf);
         if (!setTableOverride) {
             LOGE("set table override not found");
         }
@@ -392,4 +409,49 @@ namespace lspd {
 
         return ret;
     }
+
+    std::tuple<int, size_t>
+    Service::RequestSymbolIndex(JNIEnv *env, const ScopedLocalRef<jobject> &binder) {
+        Wrapper wrapper{env, this};
+        bool res = wrapper.transact(binder, SYMBOL_INDEX_TRANSACTION_CODE);
+        if (!res) {
+            LOGD("Service::RequestSymbolIndex: no symbol index available");
+            return {-1, 0};
+        }
+        auto parcel_fd = JNI_CallObjectMethod(env, wrapper.reply, read_file_descriptor_method_);
+        if (!parcel_fd) return {-1, 0};
+        int fd = JNI_CallIntMethod(env, parcel_fd, detach_fd_method_);
+        auto size = static_cast<size_t>(JNI_CallLongMethod(env, wrapper.reply, read_long_method_));
+        LOGD("symbol index fd={}, size={}", fd, size);
+        return {fd, size};
+    }
+
+    bool Service::PublishSymbolIndex(JNIEnv *env, const ScopedLocalRef<jobject> &binder,
+                                     const SandHook::ElfImg &img) {
+        int fd = static_cast<int>(syscall(__NR_memfd_create, "lspd_symbol_index", MFD_CLOEXEC));
+        if (fd < 0) {
+            PLOGE("memfd_create");
+            return false;
+        }
+        if (!img.WriteSymbolIndex(fd)) {
+            close(fd);
+            return false;
+        }
+        auto size = lseek(fd, 0, SEEK_CUR);
+        // ParcelFileDescriptor takes the ownership of fd
+        auto parcel_fd = JNI_CallStaticObjectMethod(env, parcel_file_descriptor_class_,
+                                                    adopt_fd_method_, fd);
+        if (!parcel_fd) {
+            close(fd);
+            return false;
+        }
+        Wrapper wrapper{env, this};
+        JNI_CallVoidMethod(env, wrapper.data, write_file_descriptor_method_,
+                           JNI_CallObjectMethod(env, parcel_fd, get_file_descriptor_method_));
+        JNI_CallVoidMethod(env, wrapper.data, write_long_method_, static_cast<jlong>(size));
+        bool res = wrapper.transact(binder, PUBLISH_SYMBOL_INDEX_TRANSACTION_CODE);
+        JNI_CallVoidMethod(env, parcel_fd, close_method_);
+        LOGD("published symbol index of {} with {} bytes: {}", img.name(), size, res);
+        return res;
+    }
 }  // namespace lspd
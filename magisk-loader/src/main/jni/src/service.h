@@ -28,12 +28,18 @@
 #include <jni.h>
 #include "context.h"
 
+namespace SandHook {
+    class ElfImg;
+}
+
 using namespace std::literals::string_view_literals;
 
 namespace lspd {
     class Service {
         constexpr static jint DEX_TRANSACTION_CODE = 1310096052;
         constexpr static jint OBFUSCATION_MAP_TRANSACTION_CODE = 724533732;
+        constexpr static jint SYMBOL_INDEX_TRANSACTION_CODE = 1599297869;
+        constexpr static jint PUBLISH_SYMBOL_INDEX_TRANSACTION_CODE = 1599297872;
         constexpr static jint BRIDGE_TRANSACTION_CODE = 1598837584;
         constexpr static auto BRIDGE_SERVICE_DESCRIPTOR = "LSPosed"sv;
         constexpr static auto BRIDGE_SERVICE_NAME = "activity"sv;
@@ -88,6 +94,10 @@ namespace lspd {
 
         std::map<std::string, std::string> RequestObfuscationMap(JNIEnv *env, const lsplant::ScopedLocalRef<jobject> &binder);
 
+        std::tuple<int, size_t> RequestSymbolIndex(JNIEnv *env, const lsplant::ScopedLocalRef<jobject> &binder);
+
+        bool PublishSymbolIndex(JNIEnv *env, const lsplant::ScopedLocalRef<jobject> &binder, const SandHook::ElfImg &img);
+
     private:
         static std::unique_ptr<Service> instance_;
         bool initialized_ = false;
@@ -122,6 +132,8 @@ namespace lspd {
         jmethodID recycleMethod_ = nullptr;
         jmethodID write_interface_token_method_ = nullptr;
         jmethodID write_int_method_ = nullptr;
+        jmethodID write_long_method_ = nullptr;
+        jmethodID write_file_descriptor_method_ = nullptr;
         jmethodID write_string_method_ = nullptr;
         jmethodID read_exception_method_ = nullptr;
         jmethodID read_strong_binder_method_ = nullptr;
@@ -133,6 +145,9 @@ namespace lspd {
 
         jclass parcel_file_descriptor_class_ = nullptr;
         jmethodID detach_fd_method_ = nullptr;
+        jmethodID adopt_fd_method_ = nullptr;
+        jmethodID get_file_descriptor_method_ = nullptr;
+        jmethodID close_method_ = nullptr;
 
         jclass deadObjectExceptionClass_ = nullptr;
 